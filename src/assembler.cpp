@@ -22,8 +22,8 @@ void AssemblyLexer::populateMaps() {
 }
 
 void AssemblyLexer::readFnTable() {
-    auto firstLinePos = sourceMap.sourceInfo.source->find('\n');
-    auto firstLine = sourceMap.sourceInfo.source->substr(0, firstLinePos);
+    auto firstLinePos = source->find('\n');
+    auto firstLine = source->substr(0, firstLinePos);
 
     istringstream iss(firstLine);
     int32_t count;
@@ -35,9 +35,8 @@ void AssemblyLexer::readFnTable() {
         hash_insert(fnTable, fnIndex, (uint64_t) instIndex);
     }
 
-    sourceMap.sourceInfo.source = new string(
-            sourceMap.sourceInfo.source->substr(firstLine.length() + 1,
-                                                sourceMap.sourceInfo.source->size() - firstLine.length()));
+    source = new string(source->substr(firstLine.length() + 1, source->size() - firstLine.length()));
+    sourceFileFor(sourceMap.sourceInfo)->source = source;
 }
 
 AssemblyLexer::AssemblyLexer(string fileName)  {
@@ -51,13 +50,11 @@ AssemblyLexer::AssemblyLexer(string fileName)  {
     fileBytes.assign((istreambuf_iterator<char>(t)),
                 istreambuf_iterator<char>());
 
-    auto lines = vector_init<unsigned long>(1);
-    vector_append(lines, (unsigned long) 0);
+    source = new string(fileBytes);
+    sourceMap.sourceInfo = addSourceFile(new string(fileName), source);
 
-    sourceMap.sourceInfo = {new string(fileName), new string(fileBytes), lines};
-
-    lastLoc = {0, 0, 0};
-    loc = {0, 0, 0};
+    lastLoc = {0};
+    loc = {0};
 
     readFnTable();
 
@@ -141,15 +138,15 @@ void AssemblyLexer::popFront() {
     Token newNext;
 
     // ignore whitespace
-    while (loc.byteIndex < sourceMap.sourceInfo.source->length() && isspace(sourceMap.sourceInfo.source->at(loc.byteIndex))) {
+    while (loc.byteIndex < source->length() && isspace(source->at(loc.byteIndex))) {
         eat();
     }
     lastLoc = loc;
 
     // Comment
-    if (startsWith(sourceMap.sourceInfo.source, loc.byteIndex, "--")) {
+    if (startsWith(source, loc.byteIndex, "--")) {
         // eat until newline
-        while (loc.byteIndex < sourceMap.sourceInfo.source->length() && sourceMap.sourceInfo.source->at(loc.byteIndex) != '\n') {
+        while (loc.byteIndex < source->length() && source->at(loc.byteIndex) != '\n') {
             eat();
         }
 
@@ -161,13 +158,13 @@ void AssemblyLexer::popFront() {
     }
 
     // ignore whitespace (again)
-    while (loc.byteIndex < sourceMap.sourceInfo.source->length() && isspace(sourceMap.sourceInfo.source->at(loc.byteIndex))) {
+    while (loc.byteIndex < source->length() && isspace(source->at(loc.byteIndex))) {
         eat();
     }
     lastLoc = loc;
 
     // look for EOF
-    if (loc.byteIndex >= sourceMap.sourceInfo.source->length()) {
+    if (loc.byteIndex >= source->length()) {
         newNext.type = TokenType::EOF_;
         argCount = 0;
         popFrontFinalize(newNext, {});
@@ -179,7 +176,7 @@ void AssemblyLexer::popFront() {
     for (const auto &memberName : tokenTypeStrings) {
         auto member = *hash_get(nameToTokenType, memberName);
 
-        if (startsWith(sourceMap.sourceInfo.source, loc.byteIndex, memberName)) {
+        if (startsWith(source, loc.byteIndex, memberName)) {
             auto startIndex = loc.byteIndex;
 
             newNext.type = member;
@@ -189,7 +186,7 @@ void AssemblyLexer::popFront() {
             }
 
             auto newInst = *hash_get(nameToInstruction,
-                                     sourceMap.sourceInfo.source->substr(startIndex, memberName.length()));
+                                     source->substr(startIndex, memberName.length()));
             popFrontFinalize(newNext, {static_cast<unsigned char>(newInst)});
 
             return;
@@ -198,13 +195,13 @@ void AssemblyLexer::popFront() {
 
     // maybe it's an integer or floating point literal
     auto startIndex = loc.byteIndex;
-    while (sourceMap.sourceInfo.source->at(loc.byteIndex) == '-'
-        || isdigit(sourceMap.sourceInfo.source->at(loc.byteIndex))
-        || sourceMap.sourceInfo.source->at(loc.byteIndex) == '.') {
+    while (source->at(loc.byteIndex) == '-'
+        || isdigit(source->at(loc.byteIndex))
+        || source->at(loc.byteIndex) == '.') {
         eat();
     }
 
-    auto toParse = sourceMap.sourceInfo.source->substr(startIndex, loc.byteIndex - startIndex);
+    auto toParse = source->substr(startIndex, loc.byteIndex - startIndex);
 
     if (toParse.empty()) {
         newNext.type = TokenType::EOF_;
@@ -283,7 +280,7 @@ void AssemblyLexer::popFrontFinalize(Token newNext, vector<unsigned char> newIns
 //        });
 
         // ignore whitespace
-        while (loc.byteIndex < sourceMap.sourceInfo.source->length() && isspace(sourceMap.sourceInfo.source->at(loc.byteIndex))) {
+        while (loc.byteIndex < source->length() && isspace(source->at(loc.byteIndex))) {
             eat();
         }
         savedLoc = loc;
@@ -295,17 +292,7 @@ void AssemblyLexer::popFrontFinalize(Token newNext, vector<unsigned char> newIns
 }
 
 void AssemblyLexer::eat() {
-    auto frontChar = sourceMap.sourceInfo.source->at(loc.byteIndex);
-
-    if (frontChar == '\n') {
-        loc.line += 1;
-        loc.col = 1;
-
-        vector_append(sourceMap.sourceInfo.lines, loc.byteIndex + 1);
-    }
-    else {
-        loc.col += 1;
-    }
+    auto frontChar = source->at(loc.byteIndex);
 
     loc.byteIndex += bytesInCodepoint(frontChar);
 }
@@ -416,6 +403,7 @@ const vector<string> AssemblyLexer::instructionStrings = {
     "NOT",
     "BITNOT",
     "CONVERT",
+    "RODATA",
 
     // literals
     "CONSTI8", "CONSTI16", "CONSTI32", "CONSTI64", "CONSTF32", "CONSTF64",
@@ -424,6 +412,8 @@ const vector<string> AssemblyLexer::instructionStrings = {
     "I8", "I16", "I32", "I64", "F32", "F64",
 
     "RELCONSTI32", "RELI32", "RELCONSTI64", "RELI64", "RELI8", "RELI16", "RELF32", "RELF64",
+
+    "RODATAI64",
 };
 
 
@@ -601,6 +591,21 @@ void MnemonicPrinter::step() {
         auto toType = consume<int32_t>();
         instructionString.append(to_string(toType));
         readTypeAndInt();
+    } else if (inst == "RODATA") {
+        instructionString.append(inst);
+        instructionString.append(" ");
+        auto length = consume<int64_t>();
+        instructionString.append(to_string(length));
+
+        // the block itself as hex, so the listing has everything the bytecode does
+        const char *hexDigits = "0123456789abcdef";
+        instructionString.append(" ");
+        for (int64_t i = 0; i < length; i++) {
+            auto byte = instructions[pc + i];
+            instructionString.push_back(hexDigits[byte >> 4]);
+            instructionString.push_back(hexDigits[byte & 0xf]);
+        }
+        pc += length;
     } else if (startsWith(&inst, "PUTS")) {
         instructionString.append(inst);
         instructionString.append(" ");
@@ -679,3 +684,119 @@ void MnemonicPrinter::readTypeAndFloat()
         instructionString.append("<<<error>>>");
     }
 }
+
+// the size of the T a math instruction reads both of its operands as
+uint64_t mathOperandBytes(Instruction inst) {
+    if (inst <= Instruction::SLEI8) { return 1; }
+    if (inst <= Instruction::SLEI16) { return 2; }
+    if (inst <= Instruction::SLEI32) { return 4; }
+    if (inst <= Instruction::SLEI64) { return 8; }
+    if (inst <= Instruction::GEF32) { return 4; }
+    return 8;
+}
+
+// bytes taken up by a read<T> operand, tag included
+uint64_t operandLength(const vector<unsigned char> &code, uint64_t at, uint64_t valueBytes) {
+    switch ((Instruction) code[at]) {
+        case Instruction::RELCONSTI32:
+        case Instruction::RELCONSTI64:
+        case Instruction::CONSTI8:
+        case Instruction::CONSTI16:
+        case Instruction::CONSTI32:
+        case Instruction::CONSTI64:
+        case Instruction::CONSTF32:
+        case Instruction::CONSTF64:
+            return 1 + valueBytes;
+        default:
+            return 1 + sizeof(int64_t);
+    }
+}
+
+uint64_t storeConstLength(Instruction tag) {
+    switch (tag) {
+        case Instruction::CONSTI8: return 1;
+        case Instruction::CONSTI16: return 2;
+        case Instruction::CONSTI32:
+        case Instruction::CONSTF32:
+            return 4;
+        default: return 8;
+    }
+}
+
+uint64_t instructionLength(const vector<unsigned char> &code, uint64_t at) {
+    auto inst = (Instruction) code[at];
+    auto p = at + 1;
+
+    if (inst <= Instruction::GEF64) {
+        auto bytes = mathOperandBytes(inst);
+        p += operandLength(code, p, bytes);
+        p += operandLength(code, p, bytes);
+        if (inst == Instruction::ADD_S_I64 || inst == Instruction::SUB_S_I64) {
+            p += sizeof(int32_t);
+        }
+        return p + sizeof(int64_t) - at;
+    }
+
+    switch (inst) {
+        case Instruction::BITAND:
+        case Instruction::BITOR:
+        case Instruction::BITXOR:
+        case Instruction::BITSHL:
+        case Instruction::BITSHR: {
+            p += sizeof(int32_t) + 3 * sizeof(int64_t);
+        } break;
+        case Instruction::STORECONST: {
+            p += operandLength(code, p, sizeof(int64_t));
+            p += 1 + storeConstLength((Instruction) code[p]);
+        } break;
+        case Instruction::STORE: {
+            p += operandLength(code, p, sizeof(int64_t));
+            p += operandLength(code, p, sizeof(int64_t));
+            p += sizeof(int32_t);
+        } break;
+        case Instruction::STORE_RELCONST_RELCONST: {
+            p += 2 * sizeof(int64_t) + sizeof(int32_t);
+        } break;
+        case Instruction::BUMPSP:
+        case Instruction::JUMP:
+        case Instruction::CALLE:
+        case Instruction::CALL: {
+            p += sizeof(int32_t);
+        } break;
+        case Instruction::JUMPIF: {
+            for (auto i = 0; i < 3; i++) {
+                p += operandLength(code, p, sizeof(int32_t));
+            }
+        } break;
+        case Instruction::CALLI:
+        case Instruction::PUTS: {
+            p += operandLength(code, p, sizeof(int64_t));
+        } break;
+        case Instruction::NOT: {
+            p += sizeof(int64_t);
+        } break;
+        case Instruction::BITNOT: {
+            p += sizeof(int32_t) + sizeof(int64_t);
+        } break;
+        case Instruction::CONVERT: {
+            p += 2 * (sizeof(int32_t) + sizeof(int64_t));
+        } break;
+        case Instruction::RODATA: {
+            p += sizeof(int64_t) + bytesTo<int64_t>(code, p);
+        } break;
+        case Instruction::RET:
+        case Instruction::EXIT:
+        case Instruction::PANIC:
+        case Instruction::NOP:
+            break;
+        default: cpi_assert(false);
+    }
+
+    return p - at;
+}
+
+// jumpif's targets are always constants when they come out of BytecodeGen
+int64_t constantJumpTarget(const vector<unsigned char> &code, uint64_t at) {
+    if ((Instruction) code[at] != Instruction::CONSTI32) { return -1; }
+    return bytesTo<int32_t>(code, at + 1);
+}
@@ -113,6 +113,7 @@ enum class Instruction : unsigned char {
     NOT,
     BITNOT,
     CONVERT,
+    RODATA,
 
     // literals
     CONSTI8, CONSTI16, CONSTI32, CONSTI64, CONSTF32, CONSTF64,
@@ -122,6 +123,9 @@ enum class Instruction : unsigned char {
 
     // relative literals
     RELCONSTI32, RELI32, RELCONSTI64, RELI64, RELI8, RELI16, RELF32, RELF64,
+
+    // an offset into the instructions, where a RODATA block keeps the bytes
+    RODATAI64,
 };
 
 struct Token {
@@ -137,6 +141,8 @@ public:
     Location lastLoc = {};
     Location loc = {};
 
+    string *source = nullptr;
+
     vector<unsigned char> instructions = {};
     hash_t<uint32_t, uint64_t> *fnTable;
 
@@ -166,6 +172,18 @@ private:
     int getArgCount(TokenType tt);
 };
 
+// walking a stream of instructions: the bytes the instruction at `at` takes up, operands included
+uint64_t instructionLength(const vector<unsigned char> &code, uint64_t at);
+
+// the size of the T a math instruction reads both of its operands as
+uint64_t mathOperandBytes(Instruction inst);
+
+// bytes taken up by a read<T> operand, tag included
+uint64_t operandLength(const vector<unsigned char> &code, uint64_t at, uint64_t valueBytes);
+
+// a jumpif target operand's value, or -1 if it isn't a constant
+int64_t constantJumpTarget(const vector<unsigned char> &code, uint64_t at);
+
 class MnemonicPrinter {
 public:
     const vector<unsigned char> &instructions;
@@ -0,0 +1,795 @@
+#include "bytecodecompiler.h"
+#include "assembler.h"
+
+#include <algorithm>
+
+// the same as the interpreter's
+const uint64_t bytecodeStackSize = 2048 * 64;
+
+enum class MathOp {
+    ADD, ADD_S, SUB, SUB_S, MUL, UDIV, SDIV, UREM, SREM,
+    EQ, NEQ, UGT, SGT, UGE, SGE, ULT, SLT, ULE, SLE
+};
+
+// in the order the instructions of each width are declared in
+const MathOp intMathOps[] = {
+        MathOp::ADD, MathOp::SUB, MathOp::MUL, MathOp::UDIV, MathOp::SDIV, MathOp::UREM, MathOp::SREM,
+        MathOp::EQ, MathOp::NEQ, MathOp::UGT, MathOp::SGT, MathOp::UGE, MathOp::SGE, MathOp::ULT, MathOp::SLT,
+        MathOp::ULE, MathOp::SLE};
+const MathOp i64MathOps[] = {
+        MathOp::ADD, MathOp::ADD_S, MathOp::SUB, MathOp::SUB_S, MathOp::MUL, MathOp::UDIV, MathOp::SDIV,
+        MathOp::UREM, MathOp::SREM, MathOp::EQ, MathOp::NEQ, MathOp::UGT, MathOp::SGT, MathOp::UGE, MathOp::SGE,
+        MathOp::ULT, MathOp::SLT, MathOp::ULE, MathOp::SLE};
+const MathOp floatMathOps[] = {
+        MathOp::ADD, MathOp::SUB, MathOp::MUL, MathOp::SDIV,
+        MathOp::EQ, MathOp::NEQ, MathOp::SLT, MathOp::SLE, MathOp::SGT, MathOp::SGE};
+
+MathOp mathOpFor(Instruction inst) {
+    auto i = (unsigned char) inst;
+    if (inst <= Instruction::SLEI32) { return intMathOps[(i - (unsigned char) Instruction::ADDI8) % 17]; }
+    if (inst <= Instruction::SLEI64) { return i64MathOps[i - (unsigned char) Instruction::ADDI64]; }
+    if (inst <= Instruction::GEF32) { return floatMathOps[i - (unsigned char) Instruction::ADDF32]; }
+    return floatMathOps[i - (unsigned char) Instruction::ADDF64];
+}
+
+// the llvm type a value of this kind sits in the interpreter's stack as
+llvm::Type *scalarTypeFor(llvm::IRBuilder<> &builder, NodeTypekind kind, bool *isSigned) {
+    *isSigned = false;
+
+    switch (kind) {
+        case NodeTypekind::I8: *isSigned = true; return builder.getInt8Ty();
+        case NodeTypekind::U8: return builder.getInt8Ty();
+        case NodeTypekind::I16: *isSigned = true; return builder.getInt16Ty();
+        case NodeTypekind::U16: return builder.getInt16Ty();
+        case NodeTypekind::BOOLEAN:
+        case NodeTypekind::I32:
+            *isSigned = true;
+            return builder.getInt32Ty();
+        case NodeTypekind::U32: return builder.getInt32Ty();
+        case NodeTypekind::INT_LITERAL:
+        case NodeTypekind::I64:
+            *isSigned = true;
+            return builder.getInt64Ty();
+        case NodeTypekind::U64: return builder.getInt64Ty();
+        case NodeTypekind::FLOAT_LITERAL:
+        case NodeTypekind::F32:
+            return builder.getFloatTy();
+        case NodeTypekind::F64: return builder.getDoubleTy();
+        case NodeTypekind::POINTER: return builder.getInt8Ty()->getPointerTo();
+        default: return nullptr;
+    }
+}
+
+class BytecodeTranslator {
+public:
+    LlvmGen *gen;
+    llvm::IRBuilder<> &builder;
+    CachedProgram *program;
+    const vector<unsigned char> &code;
+
+    // everything up to the rodata
+    uint64_t codeLength = 0;
+    uint64_t pc = 0;
+
+    vector<uint64_t> instStarts;
+    vector<uint64_t> fnStarts;
+    hash_t<uint64_t, llvm::Function *> *fns = hash_init<uint64_t, llvm::Function *>(256);
+
+    // the interpreter's stack, allocated by main
+    llvm::GlobalVariable *stackGlobal = nullptr;
+
+    // the whole instruction stream, only emitted if something points into its rodata
+    llvm::GlobalVariable *codeImage = nullptr;
+
+    llvm::Constant *exitFunc = nullptr;
+    llvm::Constant *callocFunc = nullptr;
+    llvm::Value *putsFormat = nullptr;
+
+    // the fn being translated
+    llvm::Function *fn = nullptr;
+    hash_t<uint64_t, llvm::BasicBlock *> *blocks = nullptr;
+    llvm::Value *stack = nullptr;
+    llvm::Value *bp = nullptr;
+    llvm::AllocaInst *sp = nullptr;
+    llvm::BasicBlock *nilBlock = nullptr;
+
+    bool failed = false;
+
+    BytecodeTranslator(LlvmGen *gen, CachedProgram *program)
+            : gen(gen), builder(gen->builder), program(program), code(program->instructions) {}
+
+    template <typename T>
+    T consume() {
+        auto value = bytesTo<T>(code, pc);
+        pc += sizeof(T);
+        return value;
+    }
+
+    llvm::Value *fail(const string &message, llvm::Type *type = nullptr) {
+        if (!failed) {
+            llvm::errs() << "can't compile the bytecode at " << pc << ": " << message << "\n";
+        }
+        failed = true;
+
+        return type == nullptr ? nullptr : llvm::UndefValue::get(type);
+    }
+
+    llvm::Value *i64(int64_t value) {
+        return builder.getInt64((uint64_t) value);
+    }
+
+    llvm::Value *stackAddress() {
+        return builder.CreatePtrToInt(stack, builder.getInt64Ty());
+    }
+
+    llvm::Value *frameOffset(int64_t offset) {
+        return builder.CreateAdd(bp, i64(offset));
+    }
+
+    // frames aren't laid out with alignment in mind, so nothing here assumes any
+    llvm::Value *address(llvm::Value *offset, llvm::Type *type) {
+        auto byte = builder.CreateGEP(stack, offset);
+        return builder.CreatePointerCast(byte, type->getPointerTo());
+    }
+
+    llvm::Value *load(llvm::Value *offset, llvm::Type *type) {
+        return builder.CreateAlignedLoad(address(offset, type), 1);
+    }
+
+    void storeAt(llvm::Value *offset, llvm::Value *value) {
+        builder.CreateAlignedStore(value, address(offset, value->getType()), 1);
+    }
+
+    void scan();
+    void declareFns();
+    void translateFn(uint64_t start, uint64_t end);
+    void translateInstruction();
+    void translateMath(Instruction inst);
+    void translateBitwise(Instruction inst);
+    void translateConvert();
+    void translateStoreConst();
+    void translateCalli();
+    void translateCalle();
+    void emitMain();
+
+    llvm::Value *constant(llvm::Type *type);
+    llvm::Value *read(llvm::Type *type);
+    llvm::BasicBlock *blockAt(int64_t offset);
+    void call(uint64_t offset);
+    void exitWith(llvm::Value *code);
+    void checkNil(llvm::Value *pointer);
+};
+
+void BytecodeTranslator::scan() {
+    fnStarts.push_back(0);
+    for (auto i = 0; i < program->fnTable->bucket_count; i++) {
+        for (auto bucket = program->fnTable->buckets[i]; bucket != nullptr; bucket = bucket->next) {
+            fnStarts.push_back(bucket->value);
+        }
+    }
+
+    uint64_t at = 0;
+    while (at < code.size() && (Instruction) code[at] != Instruction::RODATA) {
+        instStarts.push_back(at);
+
+        // fns only reached through a direct call aren't in the fn table
+        if ((Instruction) code[at] == Instruction::CALL) {
+            fnStarts.push_back((uint64_t) bytesTo<int32_t>(code, at + 1));
+        }
+
+        at += instructionLength(code, at);
+    }
+    codeLength = at;
+
+    sort(fnStarts.begin(), fnStarts.end());
+    fnStarts.erase(unique(fnStarts.begin(), fnStarts.end()), fnStarts.end());
+}
+
+void BytecodeTranslator::declareFns() {
+    // void fn(i64 spAtCall), the same as the interpreter's call: bp ends up just past the saved bp/pc
+    auto fnType = llvm::FunctionType::get(builder.getVoidTy(), { builder.getInt64Ty() }, false);
+
+    for (auto start : fnStarts) {
+        auto F = llvm::Function::Create(fnType, llvm::Function::InternalLinkage,
+                                        "cpi.bc." + to_string(start), gen->module.get());
+        F->addFnAttr("target-cpu", gen->targetCpu);
+        if (!gen->targetFeatures.empty()) {
+            F->addFnAttr("target-features", gen->targetFeatures);
+        }
+
+        hash_insert(fns, start, F);
+    }
+
+    stackGlobal = new llvm::GlobalVariable(*gen->module, builder.getInt8Ty()->getPointerTo(), false,
+                                           llvm::GlobalValue::InternalLinkage,
+                                           llvm::ConstantPointerNull::get(builder.getInt8Ty()->getPointerTo()),
+                                           "cpi.stack");
+
+    exitFunc = gen->module->getOrInsertFunction(
+            "exit", llvm::FunctionType::get(builder.getVoidTy(), { builder.getInt32Ty() }, false));
+    callocFunc = gen->module->getOrInsertFunction(
+            "calloc", llvm::FunctionType::get(builder.getInt8Ty()->getPointerTo(),
+                                              { builder.getInt64Ty(), builder.getInt64Ty() }, false));
+}
+
+llvm::BasicBlock *BytecodeTranslator::blockAt(int64_t offset) {
+    auto found = hash_get(blocks, (uint64_t) offset);
+    if (found == nullptr) {
+        fail("jump to " + to_string(offset) + ", outside of its fn");
+        return nullptr;
+    }
+    return *found;
+}
+
+void BytecodeTranslator::translateFn(uint64_t start, uint64_t end) {
+    fn = *hash_get(fns, start);
+    blocks = hash_init<uint64_t, llvm::BasicBlock *>(64);
+    nilBlock = nullptr;
+
+    builder.SetInsertPoint(llvm::BasicBlock::Create(gen->context, "entry", fn));
+
+    stack = builder.CreateLoad(stackGlobal, "stack");
+    bp = builder.CreateAdd(&*fn->arg_begin(), i64(8), "bp");
+    sp = gen->entryAlloca(builder.getInt64Ty(), "sp");
+    builder.CreateStore(bp, sp);
+
+    auto first = lower_bound(instStarts.begin(), instStarts.end(), start);
+    auto last = lower_bound(instStarts.begin(), instStarts.end(), end);
+
+    // every jump target starts a block, so find them all before translating anything that jumps back
+    for (auto it = first; it != last; ++it) {
+        auto at = *it;
+
+        vector<int64_t> targets;
+        if ((Instruction) code[at] == Instruction::JUMP) {
+            targets.push_back(bytesTo<int32_t>(code, at + 1));
+        }
+        else if ((Instruction) code[at] == Instruction::JUMPIF) {
+            auto p = at + 1;
+            p += operandLength(code, p, sizeof(int32_t));
+            targets.push_back(constantJumpTarget(code, p));
+            p += operandLength(code, p, sizeof(int32_t));
+            targets.push_back(constantJumpTarget(code, p));
+        }
+
+        for (auto target : targets) {
+            if (target < (int64_t) start || target >= (int64_t) end) {
+                pc = at;
+                fail("jumpif to a computed target, or to outside of its fn");
+                return;
+            }
+            if (hash_get(blocks, (uint64_t) target) == nullptr) {
+                hash_insert(blocks, (uint64_t) target, llvm::BasicBlock::Create(gen->context, "", fn));
+            }
+        }
+    }
+
+    for (auto it = first; it != last && !failed; ++it) {
+        pc = *it;
+
+        auto found = hash_get(blocks, pc);
+        auto current = builder.GetInsertBlock();
+        if (found != nullptr) {
+            if (current->getTerminator() == nullptr) {
+                builder.CreateBr(*found);
+            }
+            builder.SetInsertPoint(*found);
+        }
+        else if (current->getTerminator() != nullptr) {
+            // nothing jumps here, so it's dead code after a jump or return. it still has to be valid ir
+            builder.SetInsertPoint(llvm::BasicBlock::Create(gen->context, "", fn));
+        }
+
+        translateInstruction();
+    }
+
+    // falling off the end of a fn would run into the next one in the interpreter, which BytecodeGen never does
+    if (builder.GetInsertBlock()->getTerminator() == nullptr) {
+        builder.CreateUnreachable();
+    }
+}
+
+llvm::Value *BytecodeTranslator::constant(llvm::Type *type) {
+    if (type->isFloatTy()) { return llvm::ConstantFP::get(type, consume<float>()); }
+    if (type->isDoubleTy()) { return llvm::ConstantFP::get(type, consume<double>()); }
+
+    auto bytes = type->getIntegerBitWidth() / 8;
+
+    uint64_t value = 0;
+    memcpy(&value, &code[pc], bytes);
+    pc += bytes;
+
+    return llvm::ConstantInt::get(type, value);
+}
+
+// Interpreter::read<T>
+llvm::Value *BytecodeTranslator::read(llvm::Type *type) {
+    auto tag = (Instruction) code[pc];
+    pc += 1;
+
+    switch (tag) {
+        case Instruction::CONSTI8:
+        case Instruction::CONSTI16:
+        case Instruction::CONSTI32:
+        case Instruction::CONSTI64:
+        case Instruction::CONSTF32:
+        case Instruction::CONSTF64: {
+            return constant(type);
+        }
+        case Instruction::RELI8:
+        case Instruction::RELI16:
+        case Instruction::RELI32:
+        case Instruction::RELI64:
+        case Instruction::RELF32:
+        case Instruction::RELF64: {
+            return load(frameOffset(consume<int64_t>()), type);
+        }
+        default: break;
+    }
+
+    // the rest are offsets into the stack, which only make sense as integers
+    if (!type->isIntegerTy()) {
+        return fail("a frame offset read as a float", type);
+    }
+
+    switch (tag) {
+        case Instruction::RELCONSTI32:
+        case Instruction::RELCONSTI64: {
+            auto value = constant(type);
+            return builder.CreateAdd(value, builder.CreateIntCast(bp, type, true));
+        }
+        case Instruction::I64: {
+            auto pointer = load(frameOffset(consume<int64_t>()), builder.getInt64Ty());
+            return builder.CreateIntCast(builder.CreateSub(pointer, stackAddress()), type, true);
+        }
+        case Instruction::RODATAI64: {
+            if (codeImage == nullptr) {
+                auto data = llvm::ConstantDataArray::get(gen->context, llvm::ArrayRef<uint8_t>(code.data(), code.size()));
+                codeImage = new llvm::GlobalVariable(*gen->module, data->getType(), true,
+                                                     llvm::GlobalValue::PrivateLinkage, data, "cpi.code");
+            }
+
+            auto pointer = builder.CreatePtrToInt(builder.CreateConstGEP2_64(codeImage, 0, (uint64_t) consume<int64_t>()),
+                                                  builder.getInt64Ty());
+            return builder.CreateIntCast(builder.CreateSub(pointer, stackAddress()), type, true);
+        }
+        default: {
+            return fail("unrecognized operand", type);
+        }
+    }
+}
+
+void BytecodeTranslator::translateMath(Instruction inst) {
+    auto bytes = mathOperandBytes(inst);
+    auto isFloat = inst >= Instruction::ADDF32;
+    auto op = mathOpFor(inst);
+
+    llvm::Type *type = builder.getIntNTy((unsigned int) bytes * 8);
+    if (isFloat) {
+        type = bytes == 4 ? builder.getFloatTy() : builder.getDoubleTy();
+    }
+
+    auto a = read(type);
+    auto b = read(type);
+
+    llvm::Value *result = nullptr;
+    if (isFloat) {
+        switch (op) {
+            case MathOp::ADD: result = builder.CreateFAdd(a, b); break;
+            case MathOp::SUB: result = builder.CreateFSub(a, b); break;
+            case MathOp::MUL: result = builder.CreateFMul(a, b); break;
+            case MathOp::SDIV: result = builder.CreateFDiv(a, b); break;
+            case MathOp::EQ: result = builder.CreateFCmpOEQ(a, b); break;
+            case MathOp::NEQ: result = builder.CreateFCmpUNE(a, b); break;
+            case MathOp::SLT: result = builder.CreateFCmpOLT(a, b); break;
+            case MathOp::SLE: result = builder.CreateFCmpOLE(a, b); break;
+            case MathOp::SGT: result = builder.CreateFCmpOGT(a, b); break;
+            case MathOp::SGE: result = builder.CreateFCmpOGE(a, b); break;
+            default: cpi_assert(false);
+        }
+    }
+    else {
+        // c promotes anything narrower than an int, so the interpreter stores all 4 bytes of an i8/i16 result
+        if (bytes < 4 && op <= MathOp::SREM) {
+            auto isSigned = op != MathOp::UDIV && op != MathOp::UREM;
+            a = builder.CreateIntCast(a, builder.getInt32Ty(), isSigned);
+            b = builder.CreateIntCast(b, builder.getInt32Ty(), isSigned);
+        }
+
+        switch (op) {
+            case MathOp::ADD: result = builder.CreateAdd(a, b); break;
+            case MathOp::ADD_S: result = builder.CreateAdd(a, builder.CreateMul(b, i64(consume<int32_t>()))); break;
+            case MathOp::SUB: result = builder.CreateSub(a, b); break;
+            case MathOp::SUB_S: result = builder.CreateSub(a, builder.CreateMul(b, i64(consume<int32_t>()))); break;
+            case MathOp::MUL: result = builder.CreateMul(a, b); break;
+            case MathOp::UDIV: result = builder.CreateUDiv(a, b); break;
+            case MathOp::SDIV: result = builder.CreateSDiv(a, b); break;
+            case MathOp::UREM: result = builder.CreateURem(a, b); break;
+            case MathOp::SREM: result = builder.CreateSRem(a, b); break;
+            case MathOp::EQ: result = builder.CreateICmpEQ(a, b); break;
+            case MathOp::NEQ: result = builder.CreateICmpNE(a, b); break;
+            case MathOp::UGT: result = builder.CreateICmpUGT(a, b); break;
+            case MathOp::SGT: result = builder.CreateICmpSGT(a, b); break;
+            case MathOp::UGE: result = builder.CreateICmpUGE(a, b); break;
+            case MathOp::SGE: result = builder.CreateICmpSGE(a, b); break;
+            case MathOp::ULT: result = builder.CreateICmpULT(a, b); break;
+            case MathOp::SLT: result = builder.CreateICmpSLT(a, b); break;
+            case MathOp::ULE: result = builder.CreateICmpULE(a, b); break;
+            case MathOp::SLE: result = builder.CreateICmpSLE(a, b); break;
+        }
+    }
+
+    // comparisons store an i32 0/1
+    if (result->getType()->isIntegerTy(1)) {
+        result = builder.CreateZExt(result, builder.getInt32Ty());
+    }
+
+    storeAt(frameOffset(consume<int64_t>()), result);
+}
+
+void BytecodeTranslator::translateBitwise(Instruction inst) {
+    auto bytes = consume<int32_t>();
+    auto a = consume<int64_t>();
+    auto b = consume<int64_t>();
+    auto storeOffset = consume<int64_t>();
+
+    if (inst == Instruction::BITSHL || inst == Instruction::BITSHR) {
+        if (bytes != 1 && bytes != 2 && bytes != 4 && bytes != 8) {
+            fail("shift of " + to_string(bytes) + " bytes");
+            return;
+        }
+
+        // the interpreter shifts the (promoted) signed value by an i64 and keeps the low bytes
+        auto type = builder.getIntNTy((unsigned int) bytes * 8);
+        auto value = builder.CreateSExt(load(frameOffset(a), type), builder.getInt64Ty());
+        auto by = load(frameOffset(b), builder.getInt64Ty());
+
+        auto result = inst == Instruction::BITSHL ? builder.CreateShl(value, by) : builder.CreateAShr(value, by);
+        storeAt(frameOffset(storeOffset), builder.CreateTrunc(result, type));
+        return;
+    }
+
+    // any number of bytes: as many words as fit, then whatever is left. everything is read before anything is stored
+    vector<llvm::Value *> results;
+    vector<int64_t> offsets;
+    for (int64_t i = 0; i < bytes;) {
+        auto chunk = bytes - i >= 8 ? 8 : bytes - i >= 4 ? 4 : bytes - i >= 2 ? 2 : 1;
+        auto type = builder.getIntNTy((unsigned int) chunk * 8);
+
+        auto left = load(frameOffset(a + i), type);
+        auto right = load(frameOffset(b + i), type);
+
+        switch (inst) {
+            case Instruction::BITAND: results.push_back(builder.CreateAnd(left, right)); break;
+            case Instruction::BITOR: results.push_back(builder.CreateOr(left, right)); break;
+            default: results.push_back(builder.CreateXor(left, right)); break;
+        }
+        offsets.push_back(i);
+
+        i += chunk;
+    }
+
+    for (unsigned long i = 0; i < results.size(); i++) {
+        storeAt(frameOffset(storeOffset + offsets[i]), results[i]);
+    }
+}
+
+void BytecodeTranslator::translateConvert() {
+    auto fromKind = (NodeTypekind) consume<int32_t>();
+    auto fromOffset = consume<int64_t>();
+    auto toKind = (NodeTypekind) consume<int32_t>();
+    auto toOffset = consume<int64_t>();
+
+    bool fromSigned;
+    bool toSigned;
+    auto fromType = scalarTypeFor(builder, fromKind, &fromSigned);
+    auto toType = scalarTypeFor(builder, toKind, &toSigned);
+    if (fromType == nullptr || toType == nullptr || fromType->isPointerTy() || toType->isPointerTy()) {
+        fail("conversion between non-numeric types");
+        return;
+    }
+
+    auto value = load(frameOffset(fromOffset), fromType);
+    auto opcode = llvm::CastInst::getCastOpcode(value, fromSigned, toType, toSigned);
+    storeAt(frameOffset(toOffset), builder.CreateCast(opcode, value, toType));
+}
+
+void BytecodeTranslator::translateStoreConst() {
+    auto to = read(builder.getInt64Ty());
+
+    auto tag = (Instruction) code[pc];
+    pc += 1;
+
+    llvm::Value *value = nullptr;
+    switch (tag) {
+        case Instruction::CONSTI8: value = constant(builder.getInt8Ty()); break;
+        case Instruction::CONSTI16: value = constant(builder.getInt16Ty()); break;
+        case Instruction::CONSTI32: value = constant(builder.getInt32Ty()); break;
+        case Instruction::CONSTI64: value = constant(builder.getInt64Ty()); break;
+        case Instruction::CONSTF32: value = constant(builder.getFloatTy()); break;
+        case Instruction::CONSTF64: value = constant(builder.getDoubleTy()); break;
+        case Instruction::RELCONSTI64: {
+            value = builder.CreateAdd(i64(consume<int64_t>()), bp);
+        } break;
+        case Instruction::RELI64: {
+            // an absolute address
+            value = builder.CreateAdd(builder.CreateAdd(i64(consume<int64_t>()), bp), stackAddress());
+        } break;
+        default: {
+            fail("unrecognized storeconst");
+            return;
+        }
+    }
+
+    storeAt(to, value);
+}
+
+void BytecodeTranslator::call(uint64_t offset) {
+    auto found = hash_get(fns, offset);
+    if (found == nullptr) {
+        fail("call to " + to_string(offset) + ", which isn't the start of a fn");
+        return;
+    }
+
+    builder.CreateCall(*found, { builder.CreateLoad(sp) });
+}
+
+void BytecodeTranslator::translateCalli() {
+    auto index = read(builder.getInt64Ty());
+
+    if (auto constantIndex = llvm::dyn_cast<llvm::ConstantInt>(index)) {
+        auto found = hash_get(program->fnTable, (uint32_t) constantIndex->getZExtValue());
+        if (found == nullptr) {
+            fail("calli of a fn that isn't in the fn table");
+            return;
+        }
+
+        call(*found);
+        return;
+    }
+
+    // a fn pointer: the table's fns are all there is, so switch over them and call each one directly
+    auto unknown = llvm::BasicBlock::Create(gen->context, "", fn);
+    auto after = llvm::BasicBlock::Create(gen->context, "", fn);
+
+    auto dispatch = builder.CreateSwitch(builder.CreateTrunc(index, builder.getInt32Ty()), unknown,
+                                         (unsigned int) program->fnTable->size);
+    for (auto i = 0; i < program->fnTable->bucket_count; i++) {
+        for (auto bucket = program->fnTable->buckets[i]; bucket != nullptr; bucket = bucket->next) {
+            auto block = llvm::BasicBlock::Create(gen->context, "", fn);
+            dispatch->addCase(builder.getInt32(bucket->key), block);
+
+            builder.SetInsertPoint(block);
+            call(bucket->value);
+            builder.CreateBr(after);
+        }
+    }
+
+    builder.SetInsertPoint(unknown);
+    builder.CreateUnreachable();
+
+    builder.SetInsertPoint(after);
+}
+
+void BytecodeTranslator::translateCalle() {
+    auto externIndex = (unsigned long) consume<int32_t>();
+    if (externIndex >= program->externalFnTable.length || vector_at(program->externalFnTable, externIndex) == nullptr) {
+        fail("calle of an extern fn the .cbc doesn't list");
+        return;
+    }
+
+    auto externFn = resolve(vector_at(program->externalFnTable, externIndex)->fnCallData.fn);
+    cpi_assert(externFn->type == NodeType::FN_DECL);
+    auto fnName = atomTable->nameOf(externFn->fnDeclData.name->symbolData.atomId);
+
+    bool isSigned;
+
+    llvm::Type *returnType = builder.getVoidTy();
+    auto returnKind = resolve(externFn->fnDeclData.returnType)->typeData.kind;
+    if (returnKind != NodeTypekind::NONE) {
+        returnType = scalarTypeFor(builder, returnKind, &isSigned);
+    }
+
+    vector<llvm::Type *> paramTypes;
+    for (auto param : externFn->fnDeclData.params) {
+        paramTypes.push_back(scalarTypeFor(builder, resolve(param->typeInfo)->typeData.kind, &isSigned));
+    }
+
+    // by-value structs need the c abi's rules for splitting them into registers, which ffi has and llvm ir doesn't
+    if (returnType == nullptr || find(paramTypes.begin(), paramTypes.end(), nullptr) != paramTypes.end()) {
+        fail(fnName + " takes or returns a struct by value");
+        return;
+    }
+
+    auto callee = gen->module->getOrInsertFunction(fnName, llvm::FunctionType::get(returnType, paramTypes, false));
+
+    // the caller stored the args last to first, going up to sp
+    vector<llvm::Value *> args;
+    llvm::Value *paramSp = builder.CreateLoad(sp);
+    for (unsigned long i = 0; i < paramTypes.size(); i++) {
+        paramSp = builder.CreateSub(paramSp, i64(typeSize(vector_at(externFn->fnDeclData.params, i)->typeInfo)));
+        args.push_back(load(paramSp, paramTypes[i]));
+    }
+
+    auto result = builder.CreateCall(callee, args);
+    if (!returnType->isVoidTy()) {
+        storeAt(builder.CreateAdd(builder.CreateLoad(sp), i64(8)), result);
+    }
+}
+
+void BytecodeTranslator::exitWith(llvm::Value *exitCode) {
+    builder.CreateCall(exitFunc, { exitCode });
+    builder.CreateUnreachable();
+}
+
+void BytecodeTranslator::checkNil(llvm::Value *pointer) {
+    if (nilBlock == nullptr) {
+        auto current = builder.GetInsertBlock();
+
+        nilBlock = llvm::BasicBlock::Create(gen->context, "nil", fn);
+        builder.SetInsertPoint(nilBlock);
+        builder.CreateCall(gen->printfFunc, { builder.CreateGlobalStringPtr("nil pointer dereference!!\n") });
+        exitWith(builder.getInt32((uint32_t) -1));
+
+        builder.SetInsertPoint(current);
+    }
+
+    auto notNil = llvm::BasicBlock::Create(gen->context, "", fn);
+    builder.CreateCondBr(builder.CreateIsNull(pointer), nilBlock, notNil);
+    builder.SetInsertPoint(notNil);
+}
+
+void BytecodeTranslator::translateInstruction() {
+    auto inst = (Instruction) code[pc];
+    pc += 1;
+
+    if (inst <= Instruction::GEF64) {
+        translateMath(inst);
+        return;
+    }
+
+    switch (inst) {
+        case Instruction::BITAND:
+        case Instruction::BITOR:
+        case Instruction::BITXOR:
+        case Instruction::BITSHL:
+        case Instruction::BITSHR: {
+            translateBitwise(inst);
+        } break;
+        case Instruction::STORECONST: {
+            translateStoreConst();
+        } break;
+        case Instruction::STORE: {
+            auto to = builder.CreateGEP(stack, read(builder.getInt64Ty()));
+            auto from = builder.CreateGEP(stack, read(builder.getInt64Ty()));
+            auto size = consume<int32_t>();
+
+            checkNil(to);
+            builder.CreateMemCpy(to, from, (uint64_t) size, 1);
+        } break;
+        case Instruction::STORE_RELCONST_RELCONST: {
+            auto to = builder.CreateGEP(stack, frameOffset(consume<int64_t>()));
+            auto from = builder.CreateGEP(stack, frameOffset(consume<int64_t>()));
+            auto size = consume<int32_t>();
+
+            builder.CreateMemCpy(to, from, (uint64_t) size, 1);
+        } break;
+        case Instruction::BUMPSP: {
+            builder.CreateStore(builder.CreateAdd(builder.CreateLoad(sp), i64(consume<int32_t>())), sp);
+        } break;
+        case Instruction::JUMPIF: {
+            auto cond = read(builder.getInt32Ty());
+
+            auto trueTarget = constantJumpTarget(code, pc);
+            pc += operandLength(code, pc, sizeof(int32_t));
+            auto falseTarget = constantJumpTarget(code, pc);
+            pc += operandLength(code, pc, sizeof(int32_t));
+
+            auto trueBlock = blockAt(trueTarget);
+            auto falseBlock = blockAt(falseTarget);
+            if (trueBlock == nullptr || falseBlock == nullptr) { return; }
+
+            builder.CreateCondBr(builder.CreateICmpEQ(cond, builder.getInt32(1)), trueBlock, falseBlock);
+        } break;
+        case Instruction::JUMP: {
+            auto block = blockAt(consume<int32_t>());
+            if (block == nullptr) { return; }
+
+            builder.CreateBr(block);
+        } break;
+        case Instruction::CALLI: {
+            translateCalli();
+        } break;
+        case Instruction::CALLE: {
+            translateCalle();
+        } break;
+        case Instruction::CALL: {
+            call((uint64_t) consume<int32_t>());
+        } break;
+        case Instruction::RET: {
+            builder.CreateRetVoid();
+        } break;
+        case Instruction::EXIT: {
+            // main's return value is at the bottom of the stack
+            exitWith(builder.CreateAlignedLoad(address(i64(0), builder.getInt32Ty()), 1));
+        } break;
+        case Instruction::PANIC: {
+            builder.CreateCall(gen->printfFunc, { builder.CreateGlobalStringPtr("PANIC!\n") });
+            exitWith(builder.getInt32(0));
+        } break;
+        case Instruction::PUTS: {
+            auto offset = read(builder.getInt64Ty());
+
+            auto chars = builder.CreateIntToPtr(load(offset, builder.getInt64Ty()), builder.getInt8Ty()->getPointerTo());
+            auto count = builder.CreateTrunc(load(builder.CreateAdd(offset, i64(8)), builder.getInt64Ty()),
+                                             builder.getInt32Ty());
+
+            if (putsFormat == nullptr) {
+                putsFormat = builder.CreateGlobalStringPtr("%.*s", "printfFmtStr");
+            }
+            builder.CreateCall(gen->printfFunc, { putsFormat, count, chars });
+        } break;
+        case Instruction::NOP: break;
+        case Instruction::NOT: {
+            auto offset = frameOffset(consume<int64_t>());
+            auto value = load(offset, builder.getInt32Ty());
+            storeAt(offset, builder.CreateZExt(builder.CreateICmpEQ(value, builder.getInt32(0)), builder.getInt32Ty()));
+        } break;
+        case Instruction::BITNOT: {
+            auto bytes = consume<int32_t>();
+            auto offset = consume<int64_t>();
+
+            for (int64_t i = 0; i < bytes;) {
+                auto chunk = bytes - i >= 8 ? 8 : bytes - i >= 4 ? 4 : bytes - i >= 2 ? 2 : 1;
+                auto chunkOffset = frameOffset(offset + i);
+
+                storeAt(chunkOffset, builder.CreateNot(load(chunkOffset, builder.getIntNTy((unsigned int) chunk * 8))));
+                i += chunk;
+            }
+        } break;
+        case Instruction::CONVERT: {
+            translateConvert();
+        } break;
+        default: {
+            fail("unrecognized instruction");
+        }
+    }
+}
+
+void BytecodeTranslator::emitMain() {
+    auto mainFn = llvm::Function::Create(llvm::FunctionType::get(builder.getInt32Ty(), false),
+                                         llvm::Function::ExternalLinkage, "main", gen->module.get());
+    mainFn->addFnAttr("target-cpu", gen->targetCpu);
+    if (!gen->targetFeatures.empty()) {
+        mainFn->addFnAttr("target-features", gen->targetFeatures);
+    }
+
+    builder.SetInsertPoint(llvm::BasicBlock::Create(gen->context, "entry", mainFn));
+
+    auto stackMemory = builder.CreateCall(callocFunc, { i64(bytecodeStackSize), i64(1) });
+    builder.CreateStore(stackMemory, stackGlobal);
+
+    // the interpreter starts main with sp = bp = 0, as if it had been called from just below the stack
+    builder.CreateCall(*hash_get(fns, (uint64_t) 0), { i64(-8) });
+
+    // main normally ends in EXIT, which never returns
+    auto result = builder.CreatePointerCast(stackMemory, builder.getInt32Ty()->getPointerTo());
+    builder.CreateRet(builder.CreateAlignedLoad(result, 1));
+}
+
+bool compileBytecode(LlvmGen *llvmGen, CachedProgram *program) {
+    auto translator = new BytecodeTranslator(llvmGen, program);
+
+    translator->scan();
+    translator->declareFns();
+
+    for (unsigned long i = 0; i < translator->fnStarts.size() && !translator->failed; i++) {
+        auto end = i + 1 < translator->fnStarts.size() ? translator->fnStarts[i + 1] : translator->codeLength;
+        translator->translateFn(translator->fnStarts[i], end);
+    }
+
+    if (translator->failed) { return false; }
+
+    translator->emitMain();
+    return true;
+}
@@ -0,0 +1,13 @@
+#ifndef BYTECODECOMPILER_H
+#define BYTECODECOMPILER_H
+
+#include "llvmgen.h"
+#include "modulecache.h"
+
+// --compile-bytecode: translate a .cbc program into llvm ir, one llvm fn per bytecode fn, in llvmGen's module.
+// the translated code keeps the interpreter's memory model as is: one flat stack that every frame offset and every
+// pointer the bytecode computes is relative to. what goes away is the dispatch, and llvm gets to see each fn whole.
+// adds a native main which runs the bytecode's main and exits with the i32 it leaves at the bottom of the stack
+bool compileBytecode(LlvmGen *llvmGen, CachedProgram *program);
+
+#endif // BYTECODECOMPILER_H
@@ -1,17 +1,116 @@
 #include "bytecodegen.h"
+#include "threadpool.h"
 
-void append(vector<unsigned char> &instructions, vector<unsigned char> newInstructions) {
+#include <algorithm>
+#include <tuple>
+
+void append(vector<unsigned char> &instructions, const vector<unsigned char> &newInstructions) {
     instructions.insert(instructions.end(), newInstructions.begin(), newInstructions.end());
 }
 
-void append(vector<unsigned char> &instructions, unsigned char instruction) {
+void append(vector<unsigned char> &instructions, const NodeBytecode &bytecode) {
+    instructions.insert(instructions.end(), bytecode.begin(), bytecode.end());
+}
+
+// operands go straight into the buffer, rather than through the temporary vector toBytes makes.
+// the buffer is either an instruction stream or a node's NodeBytecode
+template<typename Buffer, typename T>
+inline void appendBytes(Buffer &instructions, const T object) {
+    auto at = instructions.size();
+    instructions.resize(at + sizeof(T));
+    memcpy(&instructions[at], addressof(object), sizeof(T));
+}
+
+template<typename Buffer>
+void append(Buffer &instructions, unsigned char instruction) {
     instructions.push_back(instruction);
 }
 
-void append(vector<unsigned char> &instructions, Instruction instruction) {
+template<typename Buffer>
+void append(Buffer &instructions, Instruction instruction) {
     append(instructions, static_cast<unsigned char>(instruction));
 }
 
+// the operands that follow each instruction, and how wide they are. an operand which is itself an instruction
+// (STORE's, the binops') is one byte, followed by that instruction's own operand
+template<Instruction Op> struct OperandsOf { using type = tuple<>; };
+template<> struct OperandsOf<Instruction::CONSTI8> { using type = tuple<int8_t>; };
+template<> struct OperandsOf<Instruction::CONSTI16> { using type = tuple<int16_t>; };
+template<> struct OperandsOf<Instruction::CONSTI32> { using type = tuple<int32_t>; };
+template<> struct OperandsOf<Instruction::CONSTI64> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::CONSTF32> { using type = tuple<float>; };
+template<> struct OperandsOf<Instruction::CONSTF64> { using type = tuple<double>; };
+template<> struct OperandsOf<Instruction::RELI8> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RELI16> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RELI32> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RELI64> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RELF32> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RELF64> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RELCONSTI32> { using type = tuple<int32_t>; };
+template<> struct OperandsOf<Instruction::RELCONSTI64> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::I64> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RODATAI64> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::RODATA> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::STORE> { using type = tuple<Instruction, int64_t, Instruction, int64_t, int32_t>; };
+template<> struct OperandsOf<Instruction::STORE_RELCONST_RELCONST> { using type = tuple<int64_t, int64_t, int32_t>; };
+template<> struct OperandsOf<Instruction::BUMPSP> { using type = tuple<int32_t>; };
+template<> struct OperandsOf<Instruction::JUMP> { using type = tuple<int32_t>; };
+template<> struct OperandsOf<Instruction::CALL> { using type = tuple<int32_t>; };
+template<> struct OperandsOf<Instruction::CALLE> { using type = tuple<int32_t>; };
+template<> struct OperandsOf<Instruction::NOT> { using type = tuple<int64_t>; };
+template<> struct OperandsOf<Instruction::BITNOT> { using type = tuple<int32_t, int64_t>; };
+template<> struct OperandsOf<Instruction::BITAND> { using type = tuple<int32_t, int64_t, int64_t, int64_t>; };
+template<> struct OperandsOf<Instruction::BITOR> { using type = tuple<int32_t, int64_t, int64_t, int64_t>; };
+template<> struct OperandsOf<Instruction::BITXOR> { using type = tuple<int32_t, int64_t, int64_t, int64_t>; };
+template<> struct OperandsOf<Instruction::BITSHL> { using type = tuple<int32_t, int64_t, int64_t, int64_t>; };
+template<> struct OperandsOf<Instruction::BITSHR> { using type = tuple<int32_t, int64_t, int64_t, int64_t>; };
+template<> struct OperandsOf<Instruction::CONVERT> { using type = tuple<int32_t, int64_t, int32_t, int64_t>; };
+
+// the binops are picked at runtime from binopInstructions, so they don't get an OperandsOf each.
+// both sides are read through an operand instruction, and the result goes to a local.
+// the scaled pointer binops (ADD_S, SUB_S) also take the pointee size, just before the result
+using BinopOperands = tuple<Instruction, int64_t, Instruction, int64_t, int64_t>;
+using ScaledBinopOperands = tuple<Instruction, int64_t, Instruction, int64_t, int32_t, int64_t>;
+
+template<typename Types, typename Buffer, size_t... I, typename... Args>
+inline void emitOperands(Buffer &instructions, index_sequence<I...>, Args... args) {
+    int unused[] = {0, (appendBytes(instructions, static_cast<typename tuple_element<I, Types>::type>(args)), 0)...};
+    (void) unused;
+}
+
+// appends op and its operands, each converted to the width in Types. for an op only known at runtime,
+// otherwise use emit<Op>, which looks Types up
+template<typename Types, typename Buffer, typename... Args>
+inline unsigned long emitAs(Buffer &instructions, Instruction op, Args... args) {
+    static_assert(sizeof...(Args) == tuple_size<Types>::value, "wrong number of operands for this instruction");
+
+    append(instructions, op);
+    auto operandsAt = instructions.size();
+    emitOperands<Types>(instructions, index_sequence_for<Args...>{}, args...);
+    return operandsAt;
+}
+
+// appends Op and its operands, each converted to the width the interpreter reads it at.
+// returns where the operands start, for anything that gets patched later (jump targets, calls)
+template<Instruction Op, typename Buffer, typename... Args>
+inline unsigned long emit(Buffer &instructions, Args... args) {
+    return emitAs<typename OperandsOf<Op>::type>(instructions, Op, args...);
+}
+
+// which CONST instruction a literal of type T takes
+template<typename T> struct ConstFor;
+template<> struct ConstFor<int8_t> { static constexpr Instruction op = Instruction::CONSTI8; };
+template<> struct ConstFor<int16_t> { static constexpr Instruction op = Instruction::CONSTI16; };
+template<> struct ConstFor<int32_t> { static constexpr Instruction op = Instruction::CONSTI32; };
+template<> struct ConstFor<int64_t> { static constexpr Instruction op = Instruction::CONSTI64; };
+template<> struct ConstFor<float> { static constexpr Instruction op = Instruction::CONSTF32; };
+template<> struct ConstFor<double> { static constexpr Instruction op = Instruction::CONSTF64; };
+
+template<typename Buffer, typename T>
+inline void emitConst(Buffer &instructions, T value) {
+    emit<ConstFor<T>::op>(instructions, value);
+}
+
 bool isRel(Instruction inst) {
     return inst == Instruction::RELCONSTI64 || inst == Instruction::RELCONSTI32;
 }
@@ -32,21 +131,10 @@ void makeStore(vector<unsigned char> &instructions,
     }
 
     if (isRel(readInst) && isRel(writeInst)) {
-        append(instructions, Instruction::STORE_RELCONST_RELCONST);
-        append(instructions, toBytes(readOffset));
-        append(instructions, toBytes(writeOffset));
-        append(instructions, toBytes(size));
+        emit<Instruction::STORE_RELCONST_RELCONST>(instructions, readOffset, writeOffset, size);
     }
     else {
-        append(instructions, Instruction::STORE);
-
-        append(instructions, readInst);
-        append(instructions, toBytes(readOffset));
-
-        append(instructions, writeInst);
-        append(instructions, toBytes(writeOffset));
-
-        append(instructions, toBytes(size));
+        emit<Instruction::STORE>(instructions, readInst, readOffset, writeInst, writeOffset, size);
     }
 }
 
@@ -68,9 +156,45 @@ Node *bytecodeResolve(Node *n) {
     return resolved;
 }
 
-void BytecodeGen::binopHelper(string instructionStr, Node *node, int32_t scale) {
-    string bytecodeStr;
+// operand widths, the columns of binopInstructions
+enum BinopWidth { WIDTH_I8, WIDTH_I16, WIDTH_I32, WIDTH_I64, WIDTH_F32, WIDTH_F64, WIDTH_COUNT };
+
+// one row per BinopKind, NOP where there's no such instruction
+constexpr Instruction binopInstructions[(int) BinopKind::COUNT][WIDTH_COUNT] = {
+    /* ADD */ {Instruction::ADDI8, Instruction::ADDI16, Instruction::ADDI32, Instruction::ADDI64, Instruction::ADDF32, Instruction::ADDF64},
+    /* ADD_S */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::ADD_S_I64, Instruction::NOP, Instruction::NOP},
+    /* SUB */ {Instruction::SUBI8, Instruction::SUBI16, Instruction::SUBI32, Instruction::SUBI64, Instruction::SUBF32, Instruction::SUBF64},
+    /* SUB_S */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::SUB_S_I64, Instruction::NOP, Instruction::NOP},
+    /* MUL */ {Instruction::MULI8, Instruction::MULI16, Instruction::MULI32, Instruction::MULI64, Instruction::MULF32, Instruction::MULF64},
+    /* DIV */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::DIVF32, Instruction::DIVF64},
+    /* SDIV */ {Instruction::SDIVI8, Instruction::SDIVI16, Instruction::SDIVI32, Instruction::SDIVI64, Instruction::NOP, Instruction::NOP},
+    /* EQ */ {Instruction::EQI8, Instruction::EQI16, Instruction::EQI32, Instruction::EQI64, Instruction::EQF32, Instruction::EQF64},
+    /* NEQ */ {Instruction::NEQI8, Instruction::NEQI16, Instruction::NEQI32, Instruction::NEQI64, Instruction::NEQF32, Instruction::NEQF64},
+    /* LT */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::LTF32, Instruction::LTF64},
+    /* SLT */ {Instruction::SLTI8, Instruction::SLTI16, Instruction::SLTI32, Instruction::SLTI64, Instruction::NOP, Instruction::NOP},
+    /* LE */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::LEF32, Instruction::LEF64},
+    /* SLE */ {Instruction::SLEI8, Instruction::SLEI16, Instruction::SLEI32, Instruction::SLEI64, Instruction::NOP, Instruction::NOP},
+    /* GT */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::GTF32, Instruction::GTF64},
+    /* SGT */ {Instruction::SGTI8, Instruction::SGTI16, Instruction::SGTI32, Instruction::SGTI64, Instruction::NOP, Instruction::NOP},
+    /* GE */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::GEF32, Instruction::GEF64},
+    /* SGE */ {Instruction::SGEI8, Instruction::SGEI16, Instruction::SGEI32, Instruction::SGEI64, Instruction::NOP, Instruction::NOP},
+    /* REM */ {Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP, Instruction::NOP},
+    /* SREM */ {Instruction::SREMI8, Instruction::SREMI16, Instruction::SREMI32, Instruction::SREMI64, Instruction::NOP, Instruction::NOP},
+};
+
+constexpr Instruction relInstructions[WIDTH_COUNT] = {
+    Instruction::RELI8, Instruction::RELI16, Instruction::RELI32, Instruction::RELI64, Instruction::RELF32, Instruction::RELF64
+};
+
+constexpr bool isComparison(BinopKind op) {
+    return op == BinopKind::EQ || op == BinopKind::NEQ
+           || op == BinopKind::LT || op == BinopKind::SLT
+           || op == BinopKind::LE || op == BinopKind::SLE
+           || op == BinopKind::GT || op == BinopKind::SGT
+           || op == BinopKind::GE || op == BinopKind::SGE;
+}
 
+void BytecodeGen::binopHelper(BinopKind op, Node *node, int32_t scale) {
     auto resolvedLhsType = bytecodeResolve(node->binopData.lhs->typeInfo);
     auto resolvedRhsType = bytecodeResolve(node->binopData.lhs->typeInfo);
 
@@ -80,19 +204,9 @@ void BytecodeGen::binopHelper(string instructionStr, Node *node, int32_t scale)
     if (resolvedLhsType->typeData.kind == NodeTypekind::POINTER || resolvedRhsType->typeData.kind == NodeTypekind::POINTER) {
         // pointer arithmetic
         kind = NodeTypekind::POINTER;
-    } else if (startsWith(&instructionStr, "EQ") || startsWith(&instructionStr, "NEQ")
-            || startsWith(&instructionStr, "GT") || startsWith(&instructionStr, "GE")
-            || startsWith(&instructionStr, "LT") || startsWith(&instructionStr, "LE")
-            || startsWith(&instructionStr, "GT") || startsWith(&instructionStr, "GE")
-            || startsWith(&instructionStr, "UGT") || startsWith(&instructionStr, "UGE")
-            || startsWith(&instructionStr, "ULT") || startsWith(&instructionStr, "ULE")
-            || startsWith(&instructionStr, "SGT") || startsWith(&instructionStr, "SGE")
-            || startsWith(&instructionStr, "SLT") || startsWith(&instructionStr, "SLE")) {
-        // comparison, so boolean
-        isBoolean = true;
-        kind = resolvedLhsType->typeData.kind;
     }
     else {
+        isBoolean = isComparison(op);
         kind = resolvedLhsType->typeData.kind;
     }
 
@@ -100,72 +214,56 @@ void BytecodeGen::binopHelper(string instructionStr, Node *node, int32_t scale)
         kind = resolvedLhsType->typeData.enumTypeData.type->typeData.kind;
     }
 
-    string toAppend;
+    BinopWidth width;
     switch (kind) {
         case NodeTypekind::U8:
         case NodeTypekind::I8: {
-            toAppend = "I8";
-            bytecodeStr = "RELI8";
+            width = WIDTH_I8;
         } break;
         case NodeTypekind::U16:
         case NodeTypekind::I16: {
-            toAppend = "I16";
-            bytecodeStr = "RELI16";
+            width = WIDTH_I16;
         } break;
         case NodeTypekind::BOOLEAN:
         case NodeTypekind::BOOLEAN_LITERAL:
         case NodeTypekind::U32:
         case NodeTypekind::I32: {
-            toAppend = "I32";
-            bytecodeStr = "RELI32";
+            width = WIDTH_I32;
         } break;
         case NodeTypekind::POINTER:
         case NodeTypekind::U64:
         case NodeTypekind::I64: {
-            toAppend = "I64";
-            bytecodeStr = "RELI64";
+            width = WIDTH_I64;
         } break;
         case NodeTypekind::F32: {
-            toAppend = "F32";
-            bytecodeStr = "RELF32";
+            width = WIDTH_F32;
         } break;
         case NodeTypekind::F64: {
-            toAppend = "F64";
-            bytecodeStr = "RELF64";
+            width = WIDTH_F64;
         } break;
         default:
             cpi_assert(false);
+            return;
     }
 
-    if (isBoolean) {
-        bytecodeStr = "RELI32";
-    }
-
-    instructionStr.append(toAppend);
-
-    auto inst = *hash_get(AssemblyLexer::nameToInstruction, instructionStr);
-    append(instructions, inst);
-
-    auto bytecodeInst = *hash_get(AssemblyLexer::nameToInstruction, bytecodeStr);
-    append(node->bytecode, bytecodeInst);
-
-    append(instructions, bytecodeInst);
-    append(instructions, toBytes(node->binopData.lhsTemporary->localOffset));
-
-    append(instructions, bytecodeInst);
-    append(instructions, toBytes(node->binopData.rhsTemporary->localOffset));
+    auto inst = binopInstructions[(int) op][width];
+    cpi_assert(inst != Instruction::NOP);
 
+    auto bytecodeInst = isBoolean ? Instruction::RELI32 : relInstructions[width];
+    auto lhsOffset = node->binopData.lhsTemporary->localOffset;
+    auto rhsOffset = node->binopData.rhsTemporary->localOffset;
     if (scale > 1) {
-        append(instructions, toBytes32(scale));
+        emitAs<ScaledBinopOperands>(instructions, inst, bytecodeInst, lhsOffset, bytecodeInst, rhsOffset, scale, node->localOffset);
+    }
+    else {
+        emitAs<BinopOperands>(instructions, inst, bytecodeInst, lhsOffset, bytecodeInst, rhsOffset, node->localOffset);
     }
 
-    append(instructions, toBytes(node->localOffset));
-    append(node->bytecode, toBytes(node->localOffset));
+    emitAs<tuple<int64_t>>(node->bytecode, bytecodeInst, node->localOffset);
 }
 
 void BytecodeGen::genDot(Node *node) {
     auto foundParam = node->dotData.resolved;
-    auto offsetWords = foundParam->localOffset;
 
     gen(node->dotData.lhs);
 
@@ -182,6 +280,8 @@ void BytecodeGen::genDot(Node *node) {
         resolvedTypeInfo = bytecodeResolve(resolvedTypeInfo->typeData.pointerTypeData.underlyingType);
         pointerCount += 1;
     }
+
+    auto offsetWords = static_cast<int64_t>(structFieldOffset(resolvedTypeInfo, foundParam));
     for (auto i = 0; i < pointerCount - 1; i++) {
         int64_t readBytes;
         if (i == 0) {
@@ -214,30 +314,20 @@ void BytecodeGen::genDot(Node *node) {
     if (node->dotData.autoDerefStorage) {
         node->dotData.pointerIsRelative = true;
 
-        append(instructions, Instruction::ADDI64);
-
-        append(instructions, Instruction::RELI64);
-        append(instructions, toBytes(hijackedOffsetLocation));
-
-        append(instructions, Instruction::CONSTI64);
-        append(instructions, toBytes(offsetWords));
-
-        append(instructions, toBytes(node->dotData.autoDerefStorage->localOffset));
+        emitAs<BinopOperands>(instructions, Instruction::ADDI64,
+                              Instruction::RELI64, hijackedOffsetLocation,
+                              Instruction::CONSTI64, offsetWords,
+                              node->dotData.autoDerefStorage->localOffset);
 
         node->isBytecodeLocal = true;
         node->localOffset = node->dotData.autoDerefStorage->localOffset;
     } else if (lhsRel) {
         node->dotData.pointerIsRelative = true;
 
-        append(instructions, Instruction::ADDI64);
-
-        append(instructions, Instruction::RELI64);
-        append(instructions, toBytes(hijackedOffsetLocation));
-
-        append(instructions, Instruction::CONSTI64);
-        append(instructions, toBytes(offsetWords));
-
-        append(instructions, toBytes(hijackedOffsetLocation));
+        emitAs<BinopOperands>(instructions, Instruction::ADDI64,
+                              Instruction::RELI64, hijackedOffsetLocation,
+                              Instruction::CONSTI64, offsetWords,
+                              hijackedOffsetLocation);
 
         node->isBytecodeLocal = true;
         node->localOffset = hijackedOffsetLocation;
@@ -249,25 +339,62 @@ void BytecodeGen::genDot(Node *node) {
     }
 }
 
+// while generating in parallel, guards nodes more than one fn can get to
+recursive_mutex sharedNodesLock;
+
+// whether more than one fn can get to node. a constant is reached through every symbol naming it, from any fn
+// (including ones nested in the fn it's declared in), and a compile time value can be the staticValue of any number
+// of nodes. everything else is only ever reached from the body it's in
+bool isShared(Node *node) {
+    if (node->staticValue != nullptr) { return true; }
+
+    switch (node->type) {
+        case NodeType::INT_LITERAL:
+        case NodeType::FLOAT_LITERAL:
+        case NodeType::BOOLEAN_LITERAL:
+        case NodeType::NIL_LITERAL:
+        case NodeType::STRING_LITERAL:
+        case NodeType::STRUCT_LITERAL:
+        case NodeType::ARRAY_LITERAL:
+        case NodeType::ENUM_LITERAL:
+        case NodeType::TYPE:
+            return true;
+        default:
+            return false;
+    }
+}
+
 void BytecodeGen::gen(Node *node) {
+    unique_lock<recursive_mutex> guard(sharedNodesLock, defer_lock);
+
     // avoids generating code for a fn decl within another fn decl
     if (node->type == NodeType::FN_DECL && !processFnDecls) {
-        if (node->fnDeclData.isLiteral && node->bytecode.empty()) {
-            // placeholder
-            append(node->bytecode, Instruction::RELCONSTI32);
-            append(node->bytecode, toBytes32(node->fnDeclData.tableIndex));
+        if (node->fnDeclData.isLiteral) {
+            if (parallelFn != nullptr) { guard.lock(); }
+
+            if (node->bytecode.empty()) {
+                // placeholder
+                emit<Instruction::RELCONSTI32>(node->bytecode, node->fnDeclData.tableIndex);
+            }
         }
 
         toProcess.push(node);
         return;
     }
 
+    if (parallelFn != nullptr && isShared(node)) {
+        guard.lock();
+    }
+
     if (node->genId >= genId && !node->isDeferred) {
         return;
     }
 
-    // never run the risk of adding double bytecode
-    node->bytecode = {};
+    // never run the risk of adding double bytecode.
+    // a fn decl's bytecode is only ever its placeholder though, which other fns might be reading
+    if (node->type != NodeType::FN_DECL) {
+        node->bytecode = {};
+    }
 
     if (this->debugLocalOffset != 0 && !node->debugBytecodeAdjusted) {
         node->debugBytecodeAdjusted = true;
@@ -302,8 +429,7 @@ void BytecodeGen::gen(Node *node) {
             hash_insert(fnTable, node->fnDeclData.tableIndex, node->fnDeclData.instOffset);
 
             auto stackSize = static_cast<int32_t>(node->fnDeclData.stackSize);
-            append(instructions, Instruction::BUMPSP);
-            append(instructions, toBytes(stackSize));
+            emit<Instruction::BUMPSP>(instructions, stackSize);
 
             auto savedCurrentFnStackSize = currentFnStackSize;
             currentFnStackSize = node->fnDeclData.stackSize;
@@ -318,9 +444,9 @@ void BytecodeGen::gen(Node *node) {
             }
             if (!didTerminate) {
                 if (isMainFn) {
-                    append(instructions, Instruction::EXIT);
+                    emit<Instruction::EXIT>(instructions);
                 } else {
-                    append(instructions, Instruction::RET);
+                    emit<Instruction::RET>(instructions);
                 }
             }
 
@@ -333,84 +459,63 @@ void BytecodeGen::gen(Node *node) {
             }
 
             sourceMap.statements.push_back(SourceMapStatement{ instructions.size(), instructions.size(), node });
-            append(instructions, Instruction::NOP);
+            emit<Instruction::NOP>(instructions);
 
             if (isMainFn) {
-                append(instructions, Instruction::EXIT);
+                emit<Instruction::EXIT>(instructions);
             } else {
-                append(instructions, Instruction::RET);
+                emit<Instruction::RET>(instructions);
             }
         } break;
         case NodeType::INT_LITERAL: {
             switch (node->typeInfo->typeData.kind) {
                 case NodeTypekind::U8:
                 case NodeTypekind::I8: {
-                    append(node->bytecode, Instruction::CONSTI8);
-                    auto litData = static_cast<int8_t>(node->intLiteralData.value);
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, static_cast<int8_t>(node->intLiteralData.value));
                 } break;
                 case NodeTypekind::U16:
                 case NodeTypekind::I16: {
-                    append(node->bytecode, Instruction::CONSTI16);
-                    auto litData = static_cast<int16_t>(node->intLiteralData.value);
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, static_cast<int16_t>(node->intLiteralData.value));
                 } break;
                 case NodeTypekind::U32:
                 case NodeTypekind::I32: {
-                    append(node->bytecode, Instruction::CONSTI32);
-                    auto litData = static_cast<int32_t>(node->intLiteralData.value);
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, static_cast<int32_t>(node->intLiteralData.value));
                 } break;
                 case NodeTypekind::U64:
                 case NodeTypekind::I64:
                 case NodeTypekind::INT_LITERAL: {
-                    append(node->bytecode, Instruction::CONSTI64);
-                    auto litData = node->intLiteralData.value;
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, static_cast<int64_t>(node->intLiteralData.value));
                 } break;
                 case NodeTypekind::F32: {
-                    append(node->bytecode, Instruction::CONSTF32);
-                    auto litData = (float) node->intLiteralData.value;
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, (float) node->intLiteralData.value);
                 } break;
                 case NodeTypekind::F64: {
-                    append(node->bytecode, Instruction::CONSTF64);
-                    auto litData = (double) node->intLiteralData.value;
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, (double) node->intLiteralData.value);
                 } break;
                 default: cpi_assert(false);
             }
         } break;
         case NodeType::SIZEOF: {
-            append(node->bytecode, Instruction::CONSTI64);
-            auto litData = static_cast<int64_t>(typeSize(node->nodeData));
-            append(node->bytecode, toBytes(litData));
+            emitConst(node->bytecode, static_cast<int64_t>(typeSize(node->nodeData)));
         } break;
         case NodeType::NIL_LITERAL: {
-            append(node->bytecode, Instruction::CONSTI64);
-            append(node->bytecode, toBytes64(0));
+            emit<Instruction::CONSTI64>(node->bytecode, 0);
         } break;
         case NodeType::FLOAT_LITERAL: {
             switch (node->typeInfo->typeData.kind) {
                 case NodeTypekind::FLOAT_LITERAL:
                 case NodeTypekind::F32: {
-                    append(node->bytecode, Instruction::CONSTF32);
-                    auto litData = static_cast<float>(node->floatLiteralData.value);
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, static_cast<float>(node->floatLiteralData.value));
                 } break;
                 case NodeTypekind::F64: {
-                    append(node->bytecode, Instruction::CONSTF64);
-                    auto litData = node->floatLiteralData.value;
-                    append(node->bytecode, toBytes(litData));
+                    emitConst(node->bytecode, static_cast<double>(node->floatLiteralData.value));
                 } break;
                 default: cpi_assert(false);
             }
         }
             break;
         case NodeType::BOOLEAN_LITERAL: {
-            append(node->bytecode, Instruction::CONSTI32);
-            auto litData = static_cast<int32_t>(node->boolLiteralData.value ? 1 : 0);
-            append(node->bytecode, toBytes(litData));
+            emitConst(node->bytecode, static_cast<int32_t>(node->boolLiteralData.value ? 1 : 0));
         } break;
         case NodeType::STRUCT_LITERAL: {
             // nothing to do here! wait until we actually need to store it somewhere
@@ -477,46 +582,38 @@ void BytecodeGen::gen(Node *node) {
             switch (resolvedType->typeData.kind) {
                 case NodeTypekind::FN: {
                     if (resolved->type == NodeType::FN_DECL) {
-                        append(node->bytecode, Instruction::RELCONSTI32);
-                        append(node->bytecode, toBytes32(resolved->fnDeclData.tableIndex));
+                        emit<Instruction::RELCONSTI32>(node->bytecode, resolved->fnDeclData.tableIndex);
                     } else {
                         cpi_assert(resolved->type == NodeType::DECL || resolved->type == NodeType::DECL_PARAM);
-                        append(node->bytecode, Instruction::RELI64);
-                        append(node->bytecode, toBytes(localOffset));
+                        emit<Instruction::RELI64>(node->bytecode, localOffset);
                     }
                 } break;
                 case NodeTypekind::U8:
                 case NodeTypekind::I8: {
-                    append(node->bytecode, Instruction::RELI8);
-                    append(node->bytecode, toBytes(localOffset));
+                    emit<Instruction::RELI8>(node->bytecode, localOffset);
                 } break;
                 case NodeTypekind::U16:
                 case NodeTypekind::I16: {
-                    append(node->bytecode, Instruction::RELI64);
-                    append(node->bytecode, toBytes(localOffset));
+                    emit<Instruction::RELI64>(node->bytecode, localOffset);
                 } break;
                 case NodeTypekind::BOOLEAN_LITERAL:
                 case NodeTypekind::BOOLEAN:
                 case NodeTypekind::U32:
                 case NodeTypekind::I32: {
-                    append(node->bytecode, Instruction::RELI64);
-                    append(node->bytecode, toBytes(localOffset));
+                    emit<Instruction::RELI64>(node->bytecode, localOffset);
                 } break;
                 case NodeTypekind::POINTER:
                 case NodeTypekind::INT_LITERAL:
                 case NodeTypekind::U64:
                 case NodeTypekind::I64: {
-                    append(node->bytecode, Instruction::RELI64);
-                    append(node->bytecode, toBytes(localOffset));
+                    emit<Instruction::RELI64>(node->bytecode, localOffset);
                 } break;
                 case NodeTypekind::FLOAT_LITERAL:
                 case NodeTypekind::F32: {
-                    append(node->bytecode, Instruction::RELF32);
-                    append(node->bytecode, toBytes(localOffset));
+                    emit<Instruction::RELF32>(node->bytecode, localOffset);
                 } break;
                 case NodeTypekind::F64: {
-                    append(node->bytecode, Instruction::RELF64);
-                    append(node->bytecode, toBytes(localOffset));
+                    emit<Instruction::RELF64>(node->bytecode, localOffset);
                 } break;
                 case NodeTypekind::STRUCT:
                 case NodeTypekind::ENUM:
@@ -542,146 +639,104 @@ void BytecodeGen::gen(Node *node) {
             else if (node->binopData.type == LexerTokenType::AND) {
                 // a and b ====> { result := false; if a { if b { result = true; } }
 
-                append(node->bytecode, Instruction::RELI64);
-                append(node->bytecode, toBytes(node->localOffset));
+                emit<Instruction::RELI64>(node->bytecode, node->localOffset);
 
                 // initially store false
-                append(instructions, Instruction::STORECONST);
-                append(instructions, Instruction::RELCONSTI64);
-                append(instructions, toBytes(node->localOffset));
-                append(instructions, Instruction::CONSTI32);
-                append(instructions, toBytes32((int32_t) 0));
+                emit<Instruction::STORECONST>(instructions);
+                emit<Instruction::RELCONSTI64>(instructions, node->localOffset);
+                emit<Instruction::CONSTI32>(instructions, (int32_t) 0);
 
                 gen(node->binopData.lhs);
 
-                append(instructions, Instruction::JUMPIF);
+                emit<Instruction::JUMPIF>(instructions);
                 append(instructions, node->binopData.lhs->bytecode);
 
-                append(instructions, Instruction::CONSTI32);
-                auto trueBranchOverwrite = instructions.size();
-                append(instructions, toBytes32(888));
+                auto trueBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 888);
 
-                append(instructions, Instruction::CONSTI32);
-                auto falseBranchOverwrite = instructions.size();
-                append(instructions, toBytes32(999));
+                auto falseBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 999);
 
-                auto instSize = static_cast<int32_t>(instructions.size());
-                memcpy(&instructions[trueBranchOverwrite], &instSize, sizeof(int32_t));
+                patchJumpTarget(trueBranchOverwrite);
 
                 {
                     // second 'if'
                     gen(node->binopData.rhs);
 
-                    append(instructions, Instruction::JUMPIF);
+                    emit<Instruction::JUMPIF>(instructions);
                     append(instructions, node->binopData.rhs->bytecode);
 
-                    append(instructions, Instruction::CONSTI32);
-                    auto trueBranchOverwrite2 = instructions.size();
-                    append(instructions, toBytes32(888));
+                    auto trueBranchOverwrite2 = emit<Instruction::CONSTI32>(instructions, 888);
 
-                    append(instructions, Instruction::CONSTI32);
-                    auto falseBranchOverwrite2 = instructions.size();
-                    append(instructions, toBytes32(999));
+                    auto falseBranchOverwrite2 = emit<Instruction::CONSTI32>(instructions, 999);
 
-                    instSize = static_cast<int32_t>(instructions.size());
-                    memcpy(&instructions[trueBranchOverwrite2], &instSize, sizeof(int32_t));
+                    patchJumpTarget(trueBranchOverwrite2);
 
                     // set to true
-                    append(instructions, Instruction::STORECONST);
-                    append(instructions, Instruction::RELCONSTI64);
-                    append(instructions, toBytes(node->localOffset));
-                    append(instructions, Instruction::CONSTI32);
-                    append(instructions, toBytes32((int32_t) 1));
-
-                    instSize = static_cast<int32_t>(instructions.size());
-                    memcpy(&instructions[falseBranchOverwrite2], &instSize, sizeof(int32_t));
+                    emit<Instruction::STORECONST>(instructions);
+                    emit<Instruction::RELCONSTI64>(instructions, node->localOffset);
+                    emit<Instruction::CONSTI32>(instructions, (int32_t) 1);
+
+                    patchJumpTarget(falseBranchOverwrite2);
                 }
 
                 unsigned long skipElseBranchOverwrite;
-                append(instructions, Instruction::JUMP);
-                skipElseBranchOverwrite = instructions.size();
-                append(instructions, toBytes32(999));
+                skipElseBranchOverwrite = emit<Instruction::JUMP>(instructions, 999);
 
-                instSize = static_cast<int32_t>(instructions.size());
-                memcpy(&instructions[falseBranchOverwrite], &instSize, sizeof(int32_t));
+                patchJumpTarget(falseBranchOverwrite);
 
-                instSize = static_cast<int32_t>(instructions.size());
-                memcpy(&instructions[skipElseBranchOverwrite], &instSize, sizeof(int32_t));
+                patchJumpTarget(skipElseBranchOverwrite);
             } else if (node->binopData.type == LexerTokenType::OR) {
                 // a or b ====> { result := false; if a { result = true; } else if b { result = true; } }
 
-                append(node->bytecode, Instruction::RELI64);
-                append(node->bytecode, toBytes(node->localOffset));
+                emit<Instruction::RELI64>(node->bytecode, node->localOffset);
 
                 // initially store true
-                append(instructions, Instruction::STORECONST);
-                append(instructions, Instruction::RELCONSTI64);
-                append(instructions, toBytes(node->localOffset));
-                append(instructions, Instruction::CONSTI32);
-                append(instructions, toBytes32((int32_t) 0));
+                emit<Instruction::STORECONST>(instructions);
+                emit<Instruction::RELCONSTI64>(instructions, node->localOffset);
+                emit<Instruction::CONSTI32>(instructions, (int32_t) 0);
 
                 gen(node->binopData.lhs);
 
-                append(instructions, Instruction::JUMPIF);
+                emit<Instruction::JUMPIF>(instructions);
                 append(instructions, node->binopData.lhs->bytecode);
 
-                append(instructions, Instruction::CONSTI32);
-                auto trueBranchOverwrite = instructions.size();
-                append(instructions, toBytes32(888));
+                auto trueBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 888);
 
-                append(instructions, Instruction::CONSTI32);
-                auto falseBranchOverwrite = instructions.size();
-                append(instructions, toBytes32(999));
+                auto falseBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 999);
 
-                auto instSize = static_cast<int32_t>(instructions.size());
-                memcpy(&instructions[trueBranchOverwrite], &instSize, sizeof(int32_t));
+                patchJumpTarget(trueBranchOverwrite);
 
                 // store true
-                append(instructions, Instruction::STORECONST);
-                append(instructions, Instruction::RELCONSTI64);
-                append(instructions, toBytes(node->localOffset));
-                append(instructions, Instruction::CONSTI32);
-                append(instructions, toBytes32((int32_t) 1));
+                emit<Instruction::STORECONST>(instructions);
+                emit<Instruction::RELCONSTI64>(instructions, node->localOffset);
+                emit<Instruction::CONSTI32>(instructions, (int32_t) 1);
 
                 unsigned long skipElseBranchOverwrite = 0;
-                append(instructions, Instruction::JUMP);
-                skipElseBranchOverwrite = instructions.size();
-                append(instructions, toBytes32(999));
+                skipElseBranchOverwrite = emit<Instruction::JUMP>(instructions, 999);
 
-                instSize = static_cast<int32_t>(instructions.size());
-                memcpy(&instructions[falseBranchOverwrite], &instSize, sizeof(int32_t));
+                patchJumpTarget(falseBranchOverwrite);
 
                 {
                     // else stmts
                     gen(node->binopData.rhs);
 
-                    append(instructions, Instruction::JUMPIF);
+                    emit<Instruction::JUMPIF>(instructions);
                     append(instructions, node->binopData.rhs->bytecode);
 
-                    append(instructions, Instruction::CONSTI32);
-                    trueBranchOverwrite = instructions.size();
-                    append(instructions, toBytes32(888));
+                    trueBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 888);
 
-                    append(instructions, Instruction::CONSTI32);
-                    falseBranchOverwrite = instructions.size();
-                    append(instructions, toBytes32(999));
+                    falseBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 999);
 
-                    instSize = static_cast<int32_t>(instructions.size());
-                    memcpy(&instructions[trueBranchOverwrite], &instSize, sizeof(int32_t));
+                    patchJumpTarget(trueBranchOverwrite);
 
                     // store true
-                    append(instructions, Instruction::STORECONST);
-                    append(instructions, Instruction::RELCONSTI64);
-                    append(instructions, toBytes(node->localOffset));
-                    append(instructions, Instruction::CONSTI32);
-                    append(instructions, toBytes32((int32_t) 1));
-
-                    instSize = static_cast<int32_t>(instructions.size());
-                    memcpy(&instructions[falseBranchOverwrite], &instSize, sizeof(int32_t));
+                    emit<Instruction::STORECONST>(instructions);
+                    emit<Instruction::RELCONSTI64>(instructions, node->localOffset);
+                    emit<Instruction::CONSTI32>(instructions, (int32_t) 1);
+
+                    patchJumpTarget(falseBranchOverwrite);
                 }
 
-                instSize = static_cast<int32_t>(instructions.size());
-                memcpy(&instructions[skipElseBranchOverwrite], &instSize, sizeof(int32_t));
+                patchJumpTarget(skipElseBranchOverwrite);
             } else {
                 gen(node->binopData.lhs);
                 gen(node->binopData.rhs);
@@ -700,110 +755,100 @@ void BytecodeGen::gen(Node *node) {
                 switch (node->binopData.type) {
                     case LexerTokenType::ADD: {
                         if (scale > 1) {
-                            binopHelper("ADD_S_", node, scale);
+                            binopHelper(BinopKind::ADD_S, node, scale);
                         } else {
-                            binopHelper("ADD", node);
+                            binopHelper(BinopKind::ADD, node);
                         }
                     } break;
                     case LexerTokenType::SUB: {
                         if (scale > 1) {
-                            binopHelper("SUB_S_", node, scale);
+                            binopHelper(BinopKind::SUB_S, node, scale);
                         }
                         else {
-                            binopHelper("SUB", node);
+                            binopHelper(BinopKind::SUB, node);
                         }
                     } break;
                     case LexerTokenType::MUL: {
-                        binopHelper("MUL", node);
+                        binopHelper(BinopKind::MUL, node);
                     } break;
                     case LexerTokenType::DIV: {
                         if (isFloat) {
-                            binopHelper("DIV", node);
+                            binopHelper(BinopKind::DIV, node);
                         }
                         else {
-                            binopHelper("SDIV", node);
+                            binopHelper(BinopKind::SDIV, node);
                         }
                     } break;
                     case LexerTokenType::EQ_EQ: {
-                        binopHelper("EQ", node);
+                        binopHelper(BinopKind::EQ, node);
                     } break;
                     case LexerTokenType::NE: {
-                        binopHelper("NEQ", node);
+                        binopHelper(BinopKind::NEQ, node);
                     } break;
                     case LexerTokenType::LT: {
                         if (isFloat) {
-                            binopHelper("LT", node);
+                            binopHelper(BinopKind::LT, node);
                         }
                         else {
-                            binopHelper("SLT", node);
+                            binopHelper(BinopKind::SLT, node);
                         }
                     } break;
                     case LexerTokenType::LE: {
                         if (isFloat) {
-                            binopHelper("LE", node);
+                            binopHelper(BinopKind::LE, node);
                         }
                         else {
-                            binopHelper("SLE", node);
+                            binopHelper(BinopKind::SLE, node);
                         }
                     } break;
                     case LexerTokenType::GT: {
                         if (isFloat) {
-                            binopHelper("GT", node);
+                            binopHelper(BinopKind::GT, node);
                         }
                         else {
-                            binopHelper("SGT", node);
+                            binopHelper(BinopKind::SGT, node);
                         }
                     } break;
                     case LexerTokenType::GE: {
                         if (isFloat) {
-                            binopHelper("GE", node);
+                            binopHelper(BinopKind::GE, node);
                         }
                         else {
-                            binopHelper("SGE", node);
+                            binopHelper(BinopKind::SGE, node);
                         }
                     } break;
                     case LexerTokenType::MOD: {
                         if (isFloat) {
-                            binopHelper("REM", node);
+                            binopHelper(BinopKind::REM, node);
                         }
                         else {
-                            binopHelper("SREM", node);
+                            binopHelper(BinopKind::SREM, node);
                         }
                     } break;
                     case LexerTokenType::BITAND: {
-                        append(instructions, Instruction::BITAND);
-                        append(instructions, toBytes32(typeSize(node->binopData.lhs->typeInfo)));
-                        append(instructions, toBytes(node->binopData.lhsTemporary->localOffset));
-                        append(instructions, toBytes(node->binopData.rhsTemporary->localOffset));
-                        append(instructions, toBytes(node->localOffset));
+                        emit<Instruction::BITAND>(instructions, typeSize(node->binopData.lhs->typeInfo),
+                                                 node->binopData.lhsTemporary->localOffset, node->binopData.rhsTemporary->localOffset,
+                                                 node->localOffset);
                     } break;
                     case LexerTokenType::BITOR: {
-                        append(instructions, Instruction::BITOR);
-                        append(instructions, toBytes32(typeSize(node->binopData.lhs->typeInfo)));
-                        append(instructions, toBytes(node->binopData.lhsTemporary->localOffset));
-                        append(instructions, toBytes(node->binopData.rhsTemporary->localOffset));
-                        append(instructions, toBytes(node->localOffset));
+                        emit<Instruction::BITOR>(instructions, typeSize(node->binopData.lhs->typeInfo),
+                                                 node->binopData.lhsTemporary->localOffset, node->binopData.rhsTemporary->localOffset,
+                                                 node->localOffset);
                     } break;
                     case LexerTokenType::BITXOR: {
-                        append(instructions, Instruction::BITXOR);
-                        append(instructions, toBytes32(typeSize(node->binopData.lhs->typeInfo)));
-                        append(instructions, toBytes(node->binopData.lhsTemporary->localOffset));
-                        append(instructions, toBytes(node->binopData.rhsTemporary->localOffset));
-                        append(instructions, toBytes(node->localOffset));
+                        emit<Instruction::BITXOR>(instructions, typeSize(node->binopData.lhs->typeInfo),
+                                                 node->binopData.lhsTemporary->localOffset, node->binopData.rhsTemporary->localOffset,
+                                                 node->localOffset);
                     } break;
                     case LexerTokenType::BITSHL: {
-                        append(instructions, Instruction::BITSHL);
-                        append(instructions, toBytes32(typeSize(node->binopData.lhs->typeInfo)));
-                        append(instructions, toBytes(node->binopData.lhsTemporary->localOffset));
-                        append(instructions, toBytes(node->binopData.rhsTemporary->localOffset));
-                        append(instructions, toBytes(node->localOffset));
+                        emit<Instruction::BITSHL>(instructions, typeSize(node->binopData.lhs->typeInfo),
+                                                 node->binopData.lhsTemporary->localOffset, node->binopData.rhsTemporary->localOffset,
+                                                 node->localOffset);
                     } break;
                     case LexerTokenType::BITSHR: {
-                        append(instructions, Instruction::BITSHR);
-                        append(instructions, toBytes32(typeSize(node->binopData.lhs->typeInfo)));
-                        append(instructions, toBytes(node->binopData.lhsTemporary->localOffset));
-                        append(instructions, toBytes(node->binopData.rhsTemporary->localOffset));
-                        append(instructions, toBytes(node->localOffset));
+                        emit<Instruction::BITSHR>(instructions, typeSize(node->binopData.lhs->typeInfo),
+                                                 node->binopData.lhsTemporary->localOffset, node->binopData.rhsTemporary->localOffset,
+                                                 node->localOffset);
                     } break;
                     default:
                         cpi_assert(false);
@@ -842,38 +887,33 @@ void BytecodeGen::gen(Node *node) {
                     paramAccum += paramSize;
                 }
 
-                append(instructions, Instruction::BUMPSP);
-                append(instructions, toBytes(totalParamsSize));
+                emit<Instruction::BUMPSP>(instructions, totalParamsSize);
             }
 
             sourceMap.statements.push_back(SourceMapStatement{ instructions.size(), instructions.size(), node });
 
             if (resolvedFn->type == NodeType::FN_DECL) {
                 if (resolvedFn->fnDeclData.isExternal) {
-                    append(instructions, Instruction::CALLE);
-                    append(instructions, toBytes32(this->externalFnTable.length));
+                    auto indexAt = emit<Instruction::CALLE>(instructions, this->externalFnTable.length);
+                    vector_append(externalFnRelocs, (int64_t) indexAt);
                     vector_append(this->externalFnTable, node);
                 }
                 else {
-                    append(instructions, Instruction::CALL);
-                    vector_append(fixups, {(int64_t) instructions.size(), resolvedFn});
-                    append(instructions, toBytes32(999));
+                    auto targetAt = emit<Instruction::CALL>(instructions, 999);
+                    vector_append(fixups, {(int64_t) targetAt, resolvedFn});
                 }
             } else if (resolvedFn->type == NodeType::DECL) {
-                append(instructions, Instruction::CALLI);
-                append(instructions, Instruction::RELI64);
-                append(instructions, toBytes(resolvedFn->localOffset));
+                emit<Instruction::CALLI>(instructions);
+                emit<Instruction::RELI64>(instructions, resolvedFn->localOffset);
             } else if (resolvedFn->type == NodeType::DEREF) {
-                append(instructions, Instruction::CALLI);
-                append(instructions, Instruction::RELI64);
-                append(instructions, toBytes(node->fnCallData.fn->localOffset));
+                emit<Instruction::CALLI>(instructions);
+                emit<Instruction::RELI64>(instructions, node->fnCallData.fn->localOffset);
             } else if (resolvedFn->type == NodeType::DOT) {
                 cpi_assert(resolvedFn->isLocal || resolvedFn->isBytecodeLocal);
-                append(instructions, Instruction::CALLI);
-                append(instructions, Instruction::RELI64);
-                append(instructions, toBytes(resolvedFn->localOffset));
+                emit<Instruction::CALLI>(instructions);
+                emit<Instruction::RELI64>(instructions, resolvedFn->localOffset);
             } else {
-                append(instructions, Instruction::CALLI);
+                emit<Instruction::CALLI>(instructions);
                 append(instructions, resolvedFn->bytecode);
             }
 
@@ -884,18 +924,15 @@ void BytecodeGen::gen(Node *node) {
             }
 
             if (totalParamsSize > 0) {
-                append(instructions, Instruction::BUMPSP);
-                append(instructions, toBytes(-totalParamsSize));
+                emit<Instruction::BUMPSP>(instructions, -totalParamsSize);
             }
 
-            append(node->bytecode, Instruction::RELI64);
-            append(node->bytecode, toBytes(node->localOffset));
+            emit<Instruction::RELI64>(node->bytecode, node->localOffset);
 
             toProcess.push(resolvedFn);
         } break;
         case NodeType::DECL_PARAM: {
-            append(node->bytecode, Instruction::RELI64);
-            append(node->bytecode, toBytes(node->localOffset));
+            emit<Instruction::RELI64>(node->bytecode, node->localOffset);
         } break;
         case NodeType::DEREF: {
             gen(node->nodeData);
@@ -924,11 +961,9 @@ void BytecodeGen::gen(Node *node) {
             }
 
             if (node->isLocal || node->isBytecodeLocal) {
-                append(instructions, Instruction::STORECONST);
-                append(instructions, Instruction::RELCONSTI64);
-                append(instructions, toBytes(node->localOffset));
-                append(instructions, Instruction::RELI64);
-                append(instructions, toBytes(node->nodeData->localOffset));
+                emit<Instruction::STORECONST>(instructions);
+                emit<Instruction::RELCONSTI64>(instructions, node->localOffset);
+                emit<Instruction::RELI64>(instructions, node->nodeData->localOffset);
             }
         } break;
         case NodeType::TYPE: {
@@ -943,7 +978,7 @@ void BytecodeGen::gen(Node *node) {
             }
         } break;
         case NodeType::PANIC: {
-            append(instructions, Instruction::PANIC);
+            emit<Instruction::PANIC>(instructions);
         } break;
         case NodeType::IF: {
             auto resolvedCondition = bytecodeResolve(node->ifData.condition);
@@ -953,29 +988,24 @@ void BytecodeGen::gen(Node *node) {
                 storeValue(resolvedCondition, resolvedCondition->localOffset);
             }
 
-            append(instructions, Instruction::JUMPIF);
+            emit<Instruction::JUMPIF>(instructions);
+            sourceMap.branches.push_back(SourceMapStatement{ instructions.size(), instructions.size(), node });
 
             if (resolvedCondition->isLocal || resolvedCondition->isBytecodeLocal) {
                 cpi_assert(resolvedCondition->isLocal || resolvedCondition->isBytecodeLocal);
 
-                append(instructions, Instruction::RELI64);
-                append(instructions, toBytes(resolvedCondition->localOffset));
+                emit<Instruction::RELI64>(instructions, resolvedCondition->localOffset);
             }
             else {
                 cpi_assert(!resolvedCondition->bytecode.empty());
                 append(instructions, resolvedCondition->bytecode);
             }
 
-            append(instructions, Instruction::CONSTI32);
-            auto trueBranchOverwrite = instructions.size();
-            append(instructions, toBytes32(888));
+            auto trueBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 888);
 
-            append(instructions, Instruction::CONSTI32);
-            auto falseBranchOverwrite = instructions.size();
-            append(instructions, toBytes32(999));
+            auto falseBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 999);
 
-            auto instSize = static_cast<int32_t>(instructions.size());
-            memcpy(&instructions[trueBranchOverwrite], &instSize, sizeof(int32_t));
+            patchJumpTarget(trueBranchOverwrite);
 
             for (const auto &stmt: node->ifData.stmts) {
                 gen(stmt);
@@ -984,22 +1014,17 @@ void BytecodeGen::gen(Node *node) {
             unsigned long skipElseBranchOverwrite = 0;
             auto hasElse = node->ifData.elseStmts.length != 0;
             if (hasElse) {
-                append(instructions, Instruction::JUMP);
-
-                skipElseBranchOverwrite = instructions.size();
-                append(instructions, toBytes32(999));
+                skipElseBranchOverwrite = emit<Instruction::JUMP>(instructions, 999);
             }
 
-            instSize = static_cast<int32_t>(instructions.size());
-            memcpy(&instructions[falseBranchOverwrite], &instSize, sizeof(int32_t));
+            patchJumpTarget(falseBranchOverwrite);
 
             if (hasElse) {
                 for (const auto &stmt: node->ifData.elseStmts) {
                     gen(stmt);
                 }
 
-                instSize = static_cast<int32_t>(instructions.size());
-                memcpy(&instructions[skipElseBranchOverwrite], &instSize, sizeof(int32_t));
+                patchJumpTarget(skipElseBranchOverwrite);
             }
         } break;
         case NodeType::WHILE: {
@@ -1012,38 +1037,32 @@ void BytecodeGen::gen(Node *node) {
                 storeValue(resolvedCondition, resolvedCondition->localOffset);
             }
 
-            append(instructions, Instruction::JUMPIF);
+            emit<Instruction::JUMPIF>(instructions);
+            sourceMap.branches.push_back(SourceMapStatement{ instructions.size(), instructions.size(), node });
             if (resolvedCondition->isLocal || resolvedCondition->isBytecodeLocal) {
                 cpi_assert(resolvedCondition->isLocal || resolvedCondition->isBytecodeLocal);
 
-                append(instructions, Instruction::RELI64);
-                append(instructions, toBytes(resolvedCondition->localOffset));
+                emit<Instruction::RELI64>(instructions, resolvedCondition->localOffset);
             }
             else {
                 cpi_assert(!resolvedCondition->bytecode.empty());
                 append(instructions, resolvedCondition->bytecode);
             }
 
-            append(instructions, Instruction::CONSTI32);
-            auto trueBranchOverwrite = instructions.size();
-            append(instructions, toBytes32(888));
+            auto trueBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 888);
 
-            append(instructions, Instruction::CONSTI32);
-            auto falseBranchOverwrite = instructions.size();
-            append(instructions, toBytes32(999));
+            auto falseBranchOverwrite = emit<Instruction::CONSTI32>(instructions, 999);
 
-            auto instSize = static_cast<int32_t>(instructions.size());
-            memcpy(&instructions[trueBranchOverwrite], &instSize, sizeof(int32_t));
+            patchJumpTarget(trueBranchOverwrite);
 
             for (const auto &stmt: node->whileData.stmts) {
                 gen(stmt);
             }
 
-            append(instructions, Instruction::JUMP);
-            append(instructions, toBytes32(jumpBackToInst));
+            auto jumpBackAt = emit<Instruction::JUMP>(instructions, jumpBackToInst);
+            vector_append(jumpRelocs, (int64_t) jumpBackAt);
 
-            instSize = static_cast<int32_t>(instructions.size());
-            memcpy(&instructions[falseBranchOverwrite], &instSize, sizeof(int32_t));
+            patchJumpTarget(falseBranchOverwrite);
         } break;
         case NodeType::RUN: {
             // work should already be done, just need to go with whatever it resolved itself to
@@ -1064,13 +1083,7 @@ void BytecodeGen::gen(Node *node) {
             if (isNumericType(fromType)
                 && isNumericType(toType)
                 && fromType->typeData.kind != toType->typeData.kind) {
-                append(instructions, Instruction::CONVERT);
-
-                append(instructions, toBytes32(fromType->typeData.kind));
-                append(instructions, toBytes(node->castData.value->localOffset));
-
-                append(instructions, toBytes32(toType->typeData.kind));
-                append(instructions, toBytes(node->localOffset));
+                emit<Instruction::CONVERT>(instructions, fromType->typeData.kind, node->castData.value->localOffset, toType->typeData.kind, node->localOffset);
             }
             else {
                 // copy the bytes from the value's localOffset to the node's localOffset
@@ -1088,8 +1101,7 @@ void BytecodeGen::gen(Node *node) {
             }
             storeValue(node->nodeData, node->localOffset);
 
-            append(instructions, Instruction::NOT);
-            append(instructions, toBytes(node->localOffset));
+            emit<Instruction::NOT>(instructions, node->localOffset);
 
             node->isBytecodeLocal = true;
         } break;
@@ -1101,9 +1113,7 @@ void BytecodeGen::gen(Node *node) {
             }
             storeValue(node->nodeData, node->localOffset);
 
-            append(instructions, Instruction::BITNOT);
-            append(instructions, toBytes(typeSize(node->typeInfo)));
-            append(instructions, toBytes(node->localOffset));
+            emit<Instruction::BITNOT>(instructions, typeSize(node->typeInfo), node->localOffset);
 
             node->isBytecodeLocal = true;
         } break;
@@ -1138,9 +1148,8 @@ void BytecodeGen::gen(Node *node) {
             cpi_assert(resolvedNodeData->isLocal || resolvedNodeData->isBytecodeLocal);
 
             storeValue(resolvedNodeData, resolvedNodeData->localOffset);
-            append(instructions, Instruction::PUTS);
-            append(instructions, Instruction::RELCONSTI64);
-            append(instructions, toBytes(resolvedNodeData->localOffset));
+            emit<Instruction::PUTS>(instructions);
+            emit<Instruction::RELCONSTI64>(instructions, resolvedNodeData->localOffset);
         } break;
         case NodeType::FIELDSOF: {
             gen(node->resolved);
@@ -1150,7 +1159,7 @@ void BytecodeGen::gen(Node *node) {
             node->bytecode = node->resolved->bytecode;
         } break;
         case NodeType::END_SCOPE: {
-            append(instructions, Instruction::NOP);
+            emit<Instruction::NOP>(instructions);
         } break;
         case NodeType::ALIAS: {
             gen(node->nodeData);
@@ -1192,6 +1201,153 @@ void BytecodeGen::gen(Node *node) {
     }
 }
 
+void BytecodeGen::patchJumpTarget(unsigned long operandIndex) {
+    auto instSize = static_cast<int32_t>(instructions.size());
+    memcpy(&instructions[operandIndex], &instSize, sizeof(int32_t));
+    vector_append(jumpRelocs, (int64_t) operandIndex);
+}
+
+struct FnBuffer {
+    Node *fn;
+    BytecodeGen *gen;
+
+    // every fn this one's code reaches, in the order it reached them
+    vector<Node *> callees;
+};
+
+void BytecodeGen::genProgram(Node *mainFn, unsigned int threadCount) {
+    mutex buffersLock;
+    auto claimed = hash_init<Node *, bool>(256);
+    auto buffers = hash_init<Node *, FnBuffer *>(256);
+
+    hash_insert(claimed, mainFn, true);
+
+    ThreadPool pool(threadCount);
+
+    function<void(Node *)> genFn = [&](Node *fn) {
+        auto fnGen = new BytecodeGen();
+        fnGen->parallelFn = fn;
+        fnGen->genId = genId;
+        fnGen->isMainFn = fn == mainFn;
+        fnGen->processFnDecls = true;
+        fnGen->gen(fn);
+
+        auto buffer = new FnBuffer{fn, fnGen, {}};
+
+        while (!fnGen->toProcess.empty()) {
+            auto next = fnGen->toProcess.front();
+            fnGen->toProcess.pop();
+
+            // same as the serial loop for anything that isn't a fn, it goes right after this one
+            if (next->type != NodeType::FN_DECL) {
+                fnGen->isMainFn = false;
+                fnGen->processFnDecls = true;
+                fnGen->gen(next);
+                continue;
+            }
+
+            buffer->callees.push_back(next);
+
+            {
+                lock_guard<mutex> claimGuard(buffersLock);
+                if (hash_get(claimed, next) != nullptr) { continue; }
+                hash_insert(claimed, next, true);
+            }
+
+            pool.submit([&genFn, next]() { genFn(next); });
+        }
+
+        lock_guard<mutex> claimGuard(buffersLock);
+        hash_insert(buffers, fn, buffer);
+    };
+
+    pool.submit([&genFn, mainFn]() { genFn(mainFn); });
+    pool.wait();
+
+    // lay the buffers out in the order generating serially would have reached the fns: breadth first from main,
+    // going by the order each fn's code reaches its callees. that doesn't depend on which thread got where first
+    vector<FnBuffer *> ordered;
+    auto laidOut = hash_init<Node *, bool>(256);
+    hash_insert(laidOut, mainFn, true);
+    ordered.push_back(*hash_get(buffers, mainFn));
+
+    for (unsigned long i = 0; i < ordered.size(); i++) {
+        for (auto callee : ordered[i]->callees) {
+            if (hash_get(laidOut, callee) != nullptr) { continue; }
+            hash_insert(laidOut, callee, true);
+
+            ordered.push_back(*hash_get(buffers, callee));
+        }
+    }
+
+    // link: everything in a buffer was generated as if it started at 0
+    for (auto buffer : ordered) {
+        auto fnGen = buffer->gen;
+        auto base = (int64_t) instructions.size();
+        auto externalBase = (int32_t) externalFnTable.length;
+
+        for (auto reloc : fnGen->jumpRelocs) {
+            int32_t target;
+            memcpy(&target, &fnGen->instructions[reloc], sizeof(int32_t));
+            target += static_cast<int32_t>(base);
+            memcpy(&fnGen->instructions[reloc], &target, sizeof(int32_t));
+
+            vector_append(jumpRelocs, reloc + base);
+        }
+
+        for (auto reloc : fnGen->externalFnRelocs) {
+            int32_t index;
+            memcpy(&index, &fnGen->instructions[reloc], sizeof(int32_t));
+            index += externalBase;
+            memcpy(&fnGen->instructions[reloc], &index, sizeof(int32_t));
+
+            vector_append(externalFnRelocs, reloc + base);
+        }
+
+        for (auto callNode : fnGen->externalFnTable) {
+            vector_append(externalFnTable, callNode);
+        }
+
+        for (auto f : fnGen->fixups) {
+            vector_append(fixups, {f.instOffset + base, f.node});
+        }
+
+        auto roDataBase = static_cast<int64_t>(roData.size());
+        for (auto reloc : fnGen->roDataRelocs) {
+            int64_t roDataOffset;
+            memcpy(&roDataOffset, &fnGen->instructions[reloc], sizeof(int64_t));
+            roDataOffset += roDataBase;
+            memcpy(&fnGen->instructions[reloc], &roDataOffset, sizeof(int64_t));
+
+            vector_append(roDataRelocs, reloc + base);
+        }
+        roData.insert(roData.end(), fnGen->roData.begin(), fnGen->roData.end());
+
+        for (auto statement : fnGen->sourceMap.statements) {
+            statement.instIndex += base;
+            statement.instEndIndex += base;
+            sourceMap.statements.push_back(statement);
+        }
+        for (auto branch : fnGen->sourceMap.branches) {
+            branch.instIndex += base;
+            branch.instEndIndex += base;
+            sourceMap.branches.push_back(branch);
+        }
+
+        for (auto node : fnGen->generatedNodes) {
+            vector_append(generatedNodes, node);
+        }
+
+        buffer->fn->fnDeclData.instOffset += base;
+        hash_insert(fnTable, buffer->fn->fnDeclData.tableIndex, buffer->fn->fnDeclData.instOffset);
+
+        instructions.insert(instructions.end(), fnGen->instructions.begin(), fnGen->instructions.end());
+
+        delete fnGen;
+        delete buffer;
+    }
+}
+
 void BytecodeGen::fixup() {
     // fixup statically known function instruction offsets
     for (auto&& f : fixups) {
@@ -1200,6 +1356,93 @@ void BytecodeGen::fixup() {
         auto instOffset = static_cast<int32_t>(node->fnDeclData.instOffset);
         memcpy(&instructions[f.instOffset], &instOffset, sizeof(int32_t));
     }
+
+    flushRoData();
+}
+
+void BytecodeGen::copyFromRoData(int64_t offset, const string &bytes) {
+    auto found = hash_get(roDataOffsets, bytes);
+
+    int64_t roDataOffset;
+    if (found != nullptr) {
+        roDataOffset = *found;
+    }
+    else {
+        roDataOffset = static_cast<int64_t>(roData.size());
+        roData.insert(roData.end(), bytes.begin(), bytes.end());
+        hash_insert(roDataOffsets, bytes, roDataOffset);
+    }
+
+    auto operandsAt = emit<Instruction::STORE>(instructions,
+                                               Instruction::RELCONSTI64, offset,
+                                               Instruction::RODATAI64, roDataOffset,
+                                               bytes.size());
+
+    // for now relative to roData, flushRoData makes it relative to the instructions
+    auto roDataOffsetAt = operandsAt + sizeof(Instruction) + sizeof(int64_t) + sizeof(Instruction);
+    vector_append(roDataRelocs, (int64_t) roDataOffsetAt);
+}
+
+void BytecodeGen::flushRoData() {
+    if (roData.empty()) { return; }
+
+    emit<Instruction::RODATA>(instructions, roData.size());
+
+    auto base = static_cast<int64_t>(instructions.size());
+    for (auto reloc : roDataRelocs) {
+        int64_t roDataOffset;
+        memcpy(&roDataOffset, &instructions[reloc], sizeof(int64_t));
+        roDataOffset += base;
+        memcpy(&instructions[reloc], &roDataOffset, sizeof(int64_t));
+    }
+
+    append(instructions, roData);
+
+    // anything generated after this (more compile time code) gets its own block
+    roData.clear();
+    hash_clear(roDataOffsets);
+    roDataRelocs.length = 0;
+}
+
+// where each of a struct literal's params goes: the layout of the struct it was coerced to if it has them all,
+// otherwise its own
+vector_t<int32_t> structLiteralOffsets(Node *node) {
+    auto coercedType = node->typeInfo->typeData.structTypeData.coercedType;
+    if (coercedType != nullptr) {
+        auto offsets = structLayout(coercedType).offsets;
+        if (offsets.length == node->structLiteralData.params.length) { return offsets; }
+    }
+
+    return structLayout(node->typeInfo).offsets;
+}
+
+// the bytes storeValue would write for a struct literal made only of literals, laid out the same way
+bool constantStructBytes(Node *node, string *bytes) {
+    auto offsets = structLiteralOffsets(node);
+
+    unsigned long index = 0;
+    for (const auto &param : node->structLiteralData.params) {
+        auto paramOffset = static_cast<unsigned long>(vector_at(offsets, index));
+        index += 1;
+
+        auto value = bytecodeResolve(param->paramData.value);
+        if (value->type != NodeType::INT_LITERAL
+            && value->type != NodeType::FLOAT_LITERAL
+            && value->type != NodeType::BOOLEAN_LITERAL) {
+            return false;
+        }
+
+        // a CONST* instruction followed by the value, which is what STORECONST writes
+        if (value->bytecode.empty() || !isConst(static_cast<Instruction>(value->bytecode[0]))) { return false; }
+
+        auto valueSize = value->bytecode.size() - 1;
+        if (bytes->size() < paramOffset + valueSize) {
+            bytes->resize(paramOffset + valueSize);
+        }
+        memcpy(&(*bytes)[paramOffset], &value->bytecode[1], valueSize);
+    }
+
+    return !bytes->empty();
 }
 
 // todo(chad): If this supported a non-constant offest (i.e. runtime offset), then a lot of the 'store rvalue into slot' stuff could go away
@@ -1208,59 +1451,51 @@ void BytecodeGen::storeValue(Node *node, int64_t offset) {
 
     switch (node->type) {
         case NodeType::BOOLEAN_LITERAL: {
-            append(instructions, Instruction::STORECONST);
+            emit<Instruction::STORECONST>(instructions);
 
-            append(instructions, Instruction::RELCONSTI64);
-            append(instructions, toBytes(offset));
+            emit<Instruction::RELCONSTI64>(instructions, offset);
 
             append(instructions, node->bytecode);
         } break;
         case NodeType::INT_LITERAL:
         case NodeType::SIZEOF: {
-            append(instructions, Instruction::STORECONST);
+            emit<Instruction::STORECONST>(instructions);
 
-            append(instructions, Instruction::RELCONSTI64);
-            append(instructions, toBytes(offset));
+            emit<Instruction::RELCONSTI64>(instructions, offset);
 
             append(instructions, node->bytecode);
         } break;
         case NodeType::NIL_LITERAL: {
-            append(instructions, Instruction::STORECONST);
+            emit<Instruction::STORECONST>(instructions);
 
-            append(instructions, Instruction::RELCONSTI64);
-            append(instructions, toBytes(offset));
+            emit<Instruction::RELCONSTI64>(instructions, offset);
 
             append(instructions, node->bytecode);
         } break;
         case NodeType::FLOAT_LITERAL: {
-            append(instructions, Instruction::STORECONST);
+            emit<Instruction::STORECONST>(instructions);
 
-            append(instructions, Instruction::RELCONSTI64);
-            append(instructions, toBytes(offset));
+            emit<Instruction::RELCONSTI64>(instructions, offset);
 
             append(instructions, node->bytecode);
         } break;
         case NodeType::FN_DECL: {
-            append(instructions, Instruction::STORECONST);
+            emit<Instruction::STORECONST>(instructions);
 
-            append(instructions, Instruction::RELCONSTI64);
-            append(instructions, toBytes(offset));
+            emit<Instruction::RELCONSTI64>(instructions, offset);
 
-            append(instructions, Instruction::CONSTI32);
-            append(instructions, toBytes32(node->fnDeclData.tableIndex));
+            emit<Instruction::CONSTI32>(instructions, node->fnDeclData.tableIndex);
         } break;
         case NodeType::ADDRESS_OF: {
             if (node->nodeData->type == NodeType::DOT && node->nodeData->dotData.pointerIsRelative) {
                 makeStore(instructions, Instruction::RELCONSTI64, offset, Instruction::RELCONSTI64, node->nodeData->localOffset, 8);
             }
             else {
-                append(instructions, Instruction::STORECONST);
+                emit<Instruction::STORECONST>(instructions);
 
-                append(instructions, Instruction::RELCONSTI64);
-                append(instructions, toBytes(offset));
+                emit<Instruction::RELCONSTI64>(instructions, offset);
 
-                append(instructions, Instruction::RELI64);
-                append(instructions, toBytes(node->nodeData->localOffset));
+                emit<Instruction::RELI64>(instructions, node->nodeData->localOffset);
             }
         } break;
         case NodeType::DEREF: {
@@ -1307,7 +1542,7 @@ void BytecodeGen::storeValue(Node *node, int64_t offset) {
                     tagValue->typeInfo = node->typeInfo->typeData.structTypeData.coercedType->typeData.structTypeData.unionTagType;
                 }
                 else {
-                    tagValue->typeInfo = new Node(NodeTypekind::I64);
+                    tagValue->typeInfo = canonicalType(NodeTypekind::I64);
                 }
                 tagValue->intLiteralData.value = tagIndex;
 
@@ -1320,24 +1555,23 @@ void BytecodeGen::storeValue(Node *node, int64_t offset) {
                 storeValue(value->paramData.value, offset + 8);
             }
             else {
-                auto sizeSoFar = 0;
-
                 for (const auto &param : node->structLiteralData.params) {
                     gen(param->paramData.value);
                 }
 
-                for (const auto &param : node->structLiteralData.params) {
-                    auto paramSize = typeSize(param->paramData.value->typeInfo);
-                    auto paramAlign = typeAlign(param->paramData.value->typeInfo);
-
-                    // alignment
-                    if (sizeSoFar > 0 && paramAlign > 0) {
-                        sizeSoFar += sizeSoFar % paramAlign;
-                    }
+                // all constants: one copy out of read-only data instead of a store per param
+                string bytes;
+                if (node->structLiteralData.params.length >= 4 && constantStructBytes(node, &bytes)) {
+                    copyFromRoData(offset, bytes);
+                    break;
+                }
 
-                    storeValue(param->paramData.value, offset + sizeSoFar);
+                auto offsets = structLiteralOffsets(node);
 
-                    sizeSoFar += paramSize;
+                unsigned long index = 0;
+                for (const auto &param : node->structLiteralData.params) {
+                    storeValue(param->paramData.value, offset + vector_at(offsets, index));
+                    index += 1;
                 }
             }
         } break;
@@ -1345,9 +1579,29 @@ void BytecodeGen::storeValue(Node *node, int64_t offset) {
             storeValue(node->arrayLiteralData.structLiteralRepresentation, offset);
         } break;
         case NodeType::STRING_LITERAL: {
-            this->genId += 1;
-            storeValue(node->stringLiteralData.arrayLiteralRepresentation, offset);
-            this->genId -= 1;
+            if (node->stringLiteralData.arrayLiteralRepresentation != nullptr) {
+                this->genId += 1;
+                storeValue(node->stringLiteralData.arrayLiteralRepresentation, offset);
+                this->genId -= 1;
+                break;
+            }
+
+            auto buffer = node->stringLiteralData.buffer;
+            gen(buffer);
+
+            auto value = node->stringLiteralData.value;
+            if (!value->empty()) {
+                copyFromRoData(buffer->localOffset, *value);
+            }
+
+            // {&buffer, count}
+            emit<Instruction::STORECONST>(instructions);
+            emit<Instruction::RELCONSTI64>(instructions, offset);
+            emit<Instruction::RELI64>(instructions, buffer->localOffset);
+
+            emit<Instruction::STORECONST>(instructions);
+            emit<Instruction::RELCONSTI64>(instructions, offset + 8);
+            emit<Instruction::CONSTI64>(instructions, value->size());
         } break;
         case NodeType::UNARY_NEG: {
             storeValue(node->unaryNegData.rewritten, offset);
@@ -1369,4 +1623,7 @@ void BytecodeGen::storeValue(Node *node, int64_t offset) {
 BytecodeGen::BytecodeGen() {
     fnTable = hash_init<uint32_t, uint64_t>(100);
     fixups = vector_init<Fixup>(512);
+
+    // most fns fit without ever growing this
+    instructions.reserve(4096);
 }
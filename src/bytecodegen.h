@@ -7,6 +7,14 @@
 #include "node.h"
 #include "assembler.h"
 
+// what binopHelper can generate. which instruction that ends up being also depends on the operands' width
+enum class BinopKind {
+    ADD, ADD_S, SUB, SUB_S, MUL, DIV, SDIV,
+    EQ, NEQ, LT, SLT, LE, SLE, GT, SGT, GE, SGE,
+    REM, SREM,
+    COUNT
+};
+
 struct Fixup {
     int64_t instOffset;
     Node *node;
@@ -29,17 +37,38 @@ public:
     bool isMainFn;
     uint32_t genId = 1;
 
+    // set when this is one fn's buffer in genProgram
+    Node *parallelFn = nullptr;
+
     int64_t debugLocalOffset = 0;
 
     // for going back at the end and setting call/jump locations
     // I guess this is like a poor man's linker
     vector_t<Fixup> fixups;
 
-    void binopHelper(string instructionStr, Node *node, int32_t scale = 1);
+    // positions of operands holding an instruction offset (jump targets), and of CALLE operands holding an index
+    // into externalFnTable. both need shifting when this buffer gets linked in after other fns, see genProgram
+    vector_t<int64_t> jumpRelocs = vector_init<int64_t>(64);
+    vector_t<int64_t> externalFnRelocs = vector_init<int64_t>(8);
+
+    // read-only data (string literals' characters, constant struct literals), deduped.
+    // fixup() puts it after the code as one RODATA block, and points the RODATAI64 operands in roDataRelocs at it
+    vector<unsigned char> roData = {};
+    hash_t<string, int64_t> *roDataOffsets = hash_init<string, int64_t>(64);
+    vector_t<int64_t> roDataRelocs = vector_init<int64_t>(16);
+
+    void binopHelper(BinopKind op, Node *node, int32_t scale = 1);
 
     void gen(Node *node);
     void genDot(Node *node);
     void fixup();
+    void patchJumpTarget(unsigned long operandIndex);
+    void copyFromRoData(int64_t offset, const string &bytes);
+    void flushRoData();
+
+    // generates mainFn and everything reachable from it, each fn into its own buffer on one of threadCount threads,
+    // then lays the buffers out one after the other and fixes up calls/jumps/the source map
+    void genProgram(Node *mainFn, unsigned int threadCount);
 
     void storeValue(Node *node, int64_t offset);
 
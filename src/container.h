@@ -123,6 +123,20 @@ Value *hash_get(struct hash_t<Key, Value> *ht, Key key) {
     return nullptr;
 }
 
+template<typename Key, typename Value>
+void hash_clear(hash_t<Key, Value> *ht) {
+    for (auto i = 0; i < ht->bucket_count; i++) {
+        auto bucket = ht->buckets[i];
+        while (bucket != nullptr) {
+            auto next = bucket->next;
+            delete bucket;
+            bucket = next;
+        }
+        ht->buckets[i] = nullptr;
+    }
+    ht->size = 0;
+}
+
 
 // ==========================
 //          VECTOR
@@ -149,7 +163,7 @@ vector_t<T> vector_init(unsigned long initial_capacity) {
 
 template<typename T>
 void vector_grow(vector_t<T> &vector) {
-    unsigned long new_capacity = vector.capacity * 2;
+    unsigned long new_capacity = vector.capacity == 0 ? 4 : vector.capacity * 2;
 
     auto new_items = (T *) calloc((size_t) new_capacity, sizeof(T));
 //    auto old_items = vector.items;
@@ -195,4 +209,15 @@ auto end(vector_t<T> &v) {
     return &v.items[v.length];
 }
 
+// a vector that's only allocated once something goes in it (a node's preStmts/postStmts) iterates as empty until then
+template<typename T>
+T *begin(vector_t<T> *v) {
+    return v == nullptr ? nullptr : &v->items[0];
+}
+
+template<typename T>
+T *end(vector_t<T> *v) {
+    return v == nullptr ? nullptr : &v->items[v->length];
+}
+
 #endif //CPI_CONTAINER_H
@@ -3,6 +3,8 @@
 #include "parser.h"
 #include "bytecodegen.h"
 #include "semantic.h"
+#include "tiering.h"
+#include "profile.h"
 
 #include <iostream>
 #include <string.h>
@@ -21,10 +23,10 @@ using namespace std;
 void printStmt(Interpreter *interp, int32_t pcStmtStart, ostream &s, bool withLineInfo = false) {
     for (auto stmt : interp->sourceMap.statements) {
         if (stmt.instIndex == (unsigned long) pcStmtStart) {
-            s << stmt.node->region.srcInfo.source->substr(stmt.node->region.start.byteIndex, stmt.node->region.end.byteIndex - stmt.node->region.start.byteIndex);
+            s << SourceRegion{stmt.node->region};
 
             if (withLineInfo) {
-                s << "[" << stmt.node->region.start.line << "]";
+                s << "[" << lineColFor(stmt.node->region.srcInfo, stmt.node->region.start).line << "]";
             }
         }
     }
@@ -47,7 +49,9 @@ bool isValidPtr(void *p) {
     return ret;
 }
 
-void debugPrintVar(ostream &target, Interpreter *interp, TypeData td, int64_t offset, vector<string> &extraLines) {
+void debugPrintVar(ostream &target, Interpreter *interp, Node *type, int64_t offset, vector<string> &extraLines) {
+    auto td = type->typeData;
+
     switch (td.kind) {
         case NodeTypekind::NONE: {
             target << "{}";
@@ -114,14 +118,14 @@ void debugPrintVar(ostream &target, Interpreter *interp, TypeData td, int64_t of
                     }
                     else {
                         auto enumAtom = vector_at(td.enumTypeData.params, (unsigned long) enumValue - 1)->paramData.name->symbolData.atomId;
-                        auto enumName = atomTable->backwardAtoms[enumAtom];
+                        auto enumName = atomTable->nameOf(enumAtom);
                         target << enumName;
                     }
                 }
             }
 
             target << " (";
-            debugPrintVar(target, interp, td.enumTypeData.type->typeData, offset, extraLines);
+            debugPrintVar(target, interp, td.enumTypeData.type, offset, extraLines);
             target << ")";
         } break;
         case NodeTypekind::FLOAT_LITERAL: {
@@ -191,7 +195,7 @@ void debugPrintVar(ostream &target, Interpreter *interp, TypeData td, int64_t of
                 extra << "<<invalid ptr>>";
             }
             else {
-                debugPrintVar(extra, interp, resolve(td.pointerTypeData.underlyingType)->typeData, loadedOffset, extraLines);
+                debugPrintVar(extra, interp, resolve(td.pointerTypeData.underlyingType), loadedOffset, extraLines);
             }
 
             extraLines.push_back(extra.str());
@@ -230,8 +234,8 @@ void debugPrintVar(ostream &target, Interpreter *interp, TypeData td, int64_t of
                     auto param = vector_at(td.structTypeData.params, (unsigned long) tag);
                     cpi_assert(param->type == NodeType::DECL_PARAM);
 
-                    extra << atomTable->backwardAtoms[param->paramData.name->symbolData.atomId] << ":";
-                    debugPrintVar(extra, interp, resolve(param->typeInfo)->typeData, offset + 8, extraLines);
+                    extra << atomTable->nameOf(param->paramData.name->symbolData.atomId) << ":";
+                    debugPrintVar(extra, interp, resolve(param->typeInfo), offset + 8, extraLines);
                 }
                 extra << "}";
 
@@ -283,7 +287,7 @@ void debugPrintVar(ostream &target, Interpreter *interp, TypeData td, int64_t of
                     for (auto i = 0; i < realSize; i++) {
                         extra << to_string(i) << ":";
 
-                        debugPrintVar(extra, interp, resolve(td.structTypeData.secretArrayElementType)->typeData, array_offset, extraLines);
+                        debugPrintVar(extra, interp, resolve(td.structTypeData.secretArrayElementType), array_offset, extraLines);
                         array_offset += ts;
 
                         if (i < realSize - 1) {
@@ -308,31 +312,21 @@ void debugPrintVar(ostream &target, Interpreter *interp, TypeData td, int64_t of
                 ostringstream extra("");
                 extra << "#" << nvr << ": ";
                 extra << "{";
-                auto sizeSoFar = 0;
+                auto offsets = structLayout(type).offsets;
                 unsigned long idx = 0;
 
                 for (const auto &param : td.structTypeData.params) {
                     auto name = "_" + to_string(idx);
                     if (param->paramData.name != nullptr) {
-                        name = atomTable->backwardAtoms[param->paramData.name->symbolData.atomId];
+                        name = atomTable->nameOf(param->paramData.name->symbolData.atomId);
                     }
                     extra << name << ":";
 
-                    auto paramSize = typeSize(param->paramData.type);
-                    auto paramAlign = typeAlign(param->paramData.type);
-
-                    // alignment
-                    if (sizeSoFar > 0 && paramAlign > 0) {
-                        sizeSoFar += sizeSoFar % paramAlign;
-                    }
-
-                    debugPrintVar(extra, interp, resolve(param->typeInfo)->typeData, offset + sizeSoFar, extraLines);
+                    debugPrintVar(extra, interp, resolve(param->typeInfo), offset + vector_at(offsets, idx), extraLines);
                     if (idx < td.structTypeData.params.length - 1) {
                         extra << " ";
                     }
 
-                    sizeSoFar += paramSize;
-
                     idx += 1;
                 }
                 extra << "}";
@@ -355,7 +349,7 @@ void debugPrintVar(Interpreter *interp, int32_t bp, Node *n, ostream &s) {
     }
 
     vector<string> extra;
-    debugPrintVar(s, interp, resolvedTypeinfo->typeData, ((int64_t) interp->stack_base) + bp + n->localOffset, extra);
+    debugPrintVar(s, interp, resolvedTypeinfo, ((int64_t) interp->stack_base) + bp + n->localOffset, extra);
     s << endl;
     for (const auto &e : extra) {
         s << e << endl;
@@ -367,7 +361,7 @@ void printVarsInScope(Interpreter *interp, Scope *scope, int32_t bp, ostringstre
         auto bucket = scope->symbols->buckets[i];
         if (bucket != nullptr) {
             if (bucket->value->isLocal || bucket->value->isBytecodeLocal) {
-                auto name = atomTable->backwardAtoms[bucket->key];
+                auto name = atomTable->nameOf(bucket->key);
                 s << name << ": ";
                 debugPrintVar(interp, bp, bucket->value, s);
             }
@@ -376,7 +370,7 @@ void printVarsInScope(Interpreter *interp, Scope *scope, int32_t bp, ostringstre
                 bucket = bucket->next;
 
                 if (bucket->value->isLocal || bucket->value->isBytecodeLocal) {
-                    auto name = atomTable->backwardAtoms[bucket->key];
+                    auto name = atomTable->nameOf(bucket->key);
                     s << name << ": ";
                     debugPrintVar(interp, bp, bucket->value, s);
                 }
@@ -391,14 +385,14 @@ void printVarsInScope(Interpreter *interp, Scope *scope, int32_t bp, ostringstre
             auto p = vector_at(scope->fnScopeParams, i);
             assert(p->type == NodeType::DECL_PARAM);
 
-            auto name = atomTable->backwardAtoms[p->paramData.name->symbolData.atomId];
+            auto name = atomTable->nameOf(p->paramData.name->symbolData.atomId);
             s << name << ": ";
 
             auto resolvedTypeinfo = resolve(p->paramData.type);
             offset -= typeSize(resolvedTypeinfo);
 
             vector<string> extra;
-            debugPrintVar(s, interp, resolvedTypeinfo->typeData, ((int64_t) interp->stack.data()) + bp + p->localOffset, extra);
+            debugPrintVar(s, interp, resolvedTypeinfo, ((int64_t) interp->stack.data()) + bp + p->localOffset, extra);
             s << endl;
 
             for (const auto &e : extra) {
@@ -411,7 +405,7 @@ void printVarsInScope(Interpreter *interp, Scope *scope, int32_t bp, ostringstre
             s << "*RETURN*: ";
 
             vector<string> extra;
-            debugPrintVar(s, interp, scope->fnReturnType->typeData, ((int64_t) interp->stack.data()) + bp, extra);
+            debugPrintVar(s, interp, scope->fnReturnType, ((int64_t) interp->stack.data()) + bp, extra);
             s << endl;
             for (const auto &e : extra) {
                 s << e << endl;
@@ -460,10 +454,12 @@ string getInfo(Interpreter *interp) {
     for (uint16_t i = 0; i < interp->depth + 1; i++) {
         // line 1: location
         for (auto stmt : interp->sourceMap.statements) {
-            if (stmt.node->region.srcInfo.fileName != nullptr && stmt.instIndex == (unsigned long) pc) {
-                s << *stmt.node->region.srcInfo.fileName << endl;
-                s << stmt.node->region.start.line << endl;
-                s << stmt.node->region.start.col << endl;
+            auto file = sourceFileFor(stmt.node->region.srcInfo);
+            if (file->fileName != nullptr && stmt.instIndex == (unsigned long) pc) {
+                auto lineCol = lineColFor(stmt.node->region.srcInfo, stmt.node->region.start);
+                s << *file->fileName << endl;
+                s << lineCol.line << endl;
+                s << lineCol.col << endl;
             }
         }
 
@@ -550,8 +546,9 @@ void runDebugger(Interpreter *interp, MnemonicPrinter *mp) {
 
                 for (auto stmt : interp->sourceMap.statements) {
                     if (stmt.instIndex == (unsigned long) interp->pc) {
-                        s << stmt.node->region.start.line << endl;
-                        s << stmt.node->region.start.col << endl;
+                        auto lineCol = lineColFor(stmt.node->region.srcInfo, stmt.node->region.start);
+                        s << lineCol.line << endl;
+                        s << lineCol.col << endl;
                     }
                 }
 
@@ -672,6 +669,8 @@ void interpretPanic(Interpreter *interp) {
 
 // puts
 void interpretPuts(Interpreter *interp) {
+    interp->hadSideEffects = true;
+
     auto offset_from_stack = interp->read<int64_t>();
     auto ptr_to_offset = (int64_t *) (interp->stack.data() + offset_from_stack);
     auto followed_ptr = (char *) *ptr_to_offset;
@@ -687,6 +686,12 @@ void interpretNop(Interpreter *interp) {
     // do nothing!
 }
 
+// only ever reached if something falls off the end of the code before it
+void interpretRoData(Interpreter *interp) {
+    auto length = interp->consume<int64_t>();
+    interp->pc += length;
+}
+
 // not
 void interpretNot(Interpreter *interp) {
     auto offset = interp->consume<int64_t>();
@@ -944,7 +949,11 @@ ffi_type *ffiTypeFor(Node *type) {
         case NodeTypekind::F32: return &ffi_type_float;
         case NodeTypekind::F64: return &ffi_type_double;
         case NodeTypekind::STRUCT: {
-            // todo(chad): @Leak
+            // canonical and declared struct types are shared between calls, so only build each one's ffi_type once
+            static hash_t<Node *, ffi_type *> *ffiStructTypes = hash_init<Node *, ffi_type *>(64);
+            auto found = hash_get(ffiStructTypes, type);
+            if (found != nullptr) { return *found; }
+
             auto args = (ffi_type **) malloc((type->typeData.structTypeData.params.length + 1) * sizeof(ffi_type *));
             for (unsigned long i = 0; i < type->typeData.structTypeData.params.length; i++) {
                 args[i] = ffiTypeFor(vector_at(type->typeData.structTypeData.params, i)->typeInfo);
@@ -953,6 +962,7 @@ ffi_type *ffiTypeFor(Node *type) {
             args[type->typeData.structTypeData.params.length] = nullptr;
             auto dp_type = (ffi_type *) malloc(sizeof(ffi_type));
             *dp_type = {.size = 0, .alignment = 0, .type = FFI_TYPE_STRUCT, .elements = args};
+            hash_insert(ffiStructTypes, type, dp_type);
             return dp_type;
         }
         case NodeTypekind::POINTER: return &ffi_type_pointer;
@@ -967,13 +977,15 @@ ffi_type *ffiTypeFor(Node *type) {
 
 // calle
 void interpretCalle(Interpreter *interp) {
+    interp->hadSideEffects = true;
+
     auto fnTableIndex = interp->consume<int32_t>();
     auto originalCallNode = vector_at(interp->externalFnTable, (unsigned long) fnTableIndex);
     assert(originalCallNode != nullptr);
 
     auto originalFn = resolve(originalCallNode->fnCallData.fn);
     assert(originalFn->type == NodeType::FN_DECL);
-    auto fnName = atomTable->backwardAtoms[originalFn->fnDeclData.name->symbolData.atomId];
+    auto fnName = atomTable->nameOf(originalFn->fnDeclData.name->symbolData.atomId);
 
     void *found_fn = nullptr;
 
@@ -1039,6 +1051,10 @@ void interpretCall(Interpreter *interp) {
 }
 
 void Interpreter::callIndex(int64_t index) {
+    if (profile != nullptr) { recordCall(profile, (uint64_t) index); }
+
+    if (tiering != nullptr && tiering->callNative(this, (uint64_t) index)) { return; }
+
     depth += 1;
 
     pcs.push_back(lastValidPc);
@@ -1073,7 +1089,10 @@ void Interpreter::addBreakpointForCommand(string command) {
 
     // find the statement which is on this line
     for (auto stmt : sourceMap.statements) {
-        if (stmt.node->region.start.line == (unsigned long) bNum && *stmt.node->region.srcInfo.fileName == fileName) {
+        auto file = sourceFileFor(stmt.node->region.srcInfo);
+        if (file->fileName == nullptr || *file->fileName != fileName) { continue; }
+
+        if (lineColFor(stmt.node->region.srcInfo, stmt.node->region.start).line == (uint32_t) bNum) {
             bool isConditional = condition.length() > 0;
             if (openSquareIndex == string::npos || closeSquareIndex == string::npos) {
                 isConditional = false;
@@ -1122,11 +1141,17 @@ void interpretReturn(Interpreter *interp) {
 
 // jumpif
 void interpretJumpIf(Interpreter *interp) {
+    auto at = interp->pc;
+
     auto constCond = interp->read<int32_t>();
 
     auto trueInst = interp->read<int32_t>();
     auto falseInst = interp->read<int32_t>();
 
+    if (interp->profile != nullptr) {
+        recordBranch(interp->profile, at, constCond == 1);
+    }
+
     if (constCond == 1) {
         interp->pc = trueInst;
     } else {
@@ -1138,6 +1163,11 @@ void interpretJumpIf(Interpreter *interp) {
 void interpretJump(Interpreter *interp) {
     auto index = (uint32_t)interp->consume<int32_t>();
 
+    // jumping backwards is the end of a loop iteration
+    if (interp->tiering != nullptr && index < interp->pc) {
+        interp->tiering->backEdge(index);
+    }
+
     interp->pc = index;
 }
 
@@ -1146,7 +1176,8 @@ void storeToFrom(Interpreter *interp, void *to, void *from) {
 
     if (to == nullptr) {
         cout << "nil pointer dereference!!" << endl;
-        cout << "at or near: " << interp->stoppedOnStatement.node->region.start.line << ":" << interp->stoppedOnStatement.node->region.start.col;
+        auto lineCol = lineColFor(interp->stoppedOnStatement.node->region.srcInfo, interp->stoppedOnStatement.node->region.start);
+        cout << "at or near: " << lineCol.line << ":" << lineCol.col;
         exit(-1);
     }
     else {
@@ -6,12 +6,40 @@
 #include <stack>
 #include <dlfcn.h>
 #include <zmq.h>
+#include <ffi.h>
 #include <stdint.h>
 
 #include "assembler.h"
 #include "semantic.h"
 #include "bytecodegen.h"
 
+class Tiering;
+struct ProfileRecorder;
+
+ffi_type *ffiTypeFor(Node *type);
+
+// where a #link library (or, with another extension, its --lto bitcode) is found, in the order the search goes.
+// nullptr if it's in none of them
+inline char *linkLibPath(string *lib, const string &extension = ".dylib") {
+//    auto home = strdup(getenv("HOME"));
+    auto path = realpath(string("/usr/local/lib/cpi/" + *lib + extension).c_str(), nullptr);
+
+    if (path == nullptr) {
+        path = realpath(string("/usr/local/lib/" + *lib + extension).c_str(), nullptr);
+    }
+    if (path == nullptr) {
+        path = realpath(string("/usr/lib/" + *lib + extension).c_str(), nullptr);
+    }
+    if (path == nullptr) {
+        path = realpath(string("./" + *lib + extension).c_str(), nullptr);
+    }
+    if (path == nullptr) {
+        path = realpath(string(*lib + extension).c_str(), nullptr);
+    }
+
+    return path;
+}
+
 class Interpreter;
 
 template <typename T>
@@ -68,6 +96,7 @@ void interpretNop(Interpreter *interp);
 void interpretNot(Interpreter *interp);
 void interpretBitNot(Interpreter *interp);
 void interpretConvert(Interpreter *interp);
+void interpretRoData(Interpreter *interp);
 void interpretMathBitwiseAnd(Interpreter *interp);
 void interpretMathBitwiseOr(Interpreter *interp);
 void interpretMathBitwiseXor(Interpreter *interp);
@@ -111,6 +140,15 @@ public:
 
     bool terminated = false;
 
+    // --tiered, for calling hot fns natively
+    Tiering *tiering = nullptr;
+
+    // --profile-out, for counting which way each JUMPIF goes and how often each fn is called
+    ProfileRecorder *profile = nullptr;
+
+    // set by anything that's visible outside the interpreter (external calls, puts), so the result can't be cached
+    bool hadSideEffects = false;
+
     SourceMap sourceMap;
     vector<Breakpoint> breakpoints = {};
     vector<string> breakCommands = {};
@@ -259,34 +297,25 @@ public:
                 interpretNop,
                 interpretNot,
                 interpretBitNot,
-                interpretConvert};
+                interpretConvert,
+                interpretRoData};
 
         libs = vector_init<void *>(10);
         for (auto lib : externalLibs) {
-//            auto home = strdup(getenv("HOME"));
-            auto path = realpath(string("/usr/local/lib/cpi/" + *lib + ".dylib").c_str(), nullptr);
-
-            if (path == nullptr) {
-                path = realpath(string("/usr/local/lib/" + *lib + ".dylib").c_str(), nullptr);
-            }
-            if (path == nullptr) {
-                path = realpath(string("/usr/lib/" + *lib + ".dylib").c_str(), nullptr);
-            }
-            if (path == nullptr) {
-                path = realpath(string("./" + *lib + ".dylib").c_str(), nullptr);
-            }
-            if (path == nullptr) {
-                path = realpath(string(*lib + ".dylib").c_str(), nullptr);
-            }
+            loadLib(lib);
+        }
+    }
 
-            void *libhandle = dlopen(path, RTLD_LAZY);
-            if (!libhandle) {
-                fprintf(stderr, "dlopen error: %s\n", dlerror());
-                exit(1);
-            }
+    void loadLib(string *lib) {
+        auto path = linkLibPath(lib);
 
-            vector_append(libs, libhandle);
+        void *libhandle = dlopen(path, RTLD_LAZY);
+        if (!libhandle) {
+            fprintf(stderr, "dlopen error: %s\n", dlerror());
+            exit(1);
         }
+
+        vector_append(libs, libhandle);
     }
 
     void step();
@@ -350,6 +379,10 @@ public:
             case Instruction::I64: {
                 return readFromStack<int64_t>(consume<int64_t>() + bp) - (int64_t) stack_base;
             }
+            case Instruction::RODATAI64: {
+                // relative to stack_base like any other pointer
+                return static_cast<T>((int64_t) &instructions[consume<int64_t>()] - (int64_t) stack_base);
+            }
             default: {
                 cpi_assert(false && "unrecognized inst for read<T>");
             }
@@ -0,0 +1,138 @@
+#include "jit.h"
+#include "interpreter.h"
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/Support/DynamicLibrary.h"
+
+struct JitLayers {
+    unique_ptr<llvm::TargetMachine> targetMachine;
+    llvm::DataLayout dataLayout;
+
+    llvm::orc::RTDyldObjectLinkingLayer objectLayer;
+    llvm::orc::IRCompileLayer<llvm::orc::RTDyldObjectLinkingLayer, llvm::orc::SimpleCompiler> compileLayer;
+
+    JitLayers() : targetMachine(llvm::EngineBuilder().selectTarget()),
+                  dataLayout(targetMachine->createDataLayout()),
+                  objectLayer([]() { return std::make_shared<llvm::SectionMemoryManager>(); }),
+                  compileLayer(objectLayer, llvm::orc::SimpleCompiler(*targetMachine)) {}
+};
+
+Jit::Jit() {
+    initializeLlvmTargets();
+    layers = new JitLayers();
+}
+
+void *Jit::add(LlvmGen *llvmGen, llvm::Function *fn) {
+    auto &compileLayer = layers->compileLayer;
+
+    auto resolver = llvm::orc::createLambdaResolver(
+            [&compileLayer](const std::string &name) {
+                if (auto symbol = compileLayer.findSymbol(name, false)) { return symbol; }
+                return llvm::JITSymbol(nullptr);
+            },
+            [](const std::string &name) {
+                if (auto address = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name)) {
+                    return llvm::JITSymbol(address, llvm::JITSymbolFlags::Exported);
+                }
+                return llvm::JITSymbol(nullptr);
+            });
+
+    // symbols are looked up by their object file name, which has a leading '_' on macos
+    string mangledName;
+    llvm::raw_string_ostream mangledStream(mangledName);
+    llvm::Mangler::getNameWithPrefix(mangledStream, fn->getName(), layers->dataLayout);
+    mangledStream.flush();
+
+    std::shared_ptr<llvm::Module> module = std::move(llvmGen->module);
+    auto handle = compileLayer.addModule(module, std::move(resolver));
+    if (!handle) {
+        llvm::logAllUnhandledErrors(handle.takeError(), llvm::errs(), "could not jit the module: ");
+        return nullptr;
+    }
+
+    auto symbol = compileLayer.findSymbol(mangledName, true);
+    if (!symbol) {
+        llvm::logAllUnhandledErrors(symbol.takeError(), llvm::errs(), "could not find " + mangledName + ": ");
+        return nullptr;
+    }
+
+    // linking and relocating happen here, on first lookup
+    auto address = symbol.getAddress();
+    if (!address) {
+        llvm::logAllUnhandledErrors(address.takeError(), llvm::errs(), "could not link the jitted module: ");
+        return nullptr;
+    }
+
+    return (void *) *address;
+}
+
+bool loadJitLibs(vector_t<string *> &linkLibs) {
+    // libc and the rest of this process first
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+    for (auto lib : linkLibs) {
+        auto path = linkLibPath(lib);
+
+        string error;
+        if (path == nullptr || llvm::sys::DynamicLibrary::LoadLibraryPermanently(path, &error)) {
+            llvm::errs() << "could not load " << *lib << " " << error << "\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const char *jitEntryName = "__cpi_jit_main";
+
+// main returns whatever its declared type lowers to, which C++ can't name.
+// so the module gets a void(i8 *) entry which calls main and stores the return value through its argument
+llvm::Function *addJitEntry(LlvmGen *llvmGen, llvm::Function *main) {
+    auto &builder = llvmGen->builder;
+
+    auto entryType = llvm::FunctionType::get(builder.getVoidTy(), {builder.getInt8PtrTy()}, false);
+    auto entry = llvm::Function::Create(entryType, llvm::Function::ExternalLinkage, jitEntryName, llvmGen->module.get());
+
+    builder.SetInsertPoint(llvm::BasicBlock::Create(llvmGen->context, "entry", entry));
+
+    auto returned = builder.CreateCall(main, {});
+    auto resultPtr = builder.CreateBitCast(&*entry->arg_begin(), returned->getType()->getPointerTo(0));
+    builder.CreateStore(returned, resultPtr);
+    builder.CreateRetVoid();
+
+    return entry;
+}
+
+bool runJit(LlvmGen *llvmGen, Node *mainFn, vector_t<string *> &linkLibs, int nTimes, vector<unsigned char> *result) {
+    if (!loadJitLibs(linkLibs)) { return false; }
+
+    llvmGen->gen(mainFn);
+
+    auto main = (llvm::Function *) llvmGen->llvmData(mainFn);
+    cpi_assert(main != nullptr);
+
+    uint64_t returnSize = llvmGen->module->getDataLayout().getTypeAllocSize(main->getReturnType());
+    auto entryFn = addJitEntry(llvmGen, main);
+
+    llvmGen->finalize();
+
+    Jit jit;
+    auto entry = (void (*)(unsigned char *)) jit.add(llvmGen, entryFn);
+    if (entry == nullptr) { return false; }
+
+    // at least 8 bytes, so a main returning nothing still reads back as (other) 0
+    result->assign(max(returnSize, (uint64_t) 8), 0);
+    for (int i = 0; i < nTimes; i++) {
+        entry(result->data());
+    }
+
+    return true;
+}
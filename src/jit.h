@@ -0,0 +1,28 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "llvmgen.h"
+
+struct JitLayers;
+
+// orc, compiling modules into this process. everything it compiled stays alive as long as it does.
+// undefined symbols resolve against the other modules added to it, then this process and whatever loadJitLibs loaded
+class Jit {
+public:
+    Jit();
+
+    // compiles llvmGen's module (taking it over) and returns the address of fn in it, or nullptr if that fails
+    void *add(LlvmGen *llvmGen, llvm::Function *fn);
+
+private:
+    JitLayers *layers;
+};
+
+// make the #link libraries' symbols visible to jitted code
+bool loadJitLibs(vector_t<string *> &linkLibs);
+
+// --jit: lower the program with llvmGen, compile it into this process and call main directly.
+// main is run nTimes, and result ends up holding the bytes of its (last) return value
+bool runJit(LlvmGen *llvmGen, Node *mainFn, vector_t<string *> &linkLibs, int nTimes, vector<unsigned char> *result);
+
+#endif // JIT_H
@@ -36,6 +36,7 @@ bool isSpecial(char c) {
 
 Lexer::Lexer(SourceInfo srcInfo, Node *node) {
     this->srcInfo = srcInfo;
+    this->source = sourceFileFor(srcInfo)->source;
     this->lastLoc = node->region.start;
     this->loc = node->region.start;
     this->popFront();
@@ -43,11 +44,8 @@ Lexer::Lexer(SourceInfo srcInfo, Node *node) {
 }
 
 Lexer::Lexer(string *fileName, string *fileSrc) {
-    auto lines = vector_init<unsigned long>(1);
-    vector_append(lines, (unsigned long) 0);
-
     if (fileName != nullptr && fileSrc != nullptr) {
-        srcInfo = {fileName, fileSrc, lines};
+        source = fileSrc;
     }
     else if (fileName != nullptr) {
         ifstream t(*fileName);
@@ -60,15 +58,17 @@ Lexer::Lexer(string *fileName, string *fileSrc) {
         fileBytes.assign((istreambuf_iterator<char>(t)),
                          istreambuf_iterator<char>());
 
-        srcInfo = {fileName, new string(fileBytes), lines};
+        source = new string(fileBytes);
     }
     else if (fileSrc != nullptr) {
-        srcInfo = {nullptr, fileSrc};
+        source = fileSrc;
     }
     else { cpi_assert(false); }
 
-    lastLoc = {0, 1, 1};
-    loc = {0, 1, 1};
+    srcInfo = addSourceFile(fileName, source);
+
+    lastLoc = {0};
+    loc = {0};
 
     popFront();
     popFront();
@@ -111,14 +111,14 @@ void Lexer::popFront() {
     LexerToken next;
 
     // ignore whitespace
-    while (loc.byteIndex < srcInfo.source->length() && isspace(srcInfo.source->at(loc.byteIndex))) {
+    while (loc.byteIndex < source->length() && isspace(source->at(loc.byteIndex))) {
         eat();
     }
 
     // Comment
     if (prefix("--")) {
         // eat until newline
-        while (srcInfo.source->at(loc.byteIndex) != '\n') {
+        while (source->at(loc.byteIndex) != '\n') {
             eat();
         }
 
@@ -128,12 +128,12 @@ void Lexer::popFront() {
     }
 
     // ignore whitespace
-    while (loc.byteIndex < srcInfo.source->length() && isspace(srcInfo.source->at(loc.byteIndex))) {
+    while (loc.byteIndex < source->length() && isspace(source->at(loc.byteIndex))) {
         eat();
     }
 
     // look for EOF
-    if (loc.byteIndex >= srcInfo.source->length()) {
+    if (loc.byteIndex >= source->length()) {
         next.type = LexerTokenType::EOF_;
         popFrontFinalize(next);
         return;
@@ -233,18 +233,18 @@ void Lexer::popFront() {
     if (tryEatKeyword(&next, "#for", LexerTokenType::STATIC_FOR)) { return; }
 
     // BACK_TICK
-    if (srcInfo.source->at(loc.byteIndex) == '`') {
+    if (source->at(loc.byteIndex) == '`') {
         next.type = LexerTokenType::SYMBOL;
         auto saved_loc = loc;
 
         eat(); // eat first back tick
         this->lastLoc = loc;
 
-        while (loc.byteIndex < srcInfo.source->length() && srcInfo.source->at(loc.byteIndex) != '`') {
+        while (loc.byteIndex < source->length() && source->at(loc.byteIndex) != '`') {
             eat();
         }
 
-        if (loc.byteIndex >= srcInfo.source->length()) {
+        if (loc.byteIndex >= source->length()) {
             Note note = {{srcInfo, saved_loc, saved_loc}, "Leading ` here"};
 
             reportError({{srcInfo, loc, loc},
@@ -260,16 +260,16 @@ void Lexer::popFront() {
     }
 
     // SINGLE_QUOTE
-    if (srcInfo.source->at(loc.byteIndex) == '\'') {
+    if (source->at(loc.byteIndex) == '\'') {
         next.type = LexerTokenType::SINGLE_QUOTE;
         auto savedLoc = loc;
 
         eat(); // eat first single quote
-        while (loc.byteIndex < srcInfo.source->length() && srcInfo.source->at(loc.byteIndex) != '\'') {
+        while (loc.byteIndex < source->length() && source->at(loc.byteIndex) != '\'') {
             eat();
         }
 
-        if (loc.byteIndex >= srcInfo.source->length()) {
+        if (loc.byteIndex >= source->length()) {
             Note note = {{srcInfo, savedLoc, savedLoc}, "Leading ' here"};
             Error error = {{srcInfo, lastLoc, loc},
                            "reached EOF without closing '",
@@ -284,17 +284,17 @@ void Lexer::popFront() {
     }
 
     // DOUBLE_QUOTE
-    if (srcInfo.source->at(loc.byteIndex) == '"') {
+    if (source->at(loc.byteIndex) == '"') {
         next.type = LexerTokenType::DOUBLE_QUOTE;
         auto savedLoc = loc;
 
         eat(); // eat first double quote
-        while (loc.byteIndex < srcInfo.source->length()) {
-            if (srcInfo.source->at(loc.byteIndex) == '\\') {
+        while (loc.byteIndex < source->length()) {
+            if (source->at(loc.byteIndex) == '\\') {
                 // eat the next 2 tokens
                 eat();
 
-                if (loc.byteIndex >= srcInfo.source->length()) {
+                if (loc.byteIndex >= source->length()) {
                     Note note = {{srcInfo, savedLoc, savedLoc}, "String started here"};
                     Error error = {{srcInfo, loc, loc},
                                    "reached EOF after an escape character while parsing a string. WTF are you even doing??",
@@ -306,14 +306,14 @@ void Lexer::popFront() {
                 continue;
             }
 
-            if (srcInfo.source->at(loc.byteIndex) == '"') {
+            if (source->at(loc.byteIndex) == '"') {
                 break;
             }
 
             eat();
         }
 
-        if (loc.byteIndex >= srcInfo.source->length()) {
+        if (loc.byteIndex >= source->length()) {
             Note note = {{srcInfo, loc, loc}, "Leading \" here"};
             Error error = {{srcInfo, savedLoc, loc},
                            "reached EOF without closing '\"'",
@@ -331,12 +331,12 @@ void Lexer::popFront() {
     auto parsingInt = false;
     auto parsingHex = false;
     auto parsingBin = false;
-    if (srcInfo.source->at(loc.byteIndex) == '0' && srcInfo.source->length() > loc.byteIndex + 1) {
-        if (srcInfo.source->at(loc.byteIndex + 1) == 'x') {
+    if (source->at(loc.byteIndex) == '0' && source->length() > loc.byteIndex + 1) {
+        if (source->at(loc.byteIndex + 1) == 'x') {
             parsingHex = true;
             eat(2); // 0x
         }
-        else if (srcInfo.source->at(loc.byteIndex + 1) == 'b') {
+        else if (source->at(loc.byteIndex + 1) == 'b') {
             parsingBin = true;
             eat(2); // 0b
         }
@@ -344,21 +344,21 @@ void Lexer::popFront() {
             parsingInt = true;
         }
     }
-    else if (isdigit(srcInfo.source->at(loc.byteIndex))) {
+    else if (isdigit(source->at(loc.byteIndex))) {
         parsingInt = true;
     }
     if (parsingInt || parsingHex || parsingBin) {
         next.type = LexerTokenType::INT_LITERAL;
-        while (isNumericDigit(srcInfo.source->at(loc.byteIndex), parsingHex, parsingBin)) {
+        while (isNumericDigit(source->at(loc.byteIndex), parsingHex, parsingBin)) {
             eat();
 
-            if (loc.byteIndex >= srcInfo.source->size()) {
+            if (loc.byteIndex >= source->size()) {
                 popFrontFinalize(0, next);
                 return;
             }
         }
 
-        if (srcInfo.source->at(loc.byteIndex) == '.') {
+        if (source->at(loc.byteIndex) == '.') {
             if (parsingBin || parsingHex) {
                 reportError(Error{{this->srcInfo, lastLoc, loc}, "decimals not allowed when parsing binary/hex literal"});
                 return;
@@ -366,7 +366,7 @@ void Lexer::popFront() {
 
             next.type = LexerTokenType::FLOAT_LITERAL;
             eat();
-            while (isdigit(srcInfo.source->at(loc.byteIndex)) || srcInfo.source->at(loc.byteIndex) == '_') {
+            while (isdigit(source->at(loc.byteIndex)) || source->at(loc.byteIndex) == '_') {
                 eat();
             }
         }
@@ -377,7 +377,7 @@ void Lexer::popFront() {
 
     // SYMBOL
     next.type = LexerTokenType::SYMBOL;
-    while (loc.byteIndex < srcInfo.source->length() && !isSpecial(srcInfo.source->at(loc.byteIndex))) {
+    while (loc.byteIndex < source->length() && !isSpecial(source->at(loc.byteIndex))) {
         eat();
     }
     popFrontFinalize(0, next);
@@ -390,18 +390,10 @@ void Lexer::eat(int eatLength) {
 }
 
 void Lexer::eat() {
-    auto frontChar = srcInfo.source->at(loc.byteIndex);
+    auto frontChar = source->at(loc.byteIndex);
 
     if (frontChar == '\n') {
         totalLines += 1;
-
-        loc.line += 1;
-        loc.col = 1;
-
-        unsigned long byteIndex = loc.byteIndex + 1;
-        vector_append(srcInfo.lines, byteIndex);
-    } else {
-        loc.col += 1;
     }
 
     loc.byteIndex += bytesInCodepoint(frontChar);
@@ -415,24 +407,19 @@ void Lexer::popFrontFinalize(int eatLength, LexerToken newNext) {
 void Lexer::popFrontFinalize(LexerToken newNext) {
     newNext.region.srcInfo = srcInfo;
 
-    newNext.region.start.byteIndex = lastLoc.byteIndex;
-    newNext.region.start.line = lastLoc.line;
-    newNext.region.start.col = lastLoc.col;
-
-    newNext.region.end.byteIndex = loc.byteIndex;
-    newNext.region.end.line = loc.line;
-    newNext.region.end.col = loc.col;
+    newNext.region.start = lastLoc;
+    newNext.region.end = loc;
 
     next = newNext;
 }
 
 bool Lexer::prefix(string pre) {
-    if (srcInfo.source->length() - loc.byteIndex < pre.length()) {
+    if (source->length() - loc.byteIndex < pre.length()) {
         return 0;
     }
 
     for (unsigned long i = 0; i < pre.length(); i++) {
-        if (srcInfo.source->at(loc.byteIndex + i) != pre[i]) {
+        if (source->at(loc.byteIndex + i) != pre[i]) {
             return 0;
         }
     }
@@ -441,12 +428,12 @@ bool Lexer::prefix(string pre) {
 }
 
 bool Lexer::prefixKeyword(string pre) {
-    if (srcInfo.source->length() - loc.byteIndex < pre.length() + 1) {
+    if (source->length() - loc.byteIndex < pre.length() + 1) {
         return 0;
     }
 
     // if we have a match but there are more non-special characters, then it's not a match
-    return prefix(pre) && isSpecial(srcInfo.source->at(loc.byteIndex + pre.length()));
+    return prefix(pre) && isSpecial(source->at(loc.byteIndex + pre.length()));
 }
 
 void Lexer::reportError(Error error) {
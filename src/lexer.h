@@ -19,6 +19,7 @@ public:
     Location loc = {};
 
     SourceInfo srcInfo = {};
+    string *source = nullptr;
 
     const static vector<string> lexerTokenTypeStrings;
 
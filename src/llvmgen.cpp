@@ -1,14 +1,42 @@
 #include "llvmgen.h"
 #include "util.h"
 #include "node.h"
-
+#include "threadpool.h"
+#include "interpreter.h"
+#include "profile.h"
+
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include "llvm/Support/raw_ostream.h"
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
 #include <sstream>
+#include <sys/wait.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+extern char **environ;
 
 void debugValue(void *val) {
     ((llvm::Value *) val)->print(llvm::errs());
@@ -35,45 +63,127 @@ bool needsStorage(Node *node) {
 }
 
 void LlvmGen::storeIfNeeded(Node *node) {
-    if (needsStorage(node) && node->llvmData && node->llvmLocal) {
-        store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+    if (needsStorage(node) && llvmData(node) && llvmLocal(node)) {
+        store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
+    }
+}
+
+// every temporary goes with the locals at the top of the fn, so a call in a loop doesn't grow the stack on each
+// iteration, and mem2reg/sroa (which only look at entry block allocas) can get rid of it
+llvm::AllocaInst *LlvmGen::entryAlloca(llvm::Type *type, const string &name) {
+    auto &entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+
+    auto insertPoint = entry.begin();
+    while (insertPoint != entry.end() && llvm::isa<llvm::AllocaInst>(*insertPoint)) {
+        ++insertPoint;
+    }
+
+    llvm::IRBuilder<> entryBuilder(&entry, insertPoint);
+    return entryBuilder.CreateAlloca(type, nullptr, name);
+}
+
+// nullptr if there's no profile, or the if/while never made it into one
+llvm::MDNode *LlvmGen::branchWeightsFor(Node *node) {
+    if (profile == nullptr) { return nullptr; }
+
+    auto counts = hash_get(profile->branches, profileKey(node));
+    if (counts == nullptr) { return nullptr; }
+
+    // weights are 32 bits. like clang, +1 so a side that was never taken is unlikely rather than impossible
+    auto scale = max(counts->taken, counts->notTaken) / (UINT32_MAX - 1) + 1;
+    return llvm::MDBuilder(context).createBranchWeights((uint32_t) (counts->taken / scale + 1),
+                                                        (uint32_t) (counts->notTaken / scale + 1));
+}
+
+// llvm 6 has no hot attribute, so a fn that got at least 1% of the calls the busiest one did gets an inline hint.
+// one that was never called is cold, which keeps it out of line and optimizes its callers' paths around it
+void LlvmGen::applyProfile(Node *fn, llvm::Function *F) {
+    if (profile == nullptr) { return; }
+
+    auto calls = hash_get(profile->calls, profileKey(fn));
+    if (calls == nullptr) { return; }
+
+    F->setEntryCount(*calls);
+
+    if (*calls == 0) {
+        F->addFnAttr(llvm::Attribute::Cold);
+    } else if (*calls * 100 >= profile->maxCalls) {
+        F->addFnAttr(llvm::Attribute::InlineHint);
+    }
+}
+
+void *&LlvmGen::llvmLocal(Node *node) {
+    if (node->id >= nodeData.size()) {
+        nodeData.resize(nodeId);
+    }
+    return nodeData[node->id].local;
+}
+
+void *&LlvmGen::llvmData(Node *node) {
+    if (node->id >= nodeData.size()) {
+        nodeData.resize(nodeId);
     }
+    return nodeData[node->id].data;
 }
 
-LlvmGen::LlvmGen(const char *fileName) : builder(context), module(llvm::make_unique<llvm::Module>("module", context)) {
+void initializeLlvmTargets() {
+    static bool initialized = false;
+    if (initialized) { return; }
+    initialized = true;
+
     llvm::InitializeAllTargetInfos();
     llvm::InitializeAllTargets();
     llvm::InitializeAllTargetMCs();
     llvm::InitializeAllAsmParsers();
     llvm::InitializeAllAsmPrinters();
+}
+
+llvm::CodeGenOpt::Level codeGenOptLevel(unsigned int optLevel) {
+    switch (optLevel) {
+        case 0: return llvm::CodeGenOpt::None;
+        case 1: return llvm::CodeGenOpt::Less;
+        case 2: return llvm::CodeGenOpt::Default;
+        default: return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+LlvmGen::LlvmGen(const char *fileName, unsigned int optLevel, const string &cpu) : builder(context), module(llvm::make_unique<llvm::Module>("module", context)), optLevel(optLevel) {
+    // semantic is done by the time we get here, so every node we will ever see already has an id.
+    // sizing up front keeps references from llvmLocal/llvmData stable across the whole gen
+    nodeData.resize(nodeId);
+
+    initializeLlvmTargets();
 
 //    voidTy = builder.getVoidTy();
     voidTy = llvm::StructType::get(context, {});
 
-    auto CPU = "generic";
-    auto Features = "";
+    targetCpu = "generic";
+    targetFeatures = "";
+    if (cpu == "native") {
+        targetCpu = llvm::sys::getHostCPUName().str();
 
-    llvm::TargetOptions opt;
-    auto RM = llvm::Optional<llvm::Reloc::Model>();
-    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
+        llvm::StringMap<bool> hostFeatures;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+            llvm::SubtargetFeatures features;
+            for (auto &feature : hostFeatures) {
+                features.AddFeature(feature.first(), feature.second);
+            }
+            targetFeatures = features.getString();
+        }
+    }
+    else if (!cpu.empty()) {
+        targetCpu = cpu;
+    }
 
-    module->setTargetTriple(TargetTriple);
+    module->setTargetTriple(llvm::sys::getDefaultTargetTriple());
     module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 2);
 
-    std::string Error;
-    auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
-    targetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
+    targetMachine = createTargetMachine();
     module->setDataLayout(targetMachine->createDataLayout());
 
     TheFPM = llvm::make_unique<llvm::legacy::FunctionPassManager>(module.get());
-
-    TheFPM->add(llvm::createInstructionCombiningPass());
-    TheFPM->add(llvm::createReassociatePass());
-    TheFPM->add(llvm::createGVNPass());
-    TheFPM->add(llvm::createCFGSimplificationPass());
-    TheFPM->add(llvm::createPromoteMemoryToRegisterPass());
-
-    TheFPM->doInitialization();
+    TheMPM = llvm::make_unique<llvm::legacy::PassManager>();
+    addOptimizationPasses(targetMachine, *TheFPM, *TheMPM);
 
     llvm::FunctionType *panicType = llvm::FunctionType::get(voidTy, { builder.getInt8Ty()->getPointerTo() }, false);
     panicFunc = module->getOrInsertFunction("panic", panicType);
@@ -96,13 +206,445 @@ LlvmGen::LlvmGen(const char *fileName) : builder(context), module(llvm::make_uni
     auto fileBasePath = fullPathString.substr(0, (unsigned long) lastSepPos);
 }
 
+llvm::TargetMachine *LlvmGen::createTargetMachine() {
+    llvm::TargetOptions opt;
+    auto RM = llvm::Optional<llvm::Reloc::Model>();
+    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
+
+    std::string Error;
+    auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
+    return Target->createTargetMachine(TargetTriple, targetCpu, targetFeatures, opt, RM, llvm::None, codeGenOptLevel(optLevel));
+}
+
+void LlvmGen::addOptimizationPasses(llvm::TargetMachine *machine, llvm::legacy::FunctionPassManager &fpm,
+                                    llvm::legacy::PassManager &mpm) {
+    if (optLevel == 0) { return; }
+
+    fpm.add(llvm::createTargetTransformInfoWrapperPass(machine->getTargetIRAnalysis()));
+    mpm.add(llvm::createTargetTransformInfoWrapperPass(machine->getTargetIRAnalysis()));
+
+    // every local starts out as an alloca, so get them into registers before anything else looks at the fn
+    fpm.add(llvm::createPromoteMemoryToRegisterPass());
+
+    llvm::PassManagerBuilder passBuilder;
+    passBuilder.OptLevel = optLevel;
+    passBuilder.SizeLevel = 0;
+    passBuilder.Inliner = optLevel > 1
+                          ? llvm::createFunctionInliningPass(optLevel, 0, false)
+                          : llvm::createAlwaysInlinerLegacyPass();
+    passBuilder.LoopVectorize = optLevel > 1;
+    passBuilder.SLPVectorize = optLevel > 1;
+
+    machine->adjustPassManager(passBuilder);
+
+    passBuilder.populateFunctionPassManager(fpm);
+    passBuilder.populateModulePassManager(mpm);
+
+    // internal fns nobody calls anymore: inlined everywhere, or polymorph instantiations main never reaches
+    mpm.add(llvm::createGlobalDCEPass());
+}
+
+void LlvmGen::optimize(llvm::Module &target, llvm::legacy::FunctionPassManager &fpm, llvm::legacy::PassManager &mpm) {
+    if (optLevel == 0) { return; }
+
+    // per fn first (mem2reg and cleanup), then the module pipeline: inlining, loops, vectorization
+    fpm.doInitialization();
+    for (auto &fn : target) {
+        if (!fn.isDeclaration()) {
+            fpm.run(fn);
+        }
+    }
+    fpm.doFinalization();
+
+    markTinyFnsAlwaysInline(target);
+
+    mpm.run(target);
+}
+
 void LlvmGen::finalize() {
     verifyModule(*module, &llvm::errs());
+    optimize(*module, *TheFPM, *TheMPM);
+}
+
+// after mem2reg, so allocas and the loads/stores around them don't count against a fn.
+// small enough that inlining never costs more than the call did (range accessors, buffer getters and the like)
+const unsigned int tinyFnInstructionLimit = 12;
+
+void LlvmGen::markTinyFnsAlwaysInline(llvm::Module &target) {
+    for (auto &fn : target) {
+        if (fn.isDeclaration() || !fn.hasInternalLinkage() || fn.hasFnAttribute(llvm::Attribute::NoInline)) { continue; }
+
+        auto instructionCount = 0u;
+        auto callsItself = false;
+        for (auto &bb : fn) {
+            for (auto &inst : bb) {
+                if (llvm::isa<llvm::DbgInfoIntrinsic>(inst) || llvm::isa<llvm::AllocaInst>(inst)) { continue; }
+
+                if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+                    if (call->getCalledFunction() == &fn) { callsItself = true; }
+                }
+
+                instructionCount += 1;
+            }
+        }
+
+        if (!callsItself && instructionCount <= tinyFnInstructionLimit) {
+            fn.addFnAttr(llvm::Attribute::AlwaysInline);
+        }
+    }
+}
+
+bool emitObjectWith(llvm::TargetMachine *machine, llvm::Module &target, llvm::SmallVectorImpl<char> &object) {
+    llvm::raw_svector_ostream dest(object);
+
+    llvm::legacy::PassManager pass;
+    if (machine->addPassesToEmitFile(pass, dest, llvm::TargetMachine::CGFT_ObjectFile)) {
+        llvm::errs() << "the target machine can't emit an object file\n";
+        return false;
+    }
 
-    // DO_OPTIMIZE
-    for (auto fn : allFns) {
-        TheFPM->run(*fn);
+    pass.run(target);
+    return true;
+}
+
+bool LlvmGen::emitObject(llvm::SmallVectorImpl<char> &object) {
+    return emitObjectWith(targetMachine, *module, object);
+}
+
+// reads or writes a global that isn't constant, so a copy of it would see different state than the lib does
+bool usesMutableGlobal(llvm::User *user) {
+    for (auto &operand : user->operands()) {
+        if (auto global = llvm::dyn_cast<llvm::GlobalVariable>(operand)) {
+            if (!global->isConstant()) { return true; }
+        }
+        else if (auto expr = llvm::dyn_cast<llvm::ConstantExpr>(operand)) {
+            if (usesMutableGlobal(expr)) { return true; }
+        }
     }
+    return false;
+}
+
+bool LlvmGen::importLinkBitcode(vector_t<string *> &linkLibs) {
+    auto definedBefore = hash_init<llvm::GlobalValue *, bool>((int32_t) module->size() + 256);
+    for (auto &value : module->global_values()) {
+        if (!value.isDeclaration()) {
+            hash_insert(definedBefore, &value, true);
+        }
+    }
+
+    for (auto lib : linkLibs) {
+        auto path = linkLibPath(lib, ".bc");
+        if (path == nullptr) { continue; }
+
+        auto buffer = llvm::MemoryBuffer::getFile(path);
+        if (!buffer) {
+            llvm::errs() << "could not read " << path << "\n";
+            return false;
+        }
+
+        auto parsed = llvm::parseBitcodeFile((*buffer)->getMemBufferRef(), context);
+        if (!parsed) {
+            llvm::logAllUnhandledErrors(parsed.takeError(), llvm::errs(), string(path) + ": ");
+            return false;
+        }
+
+        auto libModule = move(*parsed);
+        libModule->setTargetTriple(module->getTargetTriple());
+        libModule->setDataLayout(module->getDataLayout());
+
+        // only the definitions the program's extern decls need, and whatever those need in turn
+        if (llvm::Linker::linkModules(*module, move(libModule), llvm::Linker::Flags::LinkOnlyNeeded)) {
+            llvm::errs() << "could not link " << path << " into the program\n";
+            return false;
+        }
+    }
+
+    vector<llvm::Function *> imported;
+    for (auto &fn : *module) {
+        if (!fn.isDeclaration() && hash_get(definedBefore, (llvm::GlobalValue *) &fn) == nullptr) {
+            imported.push_back(&fn);
+        }
+    }
+
+    // a fn is only safe to copy if everything it calls into from the lib is too
+    auto unsafe = hash_init<llvm::Function *, bool>((int32_t) imported.size() + 64);
+    auto changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto fn : imported) {
+            if (hash_get(unsafe, fn) != nullptr) { continue; }
+
+            auto isUnsafe = false;
+            for (auto &bb : *fn) {
+                for (auto &inst : bb) {
+                    if (usesMutableGlobal(&inst)) { isUnsafe = true; }
+
+                    for (auto &operand : inst.operands()) {
+                        auto callee = llvm::dyn_cast<llvm::Function>(operand);
+                        if (callee != nullptr && hash_get(unsafe, callee) != nullptr) { isUnsafe = true; }
+                    }
+                }
+            }
+
+            if (isUnsafe) {
+                hash_insert(unsafe, fn, true);
+                changed = true;
+            }
+        }
+    }
+
+    // calls go to the lib like they did before. only what the lib exports can be called there though, a lib's
+    // static helpers have no symbol to link against and stay defined here for as long as anything still uses them
+    vector<llvm::Function *> localUnsafe;
+    for (auto fn : imported) {
+        if (hash_get(unsafe, fn) == nullptr) { continue; }
+
+        if (fn->hasLocalLinkage()) {
+            localUnsafe.push_back(fn);
+        }
+        else {
+            fn->deleteBody();
+        }
+    }
+
+    // the helpers nothing uses anymore, other than each other
+    auto unused = hash_init<llvm::Function *, bool>((int32_t) localUnsafe.size() + 16);
+    for (auto fn : localUnsafe) {
+        hash_insert(unused, fn, true);
+    }
+    changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto fn : localUnsafe) {
+            if (hash_get(unused, fn) == nullptr) { continue; }
+
+            for (auto user : fn->users()) {
+                auto inst = llvm::dyn_cast<llvm::Instruction>(user);
+                if (inst == nullptr || hash_get(unused, inst->getFunction()) == nullptr) {
+                    hash_erase(unused, fn);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    for (auto fn : localUnsafe) {
+        if (hash_get(unused, fn) != nullptr) { fn->dropAllReferences(); }
+    }
+    for (auto fn : localUnsafe) {
+        if (hash_get(unused, fn) != nullptr) { fn->eraseFromParent(); }
+    }
+
+    for (auto fn : imported) {
+        if (hash_get(unsafe, fn) != nullptr) { continue; }
+
+        // the lib keeps its own copy, this one is only for the program's calls to inline
+        fn->setLinkage(llvm::GlobalValue::InternalLinkage);
+        fn->setVisibility(llvm::GlobalValue::DefaultVisibility);
+
+        // compiled into this program, so with its target settings rather than whatever clang was given
+        fn->addFnAttr("target-cpu", targetCpu);
+        if (targetFeatures.empty()) {
+            fn->removeFnAttr("target-features");
+        }
+        else {
+            fn->addFnAttr("target-features", targetFeatures);
+        }
+
+        // clang -O0 marks everything optnone/noinline, which would leave nothing to gain
+        if (fn->hasFnAttribute(llvm::Attribute::OptimizeNone)) {
+            fn->removeFnAttr(llvm::Attribute::OptimizeNone);
+            fn->removeFnAttr(llvm::Attribute::NoInline);
+        }
+    }
+
+    // whatever mutable globals came along with the unsafe fns belong to the lib
+    vector<llvm::GlobalVariable *> importedGlobals;
+    for (auto &global : module->globals()) {
+        if (!global.isDeclaration() && !global.isConstant()
+            && hash_get(definedBefore, (llvm::GlobalValue *) &global) == nullptr) {
+            importedGlobals.push_back(&global);
+        }
+    }
+    for (auto global : importedGlobals) {
+        if (global->use_empty()) {
+            global->eraseFromParent();
+        }
+        else if (!global->hasLocalLinkage()) {
+            global->setInitializer(nullptr);
+            global->setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    }
+
+    return true;
+}
+
+void LlvmGen::writeBitcode(llvm::raw_ostream &out) {
+    auto summary = llvm::buildModuleSummaryIndex(*module, nullptr, nullptr);
+    llvm::WriteBitcodeToFile(module.get(), out, false, &summary);
+}
+
+bool LlvmGen::emitObjects(unsigned int partitions, vector<llvm::SmallVector<char, 0>> &objects) {
+    if (partitions <= 1) {
+        finalize();
+
+        objects.resize(1);
+        return emitObject(objects[0]);
+    }
+
+    verifyModule(*module, &llvm::errs());
+
+    auto wasLocal = hash_init<string, bool>((int32_t) module->size() + 256);
+    for (auto &value : module->global_values()) {
+        if (value.hasLocalLinkage() && value.hasName()) {
+            hash_insert(wasLocal, value.getName().str(), true);
+        }
+    }
+
+    vector<unique_ptr<llvm::Module>> parts;
+    llvm::SplitModule(move(module), partitions, [&](unique_ptr<llvm::Module> part) {
+        parts.push_back(move(part));
+    });
+
+    // splitting makes everything external, so any partition can refer to what ended up in another one. whatever
+    // no other partition refers to goes back to being local, so each partition's inliner and globaldce still apply
+    auto referenced = hash_init<string, bool>((int32_t) parts.size() * 256);
+    for (auto &part : parts) {
+        for (auto &value : part->global_values()) {
+            if (value.isDeclaration()) {
+                hash_insert(referenced, value.getName().str(), true);
+            }
+        }
+    }
+    for (auto &part : parts) {
+        for (auto &value : part->global_values()) {
+            auto name = value.getName().str();
+            if (!value.isDeclaration() && hash_get(wasLocal, name) != nullptr && hash_get(referenced, name) == nullptr) {
+                value.setLinkage(llvm::GlobalValue::InternalLinkage);
+                value.setVisibility(llvm::GlobalValue::DefaultVisibility);
+            }
+        }
+    }
+
+    // a context can only be used by one thread at a time, so each partition is handed over as bitcode
+    // and read back into a context of its own
+    vector<llvm::SmallVector<char, 0>> bitcode(parts.size());
+    for (unsigned long i = 0; i < parts.size(); i++) {
+        llvm::raw_svector_ostream out(bitcode[i]);
+        llvm::WriteBitcodeToFile(parts[i].get(), out);
+    }
+    parts.clear();
+
+    objects.resize(bitcode.size());
+    atomic<bool> failed{false};
+
+    ThreadPool pool((unsigned int) bitcode.size());
+    for (unsigned long i = 0; i < bitcode.size(); i++) {
+        pool.submit([this, i, &bitcode, &objects, &failed]() {
+            llvm::LLVMContext partContext;
+
+            auto buffer = llvm::MemoryBufferRef(llvm::StringRef(bitcode[i].data(), bitcode[i].size()), "partition");
+            auto parsed = llvm::parseBitcodeFile(buffer, partContext);
+            if (!parsed) {
+                llvm::logAllUnhandledErrors(parsed.takeError(), llvm::errs(), "partition: ");
+                failed = true;
+                return;
+            }
+            auto part = move(*parsed);
+
+            // a target machine only emits one module at a time
+            auto machine = createTargetMachine();
+
+            llvm::legacy::FunctionPassManager fpm(part.get());
+            llvm::legacy::PassManager mpm;
+            addOptimizationPasses(machine, fpm, mpm);
+            optimize(*part, fpm, mpm);
+
+            if (!emitObjectWith(machine, *part, objects[i])) {
+                failed = true;
+            }
+
+            delete machine;
+        });
+    }
+    pool.wait();
+
+    return !failed;
+}
+
+// where the linker can read the object from. on linux that's an anonymous in-memory file, inherited by the driver and
+// the linker it runs. elsewhere it has to be a real file, which is kept next to the executable: on macos that's also
+// where the debug info stays, since the linker only records a debug map pointing back into the .o
+string objectPathFor(llvm::SmallVectorImpl<char> &object, const string &outputFileName, unsigned long index) {
+#ifdef __linux__
+    auto fd = memfd_create("cpi-object", 0);
+    if (fd >= 0) {
+        if (write(fd, object.data(), object.size()) == (ssize_t) object.size()) {
+            return "/dev/fd/" + to_string(fd);
+        }
+        close(fd);
+    }
+#endif
+
+    auto path = index == 0 ? outputFileName + ".o" : outputFileName + "." + to_string(index) + ".o";
+    auto fd2 = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd2 < 0) { return ""; }
+
+    auto written = write(fd2, object.data(), object.size());
+    close(fd2);
+
+    if (written != (ssize_t) object.size()) { return ""; }
+    return path;
+}
+
+bool linkExecutable(vector<llvm::SmallVector<char, 0>> &objects, const string &outputFileName,
+                    vector_t<string *> &linkLibs) {
+    vector<string> objectPaths;
+    for (unsigned long i = 0; i < objects.size(); i++) {
+        auto objectPath = objectPathFor(objects[i], outputFileName, i);
+        if (objectPath.empty()) {
+            llvm::errs() << "could not write the object for " << outputFileName << "\n";
+            return false;
+        }
+        objectPaths.push_back(objectPath);
+    }
+
+    auto driver = getenv("CC") != nullptr ? string(getenv("CC")) : string("cc");
+
+    vector<string> args = {driver, "-L", ".", "-L", "/usr/local/lib/cpi", "-L", "/usr/local/lib"};
+    for (auto link : linkLibs) {
+        auto lastSlash = link->rfind('/');
+        auto fileName = *link;
+        if (lastSlash != string::npos && lastSlash > 0) {
+            args.push_back("-L");
+            args.push_back(link->substr(0, lastSlash));
+            fileName = link->substr(lastSlash + 1);
+        }
+
+        // substr(3) to strip "lib" from the prefix
+        args.push_back("-l" + fileName.substr(3));
+    }
+    args.push_back("-o");
+    args.push_back(outputFileName);
+    args.insert(args.end(), objectPaths.begin(), objectPaths.end());
+
+    vector<char *> argv;
+    for (auto &arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, driver.c_str(), nullptr, nullptr, argv.data(), environ) != 0) {
+        llvm::errs() << "could not run the linker driver '" << driver << "'\n";
+        return false;
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
 llvm::Type *LlvmGen::typeFor(Node *node) {
@@ -161,7 +703,7 @@ llvm::Type *LlvmGen::typeFor(Node *node) {
             return underlyingTy->getPointerTo(0);
         }
         case NodeTypekind::STRUCT: {
-            if (node->llvmData) { return (llvm::Type *) node->llvmData; }
+            if (llvmData(node)) { return (llvm::Type *) llvmData(node); }
 
             if (node->typeData.structTypeData.coercedType != nullptr) {
                 return typeFor(node->typeData.structTypeData.coercedType);
@@ -204,12 +746,12 @@ llvm::Type *LlvmGen::typeFor(Node *node) {
                 return llvm::StructType::get(context, elementTypes);
             }
 
-            else if (node->llvmData) {
-                return (llvm::Type *) node->llvmData;
+            else if (llvmData(node)) {
+                return (llvm::Type *) llvmData(node);
             }
 
             auto ty = llvm::StructType::create(context);
-            node->llvmData = ty;
+            llvmData(node) = ty;
 
             vector<llvm::Type *> elementTypes;
             for (auto param : node->typeData.structTypeData.params) {
@@ -242,25 +784,29 @@ llvm::Value *LlvmGen::rvalueFor(Node *node) {
 
     if (resolved->typeInfo->typeData.kind == NodeTypekind::NONE) { return llvm::ConstantStruct::get(llvm::StructType::get(context, false), {}); }
 
-    if(resolved->isLocal && resolved->llvmLocal) {
-        return builder.CreateLoad((llvm::Value *) resolved->llvmLocal);
+    if(resolved->isLocal && llvmLocal(resolved)) {
+        return builder.CreateLoad((llvm::Value *) llvmLocal(resolved));
     }
     if (resolved->type == NodeType::DOT && resolved->dotData.lhs->isLocal) {
-        return builder.CreateLoad((llvm::Value *) resolved->llvmData);
+        return builder.CreateLoad((llvm::Value *) llvmData(resolved));
     }
 
-    return (llvm::Value *) resolved->llvmData;
+    return (llvm::Value *) llvmData(resolved);
 }
 
 void LlvmGen::gen(Node *node) {
-    if (node->llvmGen
+    if (node->id >= nodeData.size()) {
+        nodeData.resize(nodeId);
+    }
+
+    if (nodeData[node->id].generated
         && node->type != NodeType::STRING_LITERAL
         && node->type != NodeType::ARRAY_LITERAL
         && node->type != NodeType::STRUCT_LITERAL) {
         return;
     }
 
-    node->llvmGen = true;
+    nodeData[node->id].generated = true;
 
     for (auto stmt : node->preStmts) {
         gen(stmt);
@@ -283,7 +829,7 @@ void LlvmGen::gen(Node *node) {
             auto declOnly = node->fnDeclData.body.length == 0;
 
             // debug info
-            auto fnName = node->fnDeclData.name ? atomTable->backwardAtoms[node->fnDeclData.name->symbolData.atomId] : "anon";
+            auto fnName = node->fnDeclData.name ? atomTable->nameOf(node->fnDeclData.name->symbolData.atomId) : "anon";
 
             auto savedScope = currentScope;
             auto savedScopeName = currentScopeName;
@@ -298,16 +844,35 @@ void LlvmGen::gen(Node *node) {
 
             auto FT = llvm::FunctionType::get(returnType, paramTypes, false);
 
-            auto *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, fnName, module.get());
+            // the whole program is in this module, so only main and extern decls need to be visible outside it.
+            // everything else is internal, which lets llvm inline it freely and drop it once it has no callers
+            auto isMain = fnName == "main" && !node->fnDeclData.cameFromPolymorph;
+            auto linkage = isMain || node->fnDeclData.isExternal || declOnly
+                           ? llvm::Function::ExternalLinkage
+                           : llvm::Function::InternalLinkage;
+
+            // every instantiation of a polymorph shares the decl's name
+            auto symbolName = fnName;
+            if (node->fnDeclData.cameFromPolymorph) {
+                symbolName = fnName + ".poly" + to_string(node->fnDeclData.tableIndex);
+            }
+
+            auto *F = llvm::Function::Create(FT, linkage, symbolName, module.get());
 
             F->setCallingConv(llvm::CallingConv::C);
-            node->llvmData = F;
+            F->addFnAttr("target-cpu", targetCpu);
+            if (!targetFeatures.empty()) {
+                F->addFnAttr("target-features", targetFeatures);
+            }
+            llvmData(node) = F;
 
             // if it's just a declaration, then we're done
             if (declOnly) {
                 return;
             }
 
+            applyProfile(node, F);
+
             auto currentBB = builder.GetInsertBlock();
             auto currentIP = builder.GetInsertPoint();
 
@@ -349,26 +914,26 @@ void LlvmGen::gen(Node *node) {
                             cpi_assert(resolvedLocal->declData.lhs->type == NodeType::SYMBOL);
                             auto atomId = resolvedLocal->declData.lhs->symbolData.atomId;
 
-                            auto localName = atomTable->backwardAtoms[atomId];
-                            resolvedLocal->llvmLocal = builder.CreateAlloca(typeToAlloca, nullptr, localName);
+                            auto localName = atomTable->nameOf(atomId);
+                            llvmLocal(resolvedLocal) = entryAlloca(typeToAlloca, localName);
                         } else {
-                            resolvedLocal->llvmLocal = builder.CreateAlloca(typeToAlloca, nullptr, "foreach_index");
+                            llvmLocal(resolvedLocal) = entryAlloca(typeToAlloca, "foreach_index");
                         }
                     } else {
                         ostringstream oss("");
                         oss << "local" << resolvedLocal->id << "_";
 
-                        resolvedLocal->llvmLocal = builder.CreateAlloca(typeToAlloca, nullptr, oss.str());
+                        llvmLocal(resolvedLocal) = entryAlloca(typeToAlloca, oss.str());
                     }
 
-                    local->llvmLocal = resolvedLocal->llvmLocal;
+                    llvmLocal(local) = llvmLocal(resolvedLocal);
 
                     // store any param locals
                     // todo(chad): is this a hacky way to see if the local is a param?
                     for (auto param: node->fnDeclData.params) {
                         if (param == local) {
                             gen(param);
-                            store((llvm::Value *) param->llvmData, (llvm::Value *) param->llvmLocal);
+                            store((llvm::Value *) llvmData(param), (llvm::Value *) llvmLocal(param));
                         }
                     }
                 }
@@ -390,8 +955,6 @@ void LlvmGen::gen(Node *node) {
             currentScope = savedScope;
             currentScopeName = savedScopeName;
             currentFnDecl = savedFnDecl;
-
-            allFns.push_back(F);
         } break;
         case NodeType::RETURN: {
             if (node->retData.value != nullptr) {
@@ -403,7 +966,7 @@ void LlvmGen::gen(Node *node) {
                 auto realRetType = typeFor(currentFnDecl->fnDeclData.returnType);
 
                 // todo(chad): @Hack there doesn't seem to be another way to cast things...
-                auto realRet = builder.CreateAlloca(realRetType, nullptr, "realRet");
+                auto realRet = entryAlloca(realRetType, "realRet");
                 builder.CreateStore(rvalue, builder.CreateBitCast(realRet, retType->getPointerTo(0)));
 
                 builder.CreateRet(builder.CreateLoad(realRet));
@@ -416,35 +979,35 @@ void LlvmGen::gen(Node *node) {
             if (node->typeInfo->typeData.kind == NodeTypekind::FLOAT_LITERAL
                 || node->typeInfo->typeData.kind == NodeTypekind::F32
                 || node->typeInfo->typeData.kind == NodeTypekind::F64) {
-                node->llvmData = llvm::ConstantFP::get(typeFor(node->typeInfo), (float) node->intLiteralData.value);
+                llvmData(node) = llvm::ConstantFP::get(typeFor(node->typeInfo), (float) node->intLiteralData.value);
             }
             else {
-                node->llvmData = llvm::ConstantInt::get(typeFor(node->typeInfo), (uint64_t) node->intLiteralData.value);
+                llvmData(node) = llvm::ConstantInt::get(typeFor(node->typeInfo), (uint64_t) node->intLiteralData.value);
             }
 
-            if (node->isLocal && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            if (node->isLocal && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::FLOAT_LITERAL: {
-            node->llvmData = llvm::ConstantFP::get(typeFor(node->typeInfo), (float) node->floatLiteralData.value);
+            llvmData(node) = llvm::ConstantFP::get(typeFor(node->typeInfo), (float) node->floatLiteralData.value);
 
             if (node->isLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::NIL_LITERAL: {
-            node->llvmData = llvm::ConstantPointerNull::get(builder.getInt8PtrTy(0));
+            llvmData(node) = llvm::ConstantPointerNull::get(builder.getInt8PtrTy(0));
 
             if (node->isLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::BOOLEAN_LITERAL: {
-            node->llvmData = llvm::ConstantInt::get(typeFor(node->typeInfo), (uint64_t) node->boolLiteralData.value ? 1 : 0);
+            llvmData(node) = llvm::ConstantInt::get(typeFor(node->typeInfo), (uint64_t) node->boolLiteralData.value ? 1 : 0);
 
             if (node->isLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::DECL: {
@@ -452,10 +1015,10 @@ void LlvmGen::gen(Node *node) {
 
             if (node->staticValue != nullptr) {
                 gen(node->staticValue);
-                node->llvmData = node->staticValue->llvmData;
+                llvmData(node) = llvmData(node->staticValue);
             }
             else if (data.initialValue == nullptr) {
-                cpi_assert(node->llvmLocal != nullptr);
+                cpi_assert(llvmLocal(node) != nullptr);
             }
             else {
                 gen(data.initialValue);
@@ -464,7 +1027,7 @@ void LlvmGen::gen(Node *node) {
                 gen(resolvedInitialValue);
 
                 if (data.initialValue->typeInfo->typeData.kind != NodeTypekind::NONE) {
-                    store(rvalueFor(data.initialValue), (llvm::Value *) node->llvmLocal);
+                    store(rvalueFor(data.initialValue), (llvm::Value *) llvmLocal(node));
                 }
             }
         } break;
@@ -472,11 +1035,11 @@ void LlvmGen::gen(Node *node) {
             auto resolved = resolve(node);
             gen(resolved);
 
-            node->llvmData = resolved->llvmData;
-            node->llvmLocal = resolved->llvmLocal;
+            llvmData(node) = llvmData(resolved);
+            llvmLocal(node) = llvmLocal(resolved);
 
             if (node->isLocal && resolved->type != NodeType::DECL) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
 
             node->isLocal = resolved->isLocal;
@@ -493,7 +1056,7 @@ void LlvmGen::gen(Node *node) {
                 auto declParamType = typeFor(resolve(vector_at(resolve(node->fnCallData.fn)->typeInfo->typeData.fnTypeData.params, argIdx)->typeInfo));
 
                 // todo(chad): @Hack there doesn't seem to be another way to cast things...
-                auto realParam = builder.CreateAlloca(declParamType, nullptr, "realParam");
+                auto realParam = entryAlloca(declParamType, "realParam");
                 auto realParamCasted = builder.CreateBitCast(realParam, passedParamType->getPointerTo(0));
                 builder.CreateStore(rvalueFor(param->paramData.value), realParamCasted);
 
@@ -506,17 +1069,17 @@ void LlvmGen::gen(Node *node) {
             gen(resolvedFn);
 
             auto resolvedFnLlvmValue = rvalueFor(resolvedFn);
-            node->llvmData = builder.CreateCall(resolvedFnLlvmValue, args);
+            llvmData(node) = builder.CreateCall(resolvedFnLlvmValue, args);
 
             if (node->isLocal && node->typeInfo->typeData.kind != NodeTypekind::NONE) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::VALUE_PARAM: {
             gen(node->paramData.value);
 
-            node->llvmLocal = node->paramData.value->llvmLocal;
-            node->llvmData = node->paramData.value->llvmData;
+            llvmLocal(node) = llvmLocal(node->paramData.value);
+            llvmData(node) = llvmData(node->paramData.value);
             node->isLocal = node->paramData.value->isLocal;
         } break;
         case NodeType::BINOP: {
@@ -533,10 +1096,10 @@ void LlvmGen::gen(Node *node) {
                 // a and b ====> { result := false; if a { if b { result = true; } }
 
                 // initially store false
-                store(builder.getInt1(0), (llvm::Value *) node->llvmLocal);
+                store(builder.getInt1(0), (llvm::Value *) llvmLocal(node));
 
-                auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) currentFnDecl->llvmData);
-                auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) currentFnDecl->llvmData);
+                auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) llvmData(currentFnDecl));
+                auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) llvmData(currentFnDecl));
 
                 gen(node->binopData.lhs);
 
@@ -546,8 +1109,8 @@ void LlvmGen::gen(Node *node) {
 
                 // if stmts
                 {
-                    auto thenBlock2 = llvm::BasicBlock::Create(context, "then_2", (llvm::Function *) currentFnDecl->llvmData);
-                    auto mergeBlock2 = llvm::BasicBlock::Create(context, "if_cont_2", (llvm::Function *) currentFnDecl->llvmData);
+                    auto thenBlock2 = llvm::BasicBlock::Create(context, "then_2", (llvm::Function *) llvmData(currentFnDecl));
+                    auto mergeBlock2 = llvm::BasicBlock::Create(context, "if_cont_2", (llvm::Function *) llvmData(currentFnDecl));
 
                     gen(node->binopData.rhs);
 
@@ -555,7 +1118,7 @@ void LlvmGen::gen(Node *node) {
 
                     builder.SetInsertPoint(thenBlock2);
 
-                    store(builder.getInt1(1), (llvm::Value *) node->llvmLocal);
+                    store(builder.getInt1(1), (llvm::Value *) llvmLocal(node));
 
                     builder.CreateBr(mergeBlock2);
                     builder.SetInsertPoint(mergeBlock2);
@@ -568,11 +1131,11 @@ void LlvmGen::gen(Node *node) {
                 // a or b ====> { result := false; if a { result = true; } else if b { result = true; }
 
                 // initially store false
-                store(builder.getInt1(false), (llvm::Value *) node->llvmLocal);
+                store(builder.getInt1(false), (llvm::Value *) llvmLocal(node));
 
-                auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) currentFnDecl->llvmData);
-                auto elseBlock = llvm::BasicBlock::Create(context, "else", (llvm::Function *) currentFnDecl->llvmData);
-                auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) currentFnDecl->llvmData);
+                auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) llvmData(currentFnDecl));
+                auto elseBlock = llvm::BasicBlock::Create(context, "else", (llvm::Function *) llvmData(currentFnDecl));
+                auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) llvmData(currentFnDecl));
 
                 gen(node->binopData.lhs);
 
@@ -581,14 +1144,14 @@ void LlvmGen::gen(Node *node) {
                 builder.SetInsertPoint(thenBlock);
                 {
                     // set to true
-                    store(builder.getInt1(true), (llvm::Value *) node->llvmLocal);
+                    store(builder.getInt1(true), (llvm::Value *) llvmLocal(node));
                 }
                 builder.CreateBr(mergeBlock);
 
                 builder.SetInsertPoint(elseBlock);
                 {
-                    auto thenBlock2 = llvm::BasicBlock::Create(context, "then", (llvm::Function *) currentFnDecl->llvmData);
-                    auto mergeBlock2 = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) currentFnDecl->llvmData);
+                    auto thenBlock2 = llvm::BasicBlock::Create(context, "then", (llvm::Function *) llvmData(currentFnDecl));
+                    auto mergeBlock2 = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) llvmData(currentFnDecl));
 
                     gen(node->binopData.rhs);
 
@@ -598,7 +1161,7 @@ void LlvmGen::gen(Node *node) {
 
                     // if stmts
                     {
-                        store(builder.getInt1(true), (llvm::Value *) node->llvmLocal);
+                        store(builder.getInt1(true), (llvm::Value *) llvmLocal(node));
                     }
 
                     builder.CreateBr(mergeBlock2);
@@ -622,43 +1185,43 @@ void LlvmGen::gen(Node *node) {
 
                     switch (node->binopData.type) {
                         case LexerTokenType::EQ_EQ: {
-                            node->llvmData = builder.CreateICmpEQ(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateICmpEQ(lhsIntValue, rhsIntValue);
                         } break;
                         case LexerTokenType::NE: {
-                            node->llvmData = builder.CreateICmpNE(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateICmpNE(lhsIntValue, rhsIntValue);
                         } break;
                         case LexerTokenType::GT: {
-                            node->llvmData = builder.CreateICmpSGT(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateICmpSGT(lhsIntValue, rhsIntValue);
                         } break;
                         case LexerTokenType::GE: {
-                            node->llvmData = builder.CreateICmpSGE(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateICmpSGE(lhsIntValue, rhsIntValue);
                         } break;
                         case LexerTokenType::LT: {
-                            node->llvmData = builder.CreateICmpSLT(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateICmpSLT(lhsIntValue, rhsIntValue);
                         } break;
                         case LexerTokenType::LE: {
-                            node->llvmData = builder.CreateICmpSLE(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateICmpSLE(lhsIntValue, rhsIntValue);
                         } break;
                         case LexerTokenType::SUB: {
-                            node->llvmData = builder.CreateSub(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateSub(lhsIntValue, rhsIntValue);
                         } break;
                         case LexerTokenType::ADD: {
-                            node->llvmData = builder.CreateAdd(lhsIntValue, rhsIntValue);
+                            llvmData(node) = builder.CreateAdd(lhsIntValue, rhsIntValue);
                         } break;
                         default: cpi_assert(false);
                     }
 
                     if (node->isLocal) {
-                        store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                        store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
                     }
                 }
                 else if (node->binopData.lhs->typeInfo->typeData.kind == NodeTypekind::POINTER) {
                     auto value = builder.CreateGEP(lhsValue, rhsValue, "parith");
-                    store(value, (llvm::Value *) node->llvmLocal);
+                    store(value, (llvm::Value *) llvmLocal(node));
                 }
                 else if (node->binopData.rhs->typeInfo->typeData.kind == NodeTypekind::POINTER) {
                     auto value = builder.CreateGEP(rhsValue, lhsValue, "parith");
-                    store(value, (llvm::Value *) node->llvmLocal);
+                    store(value, (llvm::Value *) llvmLocal(node));
                 }
                 else {
                     llvm::Value *value = nullptr;
@@ -804,21 +1367,21 @@ void LlvmGen::gen(Node *node) {
                         }
                     }
 
-                    node->llvmData = value;
+                    llvmData(node) = value;
 
-                    if (node->isLocal && node->llvmLocal) {
-                        store(value, (llvm::Value *) node->llvmLocal);
+                    if (node->isLocal && llvmLocal(node)) {
+                        store(value, (llvm::Value *) llvmLocal(node));
                     }
                 }
             }
         } break;
         case NodeType::DECL_PARAM: {
             auto resolvedParam = vector_at(currentFnDecl->fnDeclData.params, node->paramData.index);
-            auto fn = static_cast<llvm::Function *>(currentFnDecl->llvmData);
-            node->llvmData = &fn->arg_begin()[resolvedParam->paramData.index];
+            auto fn = static_cast<llvm::Function *>(llvmData(currentFnDecl));
+            llvmData(node) = &fn->arg_begin()[resolvedParam->paramData.index];
 
-            if (node->isLocal && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            if (node->isLocal && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::ADDRESS_OF: {
@@ -828,8 +1391,8 @@ void LlvmGen::gen(Node *node) {
 
                 storeIfNeeded(resolved);
 
-                node->llvmData = resolved->llvmData;
-                node->llvmLocal = resolved->llvmData;
+                llvmData(node) = llvmData(resolved);
+                llvmLocal(node) = llvmData(resolved);
                 node->isLocal = resolved->isLocal;
             }
             else {
@@ -837,10 +1400,10 @@ void LlvmGen::gen(Node *node) {
                 gen(resolved);
 
                 storeIfNeeded(resolved);
-                node->llvmData = resolved->llvmLocal;
+                llvmData(node) = llvmLocal(resolved);
 
-                if (node->isLocal && node->llvmLocal) {
-                    store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                if (node->isLocal && llvmLocal(node)) {
+                    store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
                 }
             }
         } break;
@@ -848,10 +1411,10 @@ void LlvmGen::gen(Node *node) {
             auto resolved = node->nodeData;
             gen(resolved);
 
-            node->llvmData = builder.CreateLoad(rvalueFor(resolved));
+            llvmData(node) = builder.CreateLoad(rvalueFor(resolved));
 
-            if (node->isLocal && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            if (node->isLocal && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::ASSIGN: {
@@ -864,7 +1427,7 @@ void LlvmGen::gen(Node *node) {
             if (resolvedDecl->type == NodeType::DECL) {
                 gen(resolvedLhs);
 
-                node->llvmData = store(rvalueFor(resolvedRhs), (llvm::Value *) resolvedLhs->llvmLocal);
+                llvmData(node) = store(rvalueFor(resolvedRhs), (llvm::Value *) llvmLocal(resolvedLhs));
             } else if (resolvedDecl->type == NodeType::DEREF) {
                 // store rvalue into its slot
                 storeIfNeeded(resolvedRhs);
@@ -872,12 +1435,12 @@ void LlvmGen::gen(Node *node) {
                 auto storageTargetNode = resolve(resolvedDecl->nodeData);
                 gen(storageTargetNode);
 
-                auto storageTarget = (llvm::Value *) storageTargetNode->llvmLocal;
+                auto storageTarget = (llvm::Value *) llvmLocal(storageTargetNode);
                 if (storageTargetNode->type == NodeType::DECL_PARAM) {
-                    storageTarget = (llvm::Value *) storageTargetNode->llvmData;
-                    node->llvmData = store(rvalueFor(resolvedRhs), storageTarget);
+                    storageTarget = (llvm::Value *) llvmData(storageTargetNode);
+                    llvmData(node) = store(rvalueFor(resolvedRhs), storageTarget);
                 } else {
-                    node->llvmData = store(rvalueFor(resolvedRhs), builder.CreateLoad(storageTarget));
+                    llvmData(node) = store(rvalueFor(resolvedRhs), builder.CreateLoad(storageTarget));
                 }
             } else if (resolvedDecl->type == NodeType::DOT) {
                 // store rvalue into its slot
@@ -892,7 +1455,7 @@ void LlvmGen::gen(Node *node) {
 
                 gen(resolvedDecl->dotData.lhs);
 
-                auto gepTarget = (llvm::Value *) resolvedDecl->dotData.lhs->llvmLocal;
+                auto gepTarget = (llvm::Value *) llvmLocal(resolvedDecl->dotData.lhs);
 
                 vector<llvm::Value *> geps;
                 geps.push_back(builder.getInt32(0));
@@ -914,7 +1477,7 @@ void LlvmGen::gen(Node *node) {
                     store(rvalueFor(resolvedRhs), gep);
                 }
 
-                node->llvmData = gep;
+                llvmData(node) = gep;
             } else {
                 cpi_assert(false);
             }
@@ -923,7 +1486,7 @@ void LlvmGen::gen(Node *node) {
             if (node->resolved != nullptr) {
                 gen(resolve(node));
 
-                node->llvmData = node->resolved->llvmData;
+                llvmData(node) = llvmData(node->resolved);
                 break;
             }
 
@@ -955,10 +1518,10 @@ void LlvmGen::gen(Node *node) {
             auto resolvedLhs = resolve(node->dotData.lhs);
 
             llvm::Value *gepTarget = nullptr;
-            if (node->dotData.lhs->isLocal && node->dotData.lhs->llvmLocal) {
-                gepTarget = (llvm::Value *) resolvedLhs->llvmLocal;
+            if (node->dotData.lhs->isLocal && llvmLocal(node->dotData.lhs)) {
+                gepTarget = (llvm::Value *) llvmLocal(resolvedLhs);
             } else {
-                gepTarget = (llvm::Value *) resolvedLhs->llvmData;
+                gepTarget = (llvm::Value *) llvmData(resolvedLhs);
             }
 
             resolvedTypeInfo = resolve(resolvedLhs->typeInfo);
@@ -987,14 +1550,14 @@ void LlvmGen::gen(Node *node) {
                     }
                 }
 
-                node->llvmData = gep;
+                llvmData(node) = gep;
 
                 if (node->isLocal) {
-                    node->llvmLocal = gep;
+                    llvmLocal(node) = gep;
                 }
             } else {
                 vector<unsigned int> values = { (unsigned int) paramIndex };
-                node->llvmData = builder.CreateExtractValue(gepTarget, values);
+                llvmData(node) = builder.CreateExtractValue(gepTarget, values);
 
                 if (isSecretlyUnion && paramIndex == 1) {
                     // bitcast gepTarget to the correct thing...
@@ -1002,14 +1565,14 @@ void LlvmGen::gen(Node *node) {
                                            ? (llvm::Type *) builder.getInt8Ty()
                                            : typeFor(foundParam->typeInfo);
 
-                    auto dumbcast = builder.CreateAlloca(realType, nullptr, "dumbcast");
-                    builder.CreateStore((llvm::Value *) node->llvmData, builder.CreateBitCast(dumbcast, ((llvm::Value *) node->llvmData)->getType()->getPointerTo(0)));
+                    auto dumbcast = entryAlloca(realType, "dumbcast");
+                    builder.CreateStore((llvm::Value *) llvmData(node), builder.CreateBitCast(dumbcast, ((llvm::Value *) llvmData(node))->getType()->getPointerTo(0)));
 
-                    node->llvmLocal = dumbcast;
-                    node->llvmData = builder.CreateLoad(dumbcast);
+                    llvmLocal(node) = dumbcast;
+                    llvmData(node) = builder.CreateLoad(dumbcast);
                 }
-                else if (node->isLocal && node->llvmLocal) {
-                    store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                else if (node->isLocal && llvmLocal(node)) {
+                    store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
                 }
             }
         } break;
@@ -1017,14 +1580,14 @@ void LlvmGen::gen(Node *node) {
             // nothing to do
         } break;
         case NodeType::IF: {
-            auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) currentFnDecl->llvmData);
-            auto elseBlock = llvm::BasicBlock::Create(context, "else", (llvm::Function *) currentFnDecl->llvmData);
-            auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) currentFnDecl->llvmData);
+            auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) llvmData(currentFnDecl));
+            auto elseBlock = llvm::BasicBlock::Create(context, "else", (llvm::Function *) llvmData(currentFnDecl));
+            auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) llvmData(currentFnDecl));
 
             auto resolvedCondition = resolve(node->ifData.condition);
             gen(resolvedCondition);
 
-            builder.CreateCondBr(rvalueFor(resolvedCondition), thenBlock, elseBlock);
+            builder.CreateCondBr(rvalueFor(resolvedCondition), thenBlock, elseBlock, branchWeightsFor(node));
 
             builder.SetInsertPoint(thenBlock);
             auto didTerminate = false;
@@ -1049,15 +1612,15 @@ void LlvmGen::gen(Node *node) {
             builder.SetInsertPoint(mergeBlock);
         } break;
         case NodeType::WHILE: {
-            auto condBlock = llvm::BasicBlock::Create(context, "cond", (llvm::Function *) currentFnDecl->llvmData);
-            auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) currentFnDecl->llvmData);
-            auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) currentFnDecl->llvmData);
+            auto condBlock = llvm::BasicBlock::Create(context, "cond", (llvm::Function *) llvmData(currentFnDecl));
+            auto thenBlock = llvm::BasicBlock::Create(context, "then", (llvm::Function *) llvmData(currentFnDecl));
+            auto mergeBlock = llvm::BasicBlock::Create(context, "if_cont", (llvm::Function *) llvmData(currentFnDecl));
 
             builder.CreateBr(condBlock);
 
             builder.SetInsertPoint(condBlock);
             gen(node->whileData.condition);
-            builder.CreateCondBr(rvalueFor(node->whileData.condition), thenBlock, mergeBlock);
+            builder.CreateCondBr(rvalueFor(node->whileData.condition), thenBlock, mergeBlock, branchWeightsFor(node));
 
             builder.SetInsertPoint(thenBlock);
             auto didTerminate = false;
@@ -1097,10 +1660,10 @@ void LlvmGen::gen(Node *node) {
                 auto castedValue = builder.CreateBitCast(paramValue, blankSlateIdxType);
                 blankSlate = builder.CreateInsertValue(blankSlate, castedValue, 1);
 
-                node->llvmData = blankSlate;
+                llvmData(node) = blankSlate;
 
-                if (node->isLocal && node->llvmLocal) {
-                    store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                if (node->isLocal && llvmLocal(node)) {
+                    store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
                 }
             }
             else {
@@ -1140,21 +1703,21 @@ void LlvmGen::gen(Node *node) {
                     idx += 1;
                 }
 
-                node->llvmData = blankSlate;
+                llvmData(node) = blankSlate;
 
-                if (node->isLocal && node->llvmLocal) {
-                    store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                if (node->isLocal && llvmLocal(node)) {
+                    store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
                 }
             }
         } break;
         case NodeType::ARRAY_LITERAL: {
             gen(node->arrayLiteralData.structLiteralRepresentation);
 
-            node->llvmData = node->arrayLiteralData.structLiteralRepresentation->llvmData;
-            node->llvmLocal = node->arrayLiteralData.structLiteralRepresentation->llvmLocal;
+            llvmData(node) = llvmData(node->arrayLiteralData.structLiteralRepresentation);
+            llvmLocal(node) = llvmLocal(node->arrayLiteralData.structLiteralRepresentation);
 
-            if (node->isLocal && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            if (node->isLocal && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::CAST: {
@@ -1206,63 +1769,92 @@ void LlvmGen::gen(Node *node) {
 
                 if (isFloatType(fromType)) {
                     if (isFloatType(toType)) {
-                        node->llvmData = builder.CreateFPCast(llvmFromValue, llvmToType);
+                        llvmData(node) = builder.CreateFPCast(llvmFromValue, llvmToType);
                     }
                     else {
                         if (isUnsigned) {
-                            node->llvmData = builder.CreateFPToUI(llvmFromValue, llvmToType);
+                            llvmData(node) = builder.CreateFPToUI(llvmFromValue, llvmToType);
                         }
                         else {
-                            node->llvmData = builder.CreateFPToSI(llvmFromValue, llvmToType);
+                            llvmData(node) = builder.CreateFPToSI(llvmFromValue, llvmToType);
                         }
                     }
                 }
                 else {
                     if (isFloatType(toType)) {
                         if (isUnsigned) {
-                            node->llvmData = builder.CreateUIToFP(llvmFromValue, llvmToType);
+                            llvmData(node) = builder.CreateUIToFP(llvmFromValue, llvmToType);
                         }
                         else {
-                            node->llvmData = builder.CreateSIToFP(llvmFromValue, llvmToType);
+                            llvmData(node) = builder.CreateSIToFP(llvmFromValue, llvmToType);
                         }
                     }
                     else {
-                        node->llvmData = builder.CreateIntCast(llvmFromValue, llvmToType, !isUnsigned);
+                        llvmData(node) = builder.CreateIntCast(llvmFromValue, llvmToType, !isUnsigned);
                     }
                 }
             }
             else if (fromType->typeData.kind == NodeTypekind::POINTER && toType->typeData.kind == NodeTypekind::I64) {
                 // ptr to int
-                node->llvmData = builder.CreatePtrToInt(rvalueFor(resolvedValue), typeFor(node->typeInfo));
+                llvmData(node) = builder.CreatePtrToInt(rvalueFor(resolvedValue), typeFor(node->typeInfo));
             }
             else if (fromType->typeData.kind == NodeTypekind::I64 && toType->typeData.kind == NodeTypekind::POINTER) {
                 // int to ptr
-                node->llvmData = builder.CreateIntToPtr(rvalueFor(resolvedValue), typeFor(node->typeInfo));
+                llvmData(node) = builder.CreateIntToPtr(rvalueFor(resolvedValue), typeFor(node->typeInfo));
             }
             else {
-                node->llvmData = rvalueFor(resolvedValue);
-                if (node->llvmData && resolve(node->typeInfo)->typeData.kind == NodeTypekind::POINTER) {
-                    node->llvmData = builder.CreateBitCast(rvalueFor(resolvedValue), typeFor(node->typeInfo));
+                llvmData(node) = rvalueFor(resolvedValue);
+                if (llvmData(node) && resolve(node->typeInfo)->typeData.kind == NodeTypekind::POINTER) {
+                    llvmData(node) = builder.CreateBitCast(rvalueFor(resolvedValue), typeFor(node->typeInfo));
                 }
             }
 
-            if (node->llvmData && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            if (llvmData(node) && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::ARRAY_INDEX: {
             gen(node->resolved);
 
-            node->llvmData = node->resolved->llvmData;
-            node->llvmLocal = node->resolved->llvmLocal;
+            llvmData(node) = llvmData(node->resolved);
+            llvmLocal(node) = llvmLocal(node->resolved);
             node->isLocal = node->resolved->isLocal;
         } break;
         case NodeType::STRING_LITERAL: {
-            gen(node->stringLiteralData.arrayLiteralRepresentation);
-            node->llvmData = node->stringLiteralData.arrayLiteralRepresentation->llvmData;
+            if (node->stringLiteralData.arrayLiteralRepresentation != nullptr) {
+                gen(node->stringLiteralData.arrayLiteralRepresentation);
+                llvmData(node) = llvmData(node->stringLiteralData.arrayLiteralRepresentation);
+            }
+            else {
+                auto value = node->stringLiteralData.value;
+                auto buffer = builder.CreateBitCast((llvm::Value *) llvmLocal(node->stringLiteralData.buffer), builder.getInt8PtrTy());
+
+                if (!value->empty()) {
+                    auto found = hash_get(stringData, *value);
+
+                    llvm::Value *data;
+                    if (found != nullptr) {
+                        data = *found;
+                    }
+                    else {
+                        data = builder.CreateGlobalStringPtr(*value, "str");
+                        hash_insert(stringData, *value, data);
+                    }
+
+                    builder.CreateMemCpy(buffer, data, value->size(), 1);
+                }
+
+                // {&buffer, count}
+                auto arrayType = llvm::StructType::get(context, { builder.getInt8PtrTy(), builder.getInt64Ty() });
+                auto array = (llvm::Value *) llvm::ConstantStruct::get(arrayType);
+                array = builder.CreateInsertValue(array, buffer, 0);
+                array = builder.CreateInsertValue(array, builder.getInt64(value->size()), 1);
+
+                llvmData(node) = array;
+            }
 
-            if (node->isLocal && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            if (node->isLocal && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::UNARY_NEG: {
@@ -1277,11 +1869,11 @@ void LlvmGen::gen(Node *node) {
                 || node->typeInfo->typeData.kind == NodeTypekind::U32
                 || node->typeInfo->typeData.kind == NodeTypekind::I64
                 || node->typeInfo->typeData.kind == NodeTypekind::U64) {
-                node->llvmData = builder.CreateNeg(rvalueFor(node->unaryNegData.target));
+                llvmData(node) = builder.CreateNeg(rvalueFor(node->unaryNegData.target));
             } else if (node->typeInfo->typeData.kind == NodeTypekind::FLOAT_LITERAL
                        || node->typeInfo->typeData.kind == NodeTypekind::F32
                        || node->typeInfo->typeData.kind == NodeTypekind::F64) {
-                node->llvmData = builder.CreateFNeg(rvalueFor(node->unaryNegData.target));
+                llvmData(node) = builder.CreateFNeg(rvalueFor(node->unaryNegData.target));
             } else {
                 cpi_assert(false);
             }
@@ -1291,21 +1883,21 @@ void LlvmGen::gen(Node *node) {
 
             gen(notData);
 
-            node->llvmData = builder.CreateNot(rvalueFor(notData));
-            store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            llvmData(node) = builder.CreateNot(rvalueFor(notData));
+            store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
         } break;
         case NodeType::UNARY_BITNOT: {
             auto notData = resolve(node->nodeData);
 
             gen(notData);
 
-            node->llvmData = builder.CreateNot(rvalueFor(notData));
-            store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            llvmData(node) = builder.CreateNot(rvalueFor(notData));
+            store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
         } break;
         case NodeType::SIZEOF: {
             auto sizeInBits = module->getDataLayout().getTypeSizeInBits(typeFor(node->nodeData));
             auto sizeInBytes = sizeInBits / 8;
-            node->llvmData = llvm::ConstantInt::get(builder.getInt64Ty(), sizeInBytes);
+            llvmData(node) = llvm::ConstantInt::get(builder.getInt64Ty(), sizeInBytes);
         } break;
         case NodeType::FOR: {
             if (node->forData.isStatic) {
@@ -1333,47 +1925,47 @@ void LlvmGen::gen(Node *node) {
             cpi_assert(node->resolved != nullptr);
             gen(node->resolved);
 
-            node->llvmData = node->resolved->llvmData;
-            if (node->isLocal && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            llvmData(node) = llvmData(node->resolved);
+            if (node->isLocal && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::FIELDSOF: {
             cpi_assert(node->resolved != nullptr);
             gen(node->resolved);
 
-            node->llvmData = node->resolved->llvmData;
-            if (node->isLocal && node->llvmLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+            llvmData(node) = llvmData(node->resolved);
+            if (node->isLocal && llvmLocal(node)) {
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::ALIAS: {
             gen(node->nodeData);
-            node->llvmData = node->nodeData->llvmData;
+            llvmData(node) = llvmData(node->nodeData);
         } break;
         case NodeType::ATTROF: {
             auto resolved = resolve(node);
             gen(resolved);
-            node->llvmData = resolved->llvmData;
+            llvmData(node) = llvmData(resolved);
 
             if (node->isLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::HASATTR: {
             auto resolved = resolve(node);
             gen(resolved);
-            node->llvmData = resolved->llvmData;
+            llvmData(node) = llvmData(resolved);
 
             if (node->isLocal) {
-                store((llvm::Value *) node->llvmData, (llvm::Value *) node->llvmLocal);
+                store((llvm::Value *) llvmData(node), (llvm::Value *) llvmLocal(node));
             }
         } break;
         case NodeType::CREATE_CONTEXT: {
             auto resolved = resolve(node);
 
             gen(resolved);
-            node->llvmData = resolved->llvmData;
+            llvmData(node) = llvmData(resolved);
         } break;
         case NodeType::DEFER:
         case NodeType::END_SCOPE:
@@ -18,6 +18,20 @@
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/IR/DIBuilder.h"
 
+struct Profile;
+
+// backend-only per-node state, kept out of Node and indexed by node id
+struct LlvmNodeData {
+    void *local = nullptr;
+    void *data = nullptr;
+
+    // kept here rather than on the node, so several LlvmGens can each generate the same fn into their own module
+    bool generated = false;
+};
+
+// once per process. --serve does it up front so every build it forks starts with the targets registered
+void initializeLlvmTargets();
+
 class LlvmGen {
 public:
     llvm::LLVMContext context;
@@ -25,29 +39,78 @@ public:
     unique_ptr<llvm::Module> module;
     llvm::TargetMachine *targetMachine;
 
+    // 0-3, like -O. 0 runs no passes at all
+    unsigned int optLevel;
+
+    // put on every fn, so the inliner and vectorizers see what they're allowed to use
+    string targetCpu;
+    string targetFeatures;
+
     llvm::Constant *panicFunc;
     llvm::Constant *printfFunc;
 
     llvm::StructType *voidTy;
 
-    // Create a new pass manager attached to it.
     unique_ptr<llvm::legacy::FunctionPassManager> TheFPM;
+    unique_ptr<llvm::legacy::PassManager> TheMPM;
 
     Node *currentFnDecl = nullptr;
-    vector<llvm::Function *> allFns;
     llvm::DIScope *currentScope;
     string currentScopeName;
 
-    LlvmGen(const char *fileName);
+    vector<LlvmNodeData> nodeData;
+
+    // string literals' characters, one private constant global per distinct string
+    hash_t<string, llvm::Value *> *stringData = hash_init<string, llvm::Value *>(64);
+
+    // --profile-in: the interpreter's counts, for branch weights on if/while and entry counts on fns
+    Profile *profile = nullptr;
+
+    // cpu is an llvm cpu name, "native" for the host cpu and all of its features, or empty for "generic"
+    LlvmGen(const char *fileName, unsigned int optLevel = 1, const string &cpu = "");
+
+    void *&llvmLocal(Node *node);
+    void *&llvmData(Node *node);
 
     llvm::Type *typeFor(Node *node);
     llvm::Value *rvalueFor(Node *node);
     llvm::Value *store(llvm::Value *val, llvm::Value *ptr);
+    llvm::AllocaInst *entryAlloca(llvm::Type *type, const string &name);
     void storeIfNeeded(Node *node);
 
+    llvm::MDNode *branchWeightsFor(Node *node);
+    void applyProfile(Node *fn, llvm::Function *F);
+
     void gen(Node *node);
 
+    // emitObjects makes a target machine and pass managers per thread, since neither can be shared between them
+    llvm::TargetMachine *createTargetMachine();
+    void addOptimizationPasses(llvm::TargetMachine *machine, llvm::legacy::FunctionPassManager &fpm,
+                               llvm::legacy::PassManager &mpm);
+    void optimize(llvm::Module &target, llvm::legacy::FunctionPassManager &fpm, llvm::legacy::PassManager &mpm);
+    void markTinyFnsAlwaysInline(llvm::Module &target);
+
     void finalize();
+
+    // machine code for the whole module, straight from the target machine into memory
+    bool emitObject(llvm::SmallVectorImpl<char> &object);
+
+    // --lto: link in the clang bitcode of every #link lib that has a <lib>.bc next to it. only what the program calls is
+    // imported, and only fns which don't touch the lib's mutable globals, since those would end up with a second copy
+    bool importLinkBitcode(vector_t<string *> &linkLibs);
+
+    // bitcode with a thinlto summary, for linking with clang -flto=thin against the c it calls into
+    void writeBitcode(llvm::raw_ostream &out);
+
+    // finalize and emitObject, but with the module split into up to `partitions` modules which are each optimized
+    // and emitted on a thread of their own. fns only get inlined into callers in the same partition.
+    // leaves this LlvmGen without a module
+    bool emitObjects(unsigned int partitions, vector<llvm::SmallVector<char, 0>> &objects);
 };
 
+// link objects held in memory into an executable against the program's #link libs.
+// the objects are handed to the system linker driver ($CC, otherwise cc from PATH) without going through llc or bitcode
+bool linkExecutable(vector<llvm::SmallVector<char, 0>> &objects, const string &outputFileName,
+                    vector_t<string *> &linkLibs);
+
 #endif // LLVM_CODEGEN_H
@@ -9,9 +9,16 @@
 #include "interpreter.h"
 #include "lexer.h"
 #include "parser.h"
+#include "threadpool.h"
+#include "modulecache.h"
+#include "serve.h"
 #include "semantic.h"
 #include "bytecodegen.h"
+#include "bytecodecompiler.h"
 #include "llvmgen.h"
+#include "jit.h"
+#include "tiering.h"
+#include "profile.h"
 #include "container.h"
 
 #include "llvm/ADT/APFloat.h"
@@ -35,21 +42,28 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
-#include "llvm/Bitcode/BitcodeWriter.h"
 
 using namespace std;
 using namespace llvm;
 
-unsigned long nodeId;
-unsigned long fnTableId;
+atomic<unsigned long> nodeId;
+atomic<unsigned long> fnTableId;
 int debugFlag;
 int noIppFlag;
+int noCtfeCacheFlag;
+static int noModuleCacheFlag = 0;
+static int serveFlag = 0;
 AtomTable *atomTable;
 vector_t<Node *> importedFileModules;
 
 static int printAsmFlag = 0;
 static int printAstFlag = 0;
 static int interpretFlag = 0;
+static int jitFlag = 0;
+static int tieredFlag = 0;
+static int compileBytecodeFlag = 0;
+static int ltoFlag = 0;
+static int printPolymorphsFlag = 0;
 
 void printHelp() {
     cout << "Usage: cpi [args] inputFile.[cpi,cas,cbc]"                                      << endl << endl
@@ -62,11 +76,41 @@ void printHelp() {
          << "--debug       (-d):               Start the program in debug mode"              << endl
          << "--output-file (-o) <filename>:    File to write to"                             << endl
          << "--interpret   (-i):               Run the interpreter"                          << endl
+         << "--jit:                            Compile with llvm in-process and run main"    << endl
+         << "--tiered:                         Interpret, compiling hot fns with llvm"       << endl
+         << "--compile-bytecode:               Turn a .cbc into an executable, with -o"      << endl
+         << "--lto:                            Inline from #link libs with a <lib>.bc"       << endl
+         << "--profile-out <file>:             Interpret, writing branch and call counts"    << endl
+         << "--profile-in <file>:              Use --profile-out counts in .ll/executables"  << endl
+         << "--print-polymorphs:               Print instantiation counts per polymorph"     << endl
+         << "--no-ctfe-cache:                  Don't read or write ~/.cpi/cache"             << endl
+         << "--no-module-cache:                Always compile, even if no module changed"    << endl
          << "--n-times     (-n):               Run interpreter n times (for benchmarking)"   << endl
+         << "--jobs        (-j) <n>:           Check, generate and emit code on n threads"   << endl
+         << "--codegen-partitions <n>:         Emit objects in n parts (default: -j)"        << endl
+         << "-O<0-3>:                          Optimization level for .ll/executables (-O1)" << endl
+         << "--march/--mcpu <cpu>:             Target cpu for .ll/executables, or 'native'"  << endl
+         << "--serve:                          Stay resident and take build/run requests"    << endl
+         << "--request <build|run>:            Send inputFile to a running --serve"          << endl
          << "--help        (-h):               Show help"                                    << endl;
     exit(1);
 }
 
+string polymorphName(Node *target) {
+    Node *name = nullptr;
+    if (target->type == NodeType::FN_DECL) {
+        name = target->fnDeclData.name;
+    }
+    else if (target->type == NodeType::PARAMETERIZED_TYPE && target->parameterizedTypeData.typeDecl != nullptr) {
+        name = target->parameterizedTypeData.typeDecl->typeData.name;
+    }
+
+    if (name == nullptr || name->type != NodeType::SYMBOL) {
+        return "<anonymous>";
+    }
+    return atomTable->nameOf(name->symbolData.atomId);
+}
+
 enum class InputType {
     CPI,
     CAS,
@@ -78,6 +122,7 @@ enum class OutputType {
     CAS,
     CBC,
     LL,
+    BC,
     BINARY
 };
 
@@ -92,12 +137,60 @@ InputType inputTypeFromExtension(const string &fileName) {
     return {};
 }
 
+// main's return value, from the start of the interpreter's stack or from what the jit wrote back
+void printReturnValue(NodeTypekind mainReturnKind, const vector<unsigned char> &bytes) {
+    cout << "RETURN VALUE: ";
+
+    switch (mainReturnKind) {
+        case NodeTypekind::BOOLEAN_LITERAL:
+        case NodeTypekind::BOOLEAN: {
+            cout << "(bool) " << (bytesTo<int32_t>(bytes, 0) ? "true" : "false") << endl;
+        } break;
+        case NodeTypekind::U8: {
+            cout << "(u8) " << bytesTo<uint8_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::I8: {
+            cout << "(i8) " << bytesTo<int8_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::U16: {
+            cout << "(u16) " << bytesTo<uint16_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::I16: {
+            cout << "(i16) " << bytesTo<int16_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::U32: {
+            cout << "(u32) " << bytesTo<uint32_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::I32: {
+            cout << "(i32) " << bytesTo<int32_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::U64: {
+            cout << "(u64) " << bytesTo<uint64_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::INT_LITERAL:
+        case NodeTypekind::I64: {
+            cout << "(i64) " << bytesTo<int64_t>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::F32:
+        case NodeTypekind::FLOAT_LITERAL: {
+            cout << "(f32) " << bytesTo<float>(bytes, 0) << endl;
+        } break;
+        case NodeTypekind::F64: {
+            cout << "(f64) " << bytesTo<double>(bytes, 0) << endl;
+        } break;
+        default: {
+            cout << "(other) " << bytesTo<int64_t>(bytes, 0) << endl;
+        }
+    }
+}
+
 int main(int argc, char **argv) {
     chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
 
     nodeId = 0;
     debugFlag = 0;
     noIppFlag = 0;
+    noCtfeCacheFlag = 0;
 
     reusedPolymorphs = 0;
     newPolymorphs = 0;
@@ -118,18 +211,40 @@ int main(int argc, char **argv) {
             {"debug",       no_argument,       &debugFlag,     'd'},
             {"output-file", required_argument, nullptr,        'o'},
             {"interpret",   no_argument,       &interpretFlag, 'i'},
+            {"jit",         no_argument,       &jitFlag,       'J'},
+            {"tiered",      no_argument,       &tieredFlag,    'T'},
+            {"compile-bytecode", no_argument,  &compileBytecodeFlag, 'B'},
+            {"lto",         no_argument,       &ltoFlag,       'L'},
+            {"print-polymorphs", no_argument,  &printPolymorphsFlag, 'y'},
+            {"no-ctfe-cache", no_argument,     &noCtfeCacheFlag, 'x'},
+            {"no-module-cache", no_argument,   &noModuleCacheFlag, 'm'},
             {"help",        no_argument,       nullptr,        'h'},
             {"n-times",     required_argument, nullptr,        'n'},
+            {"jobs",        required_argument, nullptr,        'j'},
+            {"codegen-partitions", required_argument, nullptr, 'G'},
+            {"serve",       no_argument,       &serveFlag,     's'},
+            {"request",     required_argument, nullptr,        'r'},
+            {"march",       required_argument, nullptr,        'M'},
+            {"mcpu",        required_argument, nullptr,        'C'},
+            {"profile-out", required_argument, nullptr,        'P'},
+            {"profile-in",  required_argument, nullptr,        'I'},
             {nullptr,       0,                 nullptr,        0}
     };
 
     char *outputFileName = nullptr;
     int nTimes = 1;
+    int jobs = 1;
+    int codegenPartitions = 0;
+    char *serveCommand = nullptr;
+    unsigned int optLevel = 1;
+    string targetCpu;
+    char *profileOut = nullptr;
+    char *profileIn = nullptr;
 
     while (true) {
         int optionIndex;
 
-        auto c = getopt_long(argc, argv, "pdo:c:n:ih", longOptions, &optionIndex);
+        auto c = getopt_long(argc, argv, "pdo:c:n:j:O:ih", longOptions, &optionIndex);
         if (c == -1) { break; }
         switch (c) {
             case 0: {
@@ -141,6 +256,31 @@ int main(int argc, char **argv) {
             case 'n': {
                 nTimes = atoi(optarg);
             } break;
+            case 'j': {
+                jobs = atoi(optarg);
+            } break;
+            case 'G': {
+                codegenPartitions = atoi(optarg);
+            } break;
+            case 'r': {
+                serveCommand = optarg;
+            } break;
+            case 'O': {
+                if (strlen(optarg) != 1 || optarg[0] < '0' || optarg[0] > '3') {
+                    printHelp();
+                }
+                optLevel = (unsigned int) (optarg[0] - '0');
+            } break;
+            case 'M':
+            case 'C': {
+                targetCpu = optarg;
+            } break;
+            case 'P': {
+                profileOut = optarg;
+            } break;
+            case 'I': {
+                profileIn = optarg;
+            } break;
             case 'c': {
                 noIppFlag = 1;
             } break;
@@ -154,13 +294,47 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (argc != optind + 1) {
-        printHelp();
+    if (tieredFlag != 0 || profileOut != nullptr) {
+        interpretFlag = 1;
+    }
+
+    // splitting codegen up doesn't touch anything checking or bytecode generation shares between threads,
+    // so it can be asked for on its own
+    if (codegenPartitions <= 0) {
+        codegenPartitions = jobs;
+    }
+
+    Parser *parser = nullptr;
+    string inputFile;
+
+    if (serveFlag != 0) {
+        // only comes back in a process forked off for one request
+        auto request = serve(defaultServeSocketPath());
+        inputFile = request.inputFile;
+        interpretFlag = request.run ? 1 : 0;
+        parser = request.parser;
+    }
+    else {
+        if (argc != optind + 1) {
+            printHelp();
+        }
+
+        inputFile = string(realpath(argv[optind], nullptr));
+
+        if (serveCommand != nullptr) {
+            return sendServeRequest(defaultServeSocketPath(), serveCommand, inputFile);
+        }
     }
 
-    auto inputFile = string(realpath(argv[optind], nullptr));
     auto inputType = inputTypeFromExtension(inputFile);
 
+    if (compileBytecodeFlag != 0 && (inputType != InputType::CBC || outputFileName == nullptr)) {
+        printHelp();
+    }
+    if (profileOut != nullptr && inputType != InputType::CPI) {
+        printHelp();
+    }
+
     unsigned long lastSlash = 0;
     for (unsigned long i = 0; i < inputFile.length(); i++) {
         if (inputFile[i] == '/') {
@@ -170,13 +344,21 @@ int main(int argc, char **argv) {
     auto compilerCurrentDir = realpath(inputFile.substr(0, lastSlash).c_str(), nullptr);
     chdir(compilerCurrentDir);
 
-    Semantic *semantic;
+    // like -o, relative to the input file's directory
+    Profile *profile = nullptr;
+    if (profileIn != nullptr) {
+        profile = new Profile();
+        if (!readProfile(profileIn, profile)) {
+            cout << "could not read " << profileIn << " as a profile" << endl;
+            return 1;
+        }
+    }
+
+    Semantic *semantic = nullptr;
 
     vector<unsigned char> instructions;
     hash_t<uint32_t, uint64_t> *fnTable = nullptr;
 
-    Parser *parser = nullptr;
-
     auto outputType = OutputType::NONE;
     if (outputFileName != nullptr) {
         std::ofstream out(outputFileName);
@@ -189,6 +371,8 @@ int main(int argc, char **argv) {
             outputType = OutputType::CBC;
         } else if (endsWith(outputNameString, ".ll")) {
             outputType = OutputType::LL;
+        } else if (endsWith(outputNameString, ".bc")) {
+            outputType = OutputType::BC;
         } else {
             outputType = OutputType::BINARY;
         }
@@ -197,26 +381,46 @@ int main(int argc, char **argv) {
     }
 
     Interpreter *interp;
+    BytecodeGen *bytecodeGen = nullptr;
+
+    // the cache only holds bytecode, so anything which needs the AST or llvm has to compile
+    auto useModuleCache = noModuleCacheFlag == 0 && debugFlag == 0 && printAstFlag == 0
+                          && inputType == InputType::CPI
+                          && jitFlag == 0 && tieredFlag == 0 && profileOut == nullptr
+                          && (outputType == OutputType::NONE || outputType == OutputType::CAS || outputType == OutputType::CBC);
+
+    uint64_t moduleKey = 0;
+    CachedProgram cached;
+    auto loadedFromCache = false;
+    if (useModuleCache) {
+        moduleKey = moduleCacheKey(inputFile);
+        loadedFromCache = readModuleCache(moduleKey, &cached);
+    }
 
-    if (inputType == InputType::CPI) {
-        auto lexer = new Lexer(new string(inputFile), nullptr);
-        parser = new Parser(lexer);
+    auto mainReturnKind = NodeTypekind::I64;
 
-        auto fileModule = new Node(lexer->srcInfo, NodeType::MODULE, parser->scopes.top());
-        vector_append(importedFileModules, fileModule);
-        fileModule->moduleData.name = new Node(lexer->srcInfo, NodeType::SYMBOL, parser->scopes.top());
-        fileModule->moduleData.fullImportAtomId = atomTable->insertStr(inputFile);
-        auto f = inputFile.substr(0, inputFile.length() - 4);
-        fileModule->moduleData.name->symbolData.atomId = atomTable->insertStr(f);
-        fileModule->moduleData.stmts = parser->allTopLevel;
+    if (loadedFromCache) {
+        interp = new Interpreter(cached.linkLibs);
+        interp->externalFnTable = cached.externalFnTable;
+        interp->debugging = false;
 
-        parser->parseRoot();
+        instructions = cached.instructions;
+        fnTable = cached.fnTable;
+        mainReturnKind = cached.mainReturnKind;
+    }
+    else if (inputType == InputType::CPI) {
+        // --serve hands over a program it has already parsed
+        if (parser == nullptr) {
+            parser = parseProgram(inputFile);
+        }
+        auto lexer = parser->lexer;
 
         semantic = new Semantic();
         semantic->lexer = lexer;
         semantic->parser = parser;
         semantic->contexts = *parser->contexts;
         semantic->contextInits = *parser->contextInits;
+        semantic->deferBodies = jobs > 1;
         semantic->addStaticIfs(parser->scopes.top());
         semantic->addImports(*parser->imports, *parser->impls, *parser->contexts, *parser->contextInits);
 
@@ -240,7 +444,9 @@ int main(int argc, char **argv) {
             semantic->resolveTypes(tl);
         }
 
-        vector_append(semantic->structsToSize, semantic->contextType->typeData.structTypeData);
+        semantic->checkDeferredBodies((unsigned int) jobs);
+
+        vector_append(semantic->structsToSize, semantic->contextType);
         semantic->sizeStructs();
 
         semantic->canRun = true;
@@ -248,21 +454,32 @@ int main(int argc, char **argv) {
             r->semantic = false;
             semantic->resolveTypes(r);
         }
+        semantic->releaseCompileTimeNodes();
 
         if (semantic->encounteredErrors) { return -1; }
 
+        auto mainReturnType = resolve(resolve(parser->mainFn)->fnDeclData.returnType);
+        cpi_assert(mainReturnType->type == NodeType::TYPE);
+        mainReturnKind = mainReturnType->typeData.kind;
+
         if (interpretFlag != 0 || outputType == OutputType::CAS || outputType == OutputType::CBC || printAsmFlag != 0) {
             auto gen = new BytecodeGen();
+            bytecodeGen = gen;
             gen->isMainFn = true;
             gen->sourceMap.sourceInfo = lexer->srcInfo;
             gen->processFnDecls = true;
 
-            gen->gen(parser->mainFn);
-            while (!gen->toProcess.empty()) {
-                gen->isMainFn = false;
-                gen->processFnDecls = true;
-                gen->gen(gen->toProcess.front());
-                gen->toProcess.pop();
+            if (jobs > 1) {
+                gen->genProgram(parser->mainFn, (unsigned int) jobs);
+            }
+            else {
+                gen->gen(parser->mainFn);
+                while (!gen->toProcess.empty()) {
+                    gen->isMainFn = false;
+                    gen->processFnDecls = true;
+                    gen->gen(gen->toProcess.front());
+                    gen->toProcess.pop();
+                }
             }
             gen->fixup();
 
@@ -273,39 +490,45 @@ int main(int argc, char **argv) {
             interp->externalFnTable = gen->externalFnTable;
             interp->debugging = debugFlag == 0 ? false : true;
 
+            if (profileOut != nullptr) {
+                interp->profile = new ProfileRecorder();
+            }
+
+            // natively run fns' branches wouldn't be counted, so no tiering while profiling
+            if (tieredFlag != 0 && debugFlag == 0 && profileOut == nullptr) {
+                interp->tiering = new Tiering(inputFile, semantic->linkLibs, optLevel, targetCpu, parser->mainFn,
+                                              gen->fnTable, gen->generatedNodes);
+            }
+
             instructions = gen->instructions;
             fnTable = gen->fnTable;
+
+            // also what a .cbc is written from
+            cached.instructions = instructions;
+            cached.fnTable = fnTable;
+            cached.externalFnTable = gen->externalFnTable;
+            cached.linkLibs = semantic->linkLibs;
+            cached.mainReturnKind = mainReturnKind;
+
+            if (useModuleCache && !semantic->ctfeHadSideEffects) {
+                writeModuleCache(moduleKey, &cached);
+            }
         }
     }
     else {
-        ifstream t(inputFile);
-        string fileBytes;
-
-        t.seekg(0, ios::end);
-        fileBytes.reserve(static_cast<unsigned long>(t.tellg()));
-        t.seekg(0, ios::beg);
-
-        fileBytes.assign((istreambuf_iterator<char>(t)),
-                         istreambuf_iterator<char>());
-
-        auto bytes = vector<unsigned char>(fileBytes.length());
-        copy(fileBytes.begin(), fileBytes.end(), bytes.begin());
-
-        auto offset = 0;
-        auto count = bytesTo<uint32_t>(bytes, 0);
-        offset += sizeof(uint32_t);
-        for (uint32_t i = 0; i < count; i++) {
-            auto fnIndex = bytesTo<uint32_t>(bytes, offset);
-            offset += sizeof(uint32_t);
-
-            auto instIndex = bytesTo<uint32_t>(bytes, offset);
-            offset += sizeof(uint32_t);
-
-            hash_insert(fnTable, fnIndex, (uint64_t) instIndex);
+        ifstream in(inputFile, ios::binary);
+        if (!readBytecode(in, &cached)) {
+            cout << "could not read " << inputFile << " as bytecode" << endl;
+            return 1;
         }
 
-        instructions = vector<unsigned char>(bytes.size() - offset);
-        memcpy(&instructions[0], &bytes[offset], bytes.size() - offset);
+        interp = new Interpreter(cached.linkLibs);
+        interp->externalFnTable = cached.externalFnTable;
+        interp->debugging = debugFlag == 0 ? false : true;
+
+        instructions = cached.instructions;
+        fnTable = cached.fnTable;
+        mainReturnKind = cached.mainReturnKind;
     }
 
     if (printAsmFlag != 0) {
@@ -321,6 +544,12 @@ int main(int argc, char **argv) {
     cout << "total lines: " << totalLines << endl;
     cout << "reused " << reusedPolymorphs << " polymorphs, made " << newPolymorphs << " polymorphs." << endl;
 
+    if (printPolymorphsFlag != 0 && semantic != nullptr) {
+        for (auto counts : semantic->polymorphCounts) {
+            cout << "    " << polymorphName(counts->target) << ": reused " << counts->reused << ", made " << counts->made << endl;
+        }
+    }
+
     chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
     auto duration = chrono::duration_cast<chrono::microseconds>( t2 - t1 ).count();
 
@@ -345,60 +574,61 @@ int main(int argc, char **argv) {
             interp->sp = 0;
             interp->bp = 0;
 
+            // main is started rather than called, so it counts as a call here
+            if (interp->profile != nullptr) {
+                recordCall(interp->profile, interp->pc);
+            }
+
             interp->interpret();
 //            cout << "executed " << interp->stepCount << " instructions" << endl;
         }
 
-        cout << "RETURN VALUE: ";
+        if (profileOut != nullptr
+            && !writeProfile(profileOut, interp->profile, interp->sourceMap, fnTable, bytecodeGen->generatedNodes)) {
+            cout << "could not write " << profileOut << endl;
+            return 1;
+        }
 
-        // todo(chad): look at the return type of the 'main' fn and determine which of these to print!!
-        auto mainReturnType = resolve(resolve(parser->mainFn)->fnDeclData.returnType);
-        cpi_assert(mainReturnType->type == NodeType::TYPE);
+        printReturnValue(mainReturnKind, interp->stack);
+    }
 
-        switch (mainReturnType->typeData.kind) {
-            case NodeTypekind::BOOLEAN_LITERAL:
-            case NodeTypekind::BOOLEAN: {
-                cout << "(bool) " << (interp->readFromStack<int32_t>(0) ? "true" : "false") << endl;
-            } break;
-            case NodeTypekind::U8: {
-                cout << "(u8) " << interp->readFromStack<uint8_t>(0) << endl;
-            } break;
-            case NodeTypekind::I8: {
-                cout << "(i8) " << interp->readFromStack<int8_t>(0) << endl;
-            } break;
-            case NodeTypekind::U16: {
-                cout << "(u16) " << interp->readFromStack<uint16_t>(0) << endl;
-            } break;
-            case NodeTypekind::I16: {
-                cout << "(i16) " << interp->readFromStack<int16_t>(0) << endl;
-            } break;
-            case NodeTypekind::U32: {
-                cout << "(u32) " << interp->readFromStack<uint32_t>(0) << endl;
-            } break;
-            case NodeTypekind::I32: {
-                cout << "(i32) " << interp->readFromStack<int32_t>(0) << endl;
-            } break;
-            case NodeTypekind::U64: {
-                cout << "(u64) " << interp->readFromStack<uint64_t>(0) << endl;
-            } break;
-            case NodeTypekind::INT_LITERAL:
-            case NodeTypekind::I64: {
-                cout << "(i64) " << interp->readFromStack<int64_t>(0) << endl;
-            } break;
-            case NodeTypekind::F32:
-            case NodeTypekind::FLOAT_LITERAL: {
-                cout << "(f32) " << interp->readFromStack<float>(0) << endl;
-            } break;
-            case NodeTypekind::F64: {
-                cout << "(f64) " << interp->readFromStack<double>(0) << endl;
-            } break;
-            default: {
-                cout << "(other) " << interp->readFromStack<int64_t>(0) << endl;
-            }
+    if (jitFlag != 0 && semantic != nullptr && !semantic->encounteredErrors) {
+        auto llvmGen = new LlvmGen(inputFile.c_str(), optLevel, targetCpu);
+        llvmGen->profile = profile;
+
+        if (nTimes > 1) {
+            cout << "running jitted main " << nTimes << " times..." << endl;
+        }
+
+        vector<unsigned char> result;
+        if (!runJit(llvmGen, parser->mainFn, semantic->linkLibs, nTimes, &result)) {
+            return 1;
+        }
+
+        printReturnValue(mainReturnKind, result);
+    }
+
+    if (compileBytecodeFlag != 0) {
+        auto llvmGen = new LlvmGen(inputFile.c_str(), optLevel, targetCpu);
+        if (!compileBytecode(llvmGen, &cached)) {
+            return 1;
+        }
+        if (ltoFlag != 0 && !llvmGen->importLinkBitcode(cached.linkLibs)) {
+            return 1;
+        }
+
+        vector<llvm::SmallVector<char, 0>> objects;
+        if (!llvmGen->emitObjects((unsigned int) codegenPartitions, objects)) {
+            return 1;
+        }
+
+        if (!linkExecutable(objects, outputFileName, cached.linkLibs)) {
+            errs() << "linking " << outputFileName << " failed\n";
+            return 1;
         }
     }
 
-    if (outputFileName != nullptr && semantic != nullptr && !semantic->encounteredErrors) {
+    if (outputFileName != nullptr && (loadedFromCache || (semantic != nullptr && !semantic->encounteredErrors))) {
         std::ofstream out(outputFileName);
 
         auto outputFileNameString = new string(outputFileName);
@@ -408,28 +638,11 @@ int main(int argc, char **argv) {
             printer->fnTable = fnTable;
             out << printer->debugString();
         } else if (endsWith(outputFileNameString, ".cbc")) {
-            // .cbc
-
-            // fn table
-            out << toBytes(static_cast<uint32_t>(fnTable->size));
-            for (auto i = 0; i < fnTable->bucket_count; i++) {
-                auto bucket = fnTable->buckets[i];
-                if (bucket != nullptr) {
-                    out << toBytes(bucket->key) << toBytes(bucket->value);
-
-                    while (bucket->next != nullptr) {
-                        bucket = bucket->next;
-
-                        out << toBytes(bucket->key) << toBytes(bucket->value);
-                    }
-                }
-            }
-
-            // instructions
-            out << instructions;
+            writeBytecode(out, &cached);
         } else if (endsWith(outputFileNameString, ".ll")) {
             // .ll
-            auto llvmGen = new LlvmGen(inputFile.c_str());
+            auto llvmGen = new LlvmGen(inputFile.c_str(), optLevel, targetCpu);
+            llvmGen->profile = profile;
 
             llvmGen->gen(parser->mainFn);
             llvmGen->finalize();
@@ -441,61 +654,40 @@ int main(int argc, char **argv) {
             std::ofstream outFile(outputFileName);
             out << outString;
             out.close();
-        } else {
-            // assume we are generating an executable
-            auto llvmGen = new LlvmGen(inputFile.c_str());
-
-            std::error_code EC;
-            raw_fd_ostream dest("output.bc", EC, sys::fs::F_None);
-            if (EC) {
-                errs() << "Could not open file: " << EC.message();
-                return 1;
-            }
+        } else if (endsWith(outputFileNameString, ".bc")) {
+            auto llvmGen = new LlvmGen(inputFile.c_str(), optLevel, targetCpu);
+            llvmGen->profile = profile;
 
             llvmGen->gen(parser->mainFn);
             llvmGen->finalize();
 
-            WriteBitcodeToFile(llvmGen->module.get(), dest);
+            string outString;
+            llvm::raw_string_ostream outStream(outString);
+            llvmGen->writeBitcode(outStream);
+            outStream.flush();
+
+            out << outString;
+            out.close();
+        } else {
+            // assume we are generating an executable
+            auto llvmGen = new LlvmGen(inputFile.c_str(), optLevel, targetCpu);
+            llvmGen->profile = profile;
 
-            legacy::PassManager pass;
-            auto FileType = TargetMachine::CGFT_ObjectFile;
+            llvmGen->gen(parser->mainFn);
 
-            if (llvmGen->targetMachine->addPassesToEmitFile(pass, dest, FileType)) {
-                errs() << "TheTargetMachine can't emit a file of this type";
+            if (ltoFlag != 0 && !llvmGen->importLinkBitcode(semantic->linkLibs)) {
                 return 1;
             }
 
-            pass.run(*llvmGen->module);
-            dest.flush();
-
-            system("/usr/local/Cellar/llvm/5.0.1/bin/llc --filetype=obj ./output.bc");
-
-            ostringstream command;
-            command << "clang -O3 -L . -L /usr/local/lib/cpi -L /usr/local/lib";
-            for (auto link : semantic->linkLibs) {
-                // todo(chad): make convenience fn for getting file/dir name from long path
-                lastSlash = 0;
-                unsigned long i = 0;
-                for (auto ch : *link) {
-                    if (ch == '/') {
-                        lastSlash = i;
-                    }
-                    i += 1;
-                }
-
-                if (lastSlash > 0) {
-                    command << " -L " << link->substr(0, lastSlash);
-                    *link = link->substr(lastSlash + 1);
-                }
-
-                // substr(3) to strip "lib" from the prefix
-                command << " -l" << link->substr(3);
+            vector<llvm::SmallVector<char, 0>> objects;
+            if (!llvmGen->emitObjects((unsigned int) codegenPartitions, objects)) {
+                return 1;
             }
-            command << " -o " << outputFileName << " output.o";
-            system(command.str().c_str());
 
-            // need to keep the .o file because apparently that's where the debug info is stored
-            system("rm output.bc");
+            if (!linkExecutable(objects, outputFileName, semantic->linkLibs)) {
+                errs() << "linking " << outputFileName << " failed\n";
+                return 1;
+            }
         }
 
         out.close();
@@ -0,0 +1,328 @@
+#include "modulecache.h"
+
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bump whenever the bytecode or the layout of an entry changes
+const uint64_t moduleCacheVersion = 2;
+
+uint64_t fnv1a(uint64_t h, const string &bytes) {
+    for (auto c : bytes) {
+        h = (h ^ (unsigned char) c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t fnv1a(const string &bytes) {
+    return fnv1a(14695981039346656037ULL, bytes);
+}
+
+uint64_t moduleCacheKey(const string &inputFile) {
+    auto h = fnv1a(inputFile);
+    h = fnv1a(h, to_string(moduleCacheVersion));
+    h = fnv1a(h, to_string(noIppFlag));
+    return h;
+}
+
+string moduleCacheDir() {
+    auto home = getenv("HOME");
+    if (home == nullptr) { return ""; }
+
+    return string(home) + "/.cpi/cache/programs";
+}
+
+string moduleCachePath(uint64_t key) {
+    auto dir = moduleCacheDir();
+    if (dir.empty()) { return ""; }
+
+    ostringstream path("");
+    path << dir << "/" << hex << key;
+    return path.str();
+}
+
+bool readFileContents(const string &path, string *contents) {
+    ifstream t(path, ios::binary);
+    if (!t) { return false; }
+
+    ostringstream s("");
+    s << t.rdbuf();
+    *contents = s.str();
+    return true;
+}
+
+void writeString(ostream &out, const string &s) {
+    out << s.size() << "\n" << s;
+}
+
+bool readString(istream &in, string *s) {
+    unsigned long length;
+    in >> length;
+    if (!in) { return false; }
+    in.get();
+
+    s->resize(length);
+    in.read(&(*s)[0], length);
+    return (bool) in;
+}
+
+// only as much of the type as ffi needs to make the call
+void writeType(ostream &out, Node *type) {
+    type = resolve(type);
+    cpi_assert(type->type == NodeType::TYPE);
+
+    if (type->typeData.kind == NodeTypekind::ENUM) {
+        writeType(out, type->typeData.enumTypeData.type);
+        return;
+    }
+
+    out << " " << (int32_t) type->typeData.kind;
+
+    if (type->typeData.kind == NodeTypekind::STRUCT) {
+        out << " " << type->typeData.structTypeData.params.length;
+        for (auto param : type->typeData.structTypeData.params) {
+            writeType(out, param->typeInfo);
+        }
+    }
+}
+
+Node *readType(istream &in) {
+    int32_t kind;
+    in >> kind;
+    if (!in) { return nullptr; }
+
+    auto type = new Node((NodeTypekind) kind);
+
+    if (type->typeData.kind == NodeTypekind::STRUCT) {
+        initStructTypeData(type);
+
+        unsigned long count;
+        in >> count;
+        for (unsigned long i = 0; i < count; i++) {
+            auto paramType = readType(in);
+            if (paramType == nullptr) { return nullptr; }
+
+            vector_append(type->typeData.structTypeData.params, wrapInDeclParam(paramType, "", (int) i));
+        }
+    }
+
+    return type;
+}
+
+void writeExternalFn(ostream &out, Node *callNode) {
+    if (callNode == nullptr) {
+        out << "none\n";
+        return;
+    }
+
+    auto fn = resolve(callNode->fnCallData.fn);
+    cpi_assert(fn->type == NodeType::FN_DECL);
+
+    out << "extern ";
+    writeString(out, atomTable->nameOf(fn->fnDeclData.name->symbolData.atomId));
+
+    out << " " << fn->fnDeclData.params.length;
+    for (auto param : fn->fnDeclData.params) {
+        writeType(out, param->typeInfo);
+    }
+    writeType(out, fn->fnDeclData.returnType);
+    out << "\n";
+}
+
+bool readExternalFn(istream &in, Node **callNode) {
+    string tag;
+    in >> tag;
+    if (tag == "none") {
+        *callNode = nullptr;
+        return true;
+    }
+    if (tag != "extern") { return false; }
+
+    string name;
+    if (!readString(in, &name)) { return false; }
+
+    auto fn = new Node(SourceInfo{}, NodeType::FN_DECL, nullptr);
+    fn->fnDeclData.isExternal = true;
+    fn->fnDeclData.name = new Node(SourceInfo{}, NodeType::SYMBOL, nullptr);
+    fn->fnDeclData.name->symbolData.atomId = atomTable->insertStr(name);
+
+    unsigned long paramCount;
+    in >> paramCount;
+    for (unsigned long i = 0; i < paramCount; i++) {
+        auto paramType = readType(in);
+        if (paramType == nullptr) { return false; }
+
+        vector_append(fn->fnDeclData.params, wrapInDeclParam(paramType, "", (int) i));
+    }
+
+    fn->fnDeclData.returnType = readType(in);
+    if (fn->fnDeclData.returnType == nullptr) { return false; }
+
+    *callNode = new Node(SourceInfo{}, NodeType::FN_CALL, nullptr);
+    (*callNode)->fnCallData.fn = fn;
+    return true;
+}
+
+// everything about a program except where it came from: shared by cache entries and .cbc files
+bool readProgram(istream &in, CachedProgram *program) {
+    string tag;
+
+    unsigned long libCount;
+    in >> tag >> libCount;
+    if (tag != "libs") { return false; }
+
+    for (unsigned long i = 0; i < libCount; i++) {
+        auto lib = new string();
+        if (!readString(in, lib)) { return false; }
+        vector_append(program->linkLibs, lib);
+    }
+
+    int32_t mainReturnKind;
+    in >> tag >> mainReturnKind;
+    if (tag != "main") { return false; }
+    program->mainReturnKind = (NodeTypekind) mainReturnKind;
+
+    unsigned long externCount;
+    in >> tag >> externCount;
+    if (tag != "externs") { return false; }
+
+    for (unsigned long i = 0; i < externCount; i++) {
+        Node *callNode;
+        if (!readExternalFn(in, &callNode)) { return false; }
+        vector_append(program->externalFnTable, callNode);
+    }
+
+    unsigned long fnCount;
+    in >> tag >> fnCount;
+    if (tag != "fns") { return false; }
+
+    program->fnTable = hash_init<uint32_t, uint64_t>(fnCount + 16);
+    for (unsigned long i = 0; i < fnCount; i++) {
+        uint32_t fnIndex;
+        uint64_t instIndex;
+        in >> fnIndex >> instIndex;
+        hash_insert(program->fnTable, fnIndex, instIndex);
+    }
+
+    unsigned long codeLength;
+    in >> tag >> codeLength;
+    if (tag != "code") { return false; }
+    in.get();
+
+    program->instructions.resize(codeLength);
+    in.read((char *) program->instructions.data(), codeLength);
+
+    return (bool) in;
+}
+
+bool readModuleCache(uint64_t key, CachedProgram *program) {
+    auto path = moduleCachePath(key);
+    if (path.empty()) { return false; }
+
+    ifstream in(path, ios::binary);
+    if (!in) { return false; }
+
+    string tag;
+    uint64_t version;
+    in >> tag >> version;
+    if (tag != "cpi" || version != moduleCacheVersion) { return false; }
+
+    // every module the program was built from has to be exactly as it was
+    unsigned long moduleCount;
+    in >> tag >> moduleCount;
+    if (tag != "modules") { return false; }
+
+    for (unsigned long i = 0; i < moduleCount; i++) {
+        string modulePath;
+        uint64_t moduleHash;
+        if (!readString(in, &modulePath)) { return false; }
+        in >> hex >> moduleHash >> dec;
+
+        string contents;
+        if (!readFileContents(modulePath, &contents) || fnv1a(contents) != moduleHash) {
+            return false;
+        }
+    }
+
+    return readProgram(in, program);
+}
+
+void writeProgram(ostream &out, CachedProgram *program) {
+    out << "libs " << program->linkLibs.length << "\n";
+    for (auto lib : program->linkLibs) {
+        writeString(out, *lib);
+        out << "\n";
+    }
+
+    out << "main " << (int32_t) program->mainReturnKind << "\n";
+
+    out << "externs " << program->externalFnTable.length << "\n";
+    for (auto callNode : program->externalFnTable) {
+        writeExternalFn(out, callNode);
+    }
+
+    out << "fns " << program->fnTable->size << "\n";
+    for (auto i = 0; i < program->fnTable->bucket_count; i++) {
+        for (auto bucket = program->fnTable->buckets[i]; bucket != nullptr; bucket = bucket->next) {
+            out << bucket->key << " " << bucket->value << "\n";
+        }
+    }
+
+    out << "code " << program->instructions.size() << "\n";
+    out.write((const char *) program->instructions.data(), program->instructions.size());
+}
+
+void writeModuleCache(uint64_t key, CachedProgram *program) {
+    auto path = moduleCachePath(key);
+    if (path.empty()) { return; }
+
+    ostringstream out("");
+    out << "cpi " << moduleCacheVersion << "\n";
+
+    // every file that was lexed for this program: the input file and everything it imports
+    auto moduleCount = 0;
+    for (unsigned long i = 1; i < sourceFiles.length; i++) {
+        auto file = vector_at(sourceFiles, i);
+        if (file->fileName != nullptr && file->source != nullptr) { moduleCount += 1; }
+    }
+
+    out << "modules " << moduleCount << "\n";
+    for (unsigned long i = 1; i < sourceFiles.length; i++) {
+        auto file = vector_at(sourceFiles, i);
+        if (file->fileName == nullptr || file->source == nullptr) { continue; }
+
+        writeString(out, *file->fileName);
+        out << " " << hex << fnv1a(*file->source) << dec << "\n";
+    }
+
+    writeProgram(out, program);
+
+    auto home = string(getenv("HOME"));
+    mkdir((home + "/.cpi").c_str(), 0755);
+    mkdir((home + "/.cpi/cache").c_str(), 0755);
+    mkdir(moduleCacheDir().c_str(), 0755);
+
+    // write then rename, so a concurrent compile never reads half an entry
+    auto tmpPath = path + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary);
+        if (!file) { return; }
+        file << out.str();
+    }
+    rename(tmpPath.c_str(), path.c_str());
+}
+
+bool readBytecode(istream &in, CachedProgram *program) {
+    string tag;
+    uint64_t version;
+    in >> tag >> version;
+    if (tag != "cbc" || version != moduleCacheVersion) { return false; }
+
+    return readProgram(in, program);
+}
+
+void writeBytecode(ostream &out, CachedProgram *program) {
+    out << "cbc " << moduleCacheVersion << "\n";
+    writeProgram(out, program);
+}
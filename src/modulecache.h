@@ -0,0 +1,37 @@
+#ifndef MODULECACHE_H
+#define MODULECACHE_H
+
+#include <vector>
+
+#include "node.h"
+
+// a compiled program, cached under ~/.cpi/cache/programs along with a hash of every module that went into it.
+// if none of those modules changed since, the next run loads this instead of lexing, parsing, resolving and generating
+struct CachedProgram {
+    vector<unsigned char> instructions;
+    hash_t<uint32_t, uint64_t> *fnTable = nullptr;
+
+    // the interpreter calls extern fns through their decls, so only what ffi needs is kept:
+    // the name, and the params'/return type's layout
+    vector_t<Node *> externalFnTable = vector_init<Node *>(8);
+    vector_t<string *> linkLibs = vector_init<string *>(4);
+
+    NodeTypekind mainReturnKind = NodeTypekind::NONE;
+};
+
+uint64_t fnv1a(const string &bytes);
+bool readFileContents(const string &path, string *contents);
+
+// a length-prefixed string, for anything in these files that could contain whitespace
+void writeString(ostream &out, const string &s);
+bool readString(istream &in, string *s);
+
+uint64_t moduleCacheKey(const string &inputFile);
+bool readModuleCache(uint64_t key, CachedProgram *program);
+void writeModuleCache(uint64_t key, CachedProgram *program);
+
+// a .cbc file is the same as a cache entry without the modules, so it carries the extern fns and #link libs too
+bool readBytecode(istream &in, CachedProgram *program);
+void writeBytecode(ostream &out, CachedProgram *program);
+
+#endif // MODULECACHE_H
@@ -93,8 +93,19 @@ Node::Node(NodeTypekind typekind) : Node() {
 }
 
 Node::Node(Region r) {
-    id = nodeId;
-    nodeId += 1;
+    id = nodeId++;
+
+    semantic = false;
+    isLocal = false;
+    isBytecodeLocal = false;
+    isDeferred = false;
+    sourceMapStatement = false;
+    skipAllButPostStmts = false;
+
+    isUsedInError = false;
+    printed = false;
+    tagCheck = false;
+    debugBytecodeAdjusted = false;
 
     this->region = r;
 }
@@ -175,17 +186,33 @@ void initIfData(Node *node) {
     node->ifData.ifScope = nullptr;
     node->ifData.elseScope = nullptr;
 
-    node->ifData.trueImports = vector_init<Node *>(8);
-    node->ifData.falseImports = vector_init<Node *>(8);
+    node->ifData.staticIfData = nullptr;
+}
+
+void initStaticIfData(Node *node) {
+    auto data = new StaticIfData();
+
+    data->trueImports = vector_init<Node *>(8);
+    data->falseImports = vector_init<Node *>(8);
 
-    node->ifData.trueImpls = vector_init<Node *>(8);
-    node->ifData.falseImpls = vector_init<Node *>(8);
+    data->trueImpls = vector_init<Node *>(8);
+    data->falseImpls = vector_init<Node *>(8);
 
-    node->ifData.trueContexts = vector_init<Node *>(8);
-    node->ifData.trueContextInits = vector_init<Node *>(8);
+    data->trueContexts = vector_init<Node *>(8);
+    data->trueContextInits = vector_init<Node *>(8);
 
-    node->ifData.falseContexts = vector_init<Node *>(8);
-    node->ifData.falseContextInits = vector_init<Node *>(8);
+    data->falseContexts = vector_init<Node *>(8);
+    data->falseContextInits = vector_init<Node *>(8);
+
+    node->ifData.staticIfData = data;
+}
+
+void appendStmt(vector_t<Node *> *&stmts, Node *stmt) {
+    if (stmts == nullptr) {
+        stmts = (vector_t<Node *> *) malloc(sizeof(vector_t<Node *>));
+        *stmts = vector_init<Node *>(2);
+    }
+    vector_append(*stmts, stmt);
 }
 
 void initStructLiteralData(Node *node) {
@@ -454,7 +481,7 @@ Node *makeArrayType(Node *elementType) {
     auto ptrTy = new Node(NodeTypekind::POINTER);
     ptrTy->typeData.pointerTypeData.underlyingType = elementType;
 
-    auto countTy = new Node(NodeTypekind::I64);
+    auto countTy = canonicalType(NodeTypekind::I64);
 
     auto arrayType = new Node(NodeTypekind::STRUCT);
     initStructTypeData(arrayType);
@@ -469,6 +496,79 @@ Node *makeArrayType(Node *elementType) {
     return arrayType;
 }
 
+hash_t<int32_t, Node *> *canonicalTypes = nullptr;
+hash_t<Node *, Node *> *canonicalArrayTypes = nullptr;
+hash_t<int64_t, Node *> *canonicalBufferTypes = nullptr;
+
+// makeArrayType gets called while parsing, which can happen on several threads
+recursive_mutex canonicalTypesLock;
+
+Node *canonicalType(NodeTypekind kind) {
+    cpi_assert(kind == NodeTypekind::NONE
+               || kind == NodeTypekind::U8
+               || kind == NodeTypekind::I8
+               || kind == NodeTypekind::U16
+               || kind == NodeTypekind::I16
+               || kind == NodeTypekind::U32
+               || kind == NodeTypekind::I32
+               || kind == NodeTypekind::U64
+               || kind == NodeTypekind::I64
+               || kind == NodeTypekind::F32
+               || kind == NodeTypekind::F64);
+
+    lock_guard<recursive_mutex> guard(canonicalTypesLock);
+
+    if (canonicalTypes == nullptr) {
+        canonicalTypes = hash_init<int32_t, Node *>(16);
+    }
+
+    auto found = hash_get(canonicalTypes, (int32_t) kind);
+    if (found != nullptr) { return *found; }
+
+    auto type = new Node(kind);
+    hash_insert(canonicalTypes, (int32_t) kind, type);
+    return type;
+}
+
+Node *canonicalArrayType(Node *elementType) {
+    lock_guard<recursive_mutex> guard(canonicalTypesLock);
+
+    if (canonicalArrayTypes == nullptr) {
+        canonicalArrayTypes = hash_init<Node *, Node *>(64);
+    }
+
+    auto found = hash_get(canonicalArrayTypes, elementType);
+    if (found != nullptr) { return *found; }
+
+    auto type = makeArrayType(elementType);
+    hash_insert(canonicalArrayTypes, elementType, type);
+    return type;
+}
+
+Node *canonicalBufferType(int64_t size) {
+    auto words = (size + 7) / 8;
+
+    lock_guard<recursive_mutex> guard(canonicalTypesLock);
+
+    if (canonicalBufferTypes == nullptr) {
+        canonicalBufferTypes = hash_init<int64_t, Node *>(64);
+    }
+
+    auto found = hash_get(canonicalBufferTypes, words);
+    if (found != nullptr) { return *found; }
+
+    auto type = new Node(NodeTypekind::STRUCT);
+    initStructTypeData(type);
+
+    type->typeData.structTypeData.params = vector_init<Node *>(words > 0 ? (unsigned long) words : 1);
+    for (auto i = 0; i < words; i++) {
+        vector_append(type->typeData.structTypeData.params, wrapInDeclParam(canonicalType(NodeTypekind::I64), "", i));
+    }
+
+    hash_insert(canonicalBufferTypes, words, type);
+    return type;
+}
+
 Node *wrapInValueParam(Node *value, Node *name) {
     auto valueParam = new Node(value->region);
     valueParam->type = NodeType::VALUE_PARAM;
@@ -6,13 +6,36 @@
 #include "lexer.h"
 #include "util.h"
 
+struct StructLayout {
+    int32_t size;
+    int32_t alignment;
+
+    // indexed like structTypeData.params
+    vector_t<int32_t> offsets;
+};
+
 int32_t typeSize(Node *type);
 int32_t typeAlign(Node *type);
+StructLayout structLayout(Node *type);
+
+// where param (one of the struct type's DECL_PARAMs) starts, from the type's layout
+int32_t structFieldOffset(Node *type, Node *param);
+
+// drops every memoized layout, see Semantic::sizeStructs
+void forgetStructLayouts();
 
 ostream &operator<<(ostream &os, NodeType type);
 
 Node *makeArrayType(Node *elementType);
 
+// interned type nodes: one shared node per type, so matching ones are pointer-equal.
+// only kinds that are never rewritten in place by typesMatch/makeTypeConcrete can be interned, so no literal kinds and no boolean
+Node *canonicalType(NodeTypekind kind);
+Node *canonicalArrayType(Node *elementType);
+
+// just `size` bytes of storage, rounded up to whole i64s. for locals that only ever get copied into
+Node *canonicalBufferType(int64_t size);
+
 Node *wrapInValueParam(Node *value, Node *name);
 Node *wrapInValueParam(Node *value, string name);
 Node *wrapInValueParam(Node *value, int64_t atomId);
@@ -25,6 +48,7 @@ void initArrayLiteralData(Node *node);
 void initCastData(Node *node);
 void initWhileData(Node *node);
 void initIfData(Node *node);
+void initStaticIfData(Node *node);
 void initStructLiteralData(Node *node);
 void initDotData(Node *node);
 void initBinopData(Node *node);
@@ -35,6 +59,9 @@ void initAttrofData(Node *node);
 void initDeclData(Node *node);
 void initParamData(Node *node);
 void initFnDeclData(Node *node);
+
+// appends to a node's preStmts/postStmts, allocating them if this is the first
+void appendStmt(vector_t<Node *> *&stmts, Node *stmt);
 void initStructTypeData(Node *node);
 void initEnumTypeData(Node *node);
 void initFnTypeData(Node *node);
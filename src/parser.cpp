@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include "parser.h"
+#include "threadpool.h"
 
 Parser::Parser(Lexer *lexer_) {
     lexer = lexer_;
@@ -23,6 +24,8 @@ Parser::Parser(Lexer *lexer_) {
 
     allTopLevel = vector_init<Node *>(256);
 
+    importDirectives = vector_init<ImportDirective>(4);
+
     scopes.push(new Scope(nullptr));
 
     staticIfScope = scopes.top();
@@ -34,9 +37,10 @@ void Parser::popFront() {
 }
 
 void Parser::reportError(string error) {
-    cout << *last.region.srcInfo.fileName << ":"
-         << last.region.start.line << ":"
-         << last.region.start.col << ":"
+    auto lineCol = lineColFor(last.region.srcInfo, last.region.start);
+    cout << *sourceFileFor(last.region.srcInfo)->fileName << ":"
+         << lineCol.line << ":"
+         << lineCol.col << ":"
          << Colored<string>{"error: ", {Color::FG_RED}, true}
          << error << endl;
 }
@@ -76,7 +80,7 @@ void Parser::scopeInsert(int64_t atomId, Node *node) {
     auto found = hash_get(_scope->symbols, atomId);
     if (found != nullptr) {
         ostringstream s("");
-        s << "redeclaration of symbol '" << atomTable->backwardAtoms[atomId] << "'";
+        s << "redeclaration of symbol '" << atomTable->nameOf(atomId) << "'";
         reportError(s.str());
     }
 
@@ -98,13 +102,23 @@ void Parser::initContext(Node *decl) {
     vector_append(decl->fnDeclData.body, contextDecl);
 }
 
+ThreadPool *importPool = nullptr;
+
+// guards importedFileModules and importParsers while imports are parsed concurrently
+mutex importsLock;
+
+// the parser which produced each imported file module, so finishImports can collect its contexts
+hash_t<Node *, Parser *> *importParsers = nullptr;
+
 Node *Parser::addImport(string importName, Node *alias) {
     auto concatPath = importName + ".cpi";
 
     auto rpath = realpath(concatPath.c_str(), nullptr);
     if (rpath == nullptr) {
-        auto home = strdup(getenv("HOME"));
-        rpath = realpath(string(strcat(home, "/.cpi/include/") + concatPath).c_str(), nullptr);
+        auto home = getenv("HOME");
+        if (home != nullptr) {
+            rpath = realpath((string(home) + "/.cpi/include/" + concatPath).c_str(), nullptr);
+        }
     }
     if (rpath == nullptr) {
         // this doesn't exist. Might not be an issue (that's for semantic to decide), but definitely don't continue
@@ -112,6 +126,7 @@ Node *Parser::addImport(string importName, Node *alias) {
     }
 
     auto path = string(rpath);
+    free(rpath);
 
     unsigned long lastSlash = 0;
     unsigned long lastDot = 0;
@@ -125,45 +140,122 @@ Node *Parser::addImport(string importName, Node *alias) {
     }
     auto defaultImportName = path.substr(lastSlash + 1, lastDot - (lastSlash + 1));
 
-    auto found = false;
-
     auto importAtomId = atomTable->insertStr(defaultImportName);
     if (alias != nullptr) {
         importAtomId = alias->symbolData.atomId;
     }
 
+    auto fullImportAtomId = atomTable->insertStr(path);
+
+    unique_lock<mutex> guard(importsLock);
+
     for (auto i : importedFileModules) {
-        auto iName = atomTable->backwardAtoms[i->moduleData.fullImportAtomId].c_str();
-        if (strcmp(iName, path.c_str()) == 0) {
+        if (i->moduleData.fullImportAtomId == fullImportAtomId) {
+            guard.unlock();
+
+            if (importPool != nullptr) {
+                vector_append(importDirectives, ImportDirective{i, this->contexts, this->contextInits});
+            }
             scopeInsert(importAtomId, i);
 
             return i;
         }
     }
 
-    if (!found) {
-        auto lexer = new Lexer(new string(path), nullptr);
-        auto parser = new Parser(lexer);
-        parser->contexts = this->contexts;
-        parser->contextInits = this->contextInits;
+    auto lexer = new Lexer(new string(path), nullptr);
+    auto parser = new Parser(lexer);
 
-        auto fileModule = new Node(lexer->srcInfo, NodeType::MODULE, nullptr);
-        fileModule->moduleData.name = new Node(lexer->srcInfo, NodeType::SYMBOL, parser->scopes.top());
-        fileModule->moduleData.name->symbolData.atomId = atomTable->insertStr(importName);
-        fileModule->moduleData.fullImportAtomId = atomTable->insertStr(path);
-        vector_append(importedFileModules, fileModule);
+    auto fileModule = new Node(lexer->srcInfo, NodeType::MODULE, nullptr);
+    fileModule->moduleData.name = new Node(lexer->srcInfo, NodeType::SYMBOL, parser->scopes.top());
+    fileModule->moduleData.name->symbolData.atomId = atomTable->insertStr(importName);
+    fileModule->moduleData.fullImportAtomId = fullImportAtomId;
+    fileModule->scope = parser->scopes.top();
+    vector_append(importedFileModules, fileModule);
 
-        fileModule->scope = parser->scopes.top();
-        parser->parseRoot();
+    if (importPool != nullptr) {
+        // the module is registered before it's parsed, so nobody else starts on the same file.
+        // its contexts are kept separate for now and merged in a fixed order by finishImports
+        if (importParsers == nullptr) {
+            importParsers = hash_init<Node *, Parser *>(64);
+        }
+        hash_insert(importParsers, fileModule, parser);
+        guard.unlock();
 
-        fileModule->moduleData.stmts = parser->allTopLevel;
+        importPool->submit([parser, fileModule]() {
+            parser->parseRoot();
+            fileModule->moduleData.stmts = parser->allTopLevel;
+        });
 
+        vector_append(importDirectives, ImportDirective{fileModule, this->contexts, this->contextInits});
         scopeInsert(importAtomId, fileModule);
 
         return fileModule;
     }
 
-    return nullptr;
+    guard.unlock();
+
+    parser->contexts = this->contexts;
+    parser->contextInits = this->contextInits;
+    parser->parseRoot();
+
+    fileModule->moduleData.stmts = parser->allTopLevel;
+
+    scopeInsert(importAtomId, fileModule);
+
+    return fileModule;
+}
+
+Parser *parseProgram(const string &inputFile) {
+    auto lexer = new Lexer(new string(inputFile), nullptr);
+    auto parser = new Parser(lexer);
+
+    auto fileModule = new Node(lexer->srcInfo, NodeType::MODULE, parser->scopes.top());
+    vector_append(importedFileModules, fileModule);
+    fileModule->moduleData.name = new Node(lexer->srcInfo, NodeType::SYMBOL, parser->scopes.top());
+    fileModule->moduleData.fullImportAtomId = atomTable->insertStr(inputFile);
+    auto f = inputFile.substr(0, inputFile.length() - 4);
+    fileModule->moduleData.name->symbolData.atomId = atomTable->insertStr(f);
+    fileModule->moduleData.stmts = parser->allTopLevel;
+
+    importPool = new ThreadPool(defaultThreadCount());
+    parser->parseRoot();
+    parser->finishImports();
+    delete importPool;
+    importPool = nullptr;
+
+    return parser;
+}
+
+void forgetParsedModules() {
+    importedFileModules.length = 0;
+    importParsers = nullptr;
+}
+
+void mergeImportContexts(Parser *parser, hash_t<Node *, bool> *merged) {
+    for (auto directive : parser->importDirectives) {
+        if (hash_get(merged, directive.module) != nullptr) { continue; }
+        hash_insert(merged, directive.module, true);
+
+        auto imported = *hash_get(importParsers, directive.module);
+        mergeImportContexts(imported, merged);
+
+        for (auto context : *imported->contexts) {
+            vector_append(*directive.contexts, context);
+        }
+        for (auto contextInit : *imported->contextInits) {
+            vector_append(*directive.contextInits, contextInit);
+        }
+    }
+}
+
+void Parser::finishImports() {
+    if (importPool == nullptr) { return; }
+
+    importPool->wait();
+
+    // walk the import graph depth first from here, so the merged order doesn't depend on which thread finished first
+    auto merged = hash_init<Node *, bool>(64);
+    mergeImportContexts(this, merged);
 }
 
 void Parser::addBasicImport() {
@@ -381,11 +473,11 @@ Node *makeAutoPolyCtParam(Node *originalParam) {
     auto paramType = originalParam->paramData.type;
     cpi_assert(paramType->type == NodeType::TYPE);
     cpi_assert(paramType->typeData.kind == NodeTypekind::SYMBOL);
-    auto paramTypeDebug = atomTable->backwardAtoms[paramType->typeData.symbolTypeData.atomId];
+    auto paramTypeDebug = atomTable->nameOf(paramType->typeData.symbolTypeData.atomId);
 
     auto paramName = originalParam->paramData.name;
     cpi_assert(paramName->type == NodeType::SYMBOL);
-    auto paramNameDebug = atomTable->backwardAtoms[paramName->symbolData.atomId];
+    auto paramNameDebug = atomTable->nameOf(paramName->symbolData.atomId);
 
     auto newParam = new Node(originalParam->region.srcInfo, NodeType::DECL_PARAM, originalParam->scope);
 
@@ -973,11 +1065,13 @@ Node *Parser::parseIf() {
     auto savedContextInits = this->contextInits;
 
     if (isStatic) {
+        initStaticIfData(if_);
+
         this->staticIfScope = scopes.top();
-        this->imports = &if_->ifData.trueImports;
-        this->impls = &if_->ifData.trueImpls;
-        this->contexts = &if_->ifData.trueContexts;
-        this->contextInits = &if_->ifData.trueContextInits;
+        this->imports = &if_->ifData.staticIfData->trueImports;
+        this->impls = &if_->ifData.staticIfData->trueImpls;
+        this->contexts = &if_->ifData.staticIfData->trueContexts;
+        this->contextInits = &if_->ifData.staticIfData->trueContextInits;
     }
 
     expect(LexerTokenType::LCURLY, "{");
@@ -996,9 +1090,9 @@ Node *Parser::parseIf() {
 
     if (isStatic) {
         this->staticIfScope = savedStaticIfScope;
-        this->imports = &if_->ifData.falseImports;
-        this->contexts = &if_->ifData.falseContexts;
-        this->contextInits = &if_->ifData.falseContextInits;
+        this->imports = &if_->ifData.staticIfData->falseImports;
+        this->contexts = &if_->ifData.staticIfData->falseContexts;
+        this->contextInits = &if_->ifData.staticIfData->falseContextInits;
     }
 
     if (lexer->front.type == LexerTokenType::ELSE) {
@@ -1126,27 +1220,43 @@ Node *Parser::parseFor() {
     return for_;
 }
 
-void Parser::possiblyInsertDeferreds(Node *node, bool isReturn) {
-    if (node->scope->insertedDeferredStmts) {
-        return;
-    }
-    node->scope->insertedDeferredStmts = true;
-
-    auto scope = node->scope;
+bool insertDeferreds(Node *node, Scope *scope, bool isReturn, Scope *openScope) {
     if (isReturn) {
         while (!scope->isFunctionScope) {
             for (auto i = static_cast<int64_t>(scope->deferredStmts.length - 1); i >= 0; i--) {
                 auto stmt = vector_at(scope->deferredStmts, static_cast<unsigned long>(i));
                 stmt->isDeferred = true;
-                vector_append(node->preStmts, stmt);
+                appendStmt(node->preStmts, stmt);
             }
             scope = scope->parent;
+
+            if (scope == openScope) {
+                return false;
+            }
         }
     }
     for (auto i = static_cast<int64_t>(scope->deferredStmts.length - 1); i >= 0; i--) {
         auto stmt = vector_at(scope->deferredStmts, static_cast<unsigned long>(i));
         stmt->isDeferred = true;
-        vector_append(node->preStmts, stmt);
+        appendStmt(node->preStmts, stmt);
+    }
+
+    return true;
+}
+
+void Parser::possiblyInsertDeferreds(Node *node, bool isReturn) {
+    if (node->scope == copyRootScope) {
+        vector_append(*openDeferreds, node);
+        return;
+    }
+
+    if (node->scope->insertedDeferredStmts) {
+        return;
+    }
+    node->scope->insertedDeferredStmts = true;
+
+    if (!insertDeferreds(node, node->scope, isReturn, copyRootScope)) {
+        vector_append(*openDeferreds, node);
     }
 }
 
@@ -2007,8 +2117,8 @@ Node *Parser::parseIntLiteral() {
 
     ostringstream s("");
     for (auto i = node->region.start.byteIndex; i < node->region.end.byteIndex; i++) {
-        if (node->region.srcInfo.source->at(i) != '_') {
-            s << node->region.srcInfo.source->at(i);
+        if (lexer->source->at(i) != '_') {
+            s << lexer->source->at(i);
         }
     }
 
@@ -2034,8 +2144,8 @@ Node *Parser::parseFloatLiteral() {
 
     ostringstream s("");
     for (auto i = node->region.start.byteIndex; i < node->region.end.byteIndex; i++) {
-        if (lexer->srcInfo.source->at(i) != '_') {
-            s << lexer->srcInfo.source->at(i);
+        if (lexer->source->at(i) != '_') {
+            s << lexer->source->at(i);
         }
     }
 
@@ -2053,9 +2163,9 @@ Node *Parser::parseStringLiteral() {
 
     ostringstream s("");
     for (auto i = node->region.start.byteIndex + 1; i < node->region.end.byteIndex - 1; i++) {
-        if (node->region.srcInfo.source->at(i) == '\\') {
-            cpi_assert(node->region.srcInfo.source->size() > i + 1);
-            switch (node->region.srcInfo.source->at(i + 1)) {
+        if (lexer->source->at(i) == '\\') {
+            cpi_assert(lexer->source->size() > i + 1);
+            switch (lexer->source->at(i + 1)) {
                 case 'n': {
                     s << '\n';
                 } break;
@@ -2073,7 +2183,7 @@ Node *Parser::parseStringLiteral() {
             i = i + 1;
         }
         else {
-            s << node->region.srcInfo.source->at(i);
+            s << lexer->source->at(i);
         }
     }
 
@@ -2181,7 +2291,7 @@ Node *Parser::parseContext() {
             param = parseDeclParam();
             param->paramData.isContext = true;
 
-            auto debugName = atomTable->backwardAtoms[param->paramData.name->symbolData.atomId];
+            auto debugName = atomTable->nameOf(param->paramData.name->symbolData.atomId);
 
             vector_append(context->contextData.decls, param);
         }
@@ -2192,7 +2302,7 @@ Node *Parser::parseContext() {
         param = parseDeclParam();
         param->paramData.isContext = true;
 
-        auto debugName = atomTable->backwardAtoms[param->paramData.name->symbolData.atomId];
+        auto debugName = atomTable->nameOf(param->paramData.name->symbolData.atomId);
 
         vector_append(context->contextData.decls, param);
     }
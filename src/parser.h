@@ -9,9 +9,20 @@
 #include "node.h"
 
 struct Parser;
+class ThreadPool;
 
 extern vector_t<Node *> importedFileModules;
 
+// only set while the root file is being parsed. imported files are parsed on it concurrently
+extern ThreadPool *importPool;
+
+// an import seen while parsing with importPool, and where the imported file's contexts should end up
+struct ImportDirective {
+    Node *module;
+    vector_t<Node *> *contexts;
+    vector_t<Node *> *contextInits;
+};
+
 enum class ShuntingYardType {
     NODE,
     OP
@@ -27,6 +38,10 @@ struct ShuntingYard {
     ShuntingYardData data = {};
 };
 
+// appends the deferred stmts that run when node leaves scope (for a return, up through the enclosing fn's scope).
+// returns false without finishing if the walk reaches openScope
+bool insertDeferreds(Node *node, Scope *scope, bool isReturn, Scope *openScope);
+
 struct Parser {
     Lexer *lexer = nullptr;
     LexerToken last;
@@ -43,8 +58,15 @@ struct Parser {
     vector_t<Node *> *contexts;
     vector_t<Node *> *contextInits;
 
+    vector_t<ImportDirective> importDirectives;
+
     Scope *staticIfScope = nullptr;
 
+    // only set while parsing a copy template. its root scope stands in for whichever scope the copy goes into,
+    // so deferreds past it aren't known yet: nodes that need them are collected in openDeferreds instead
+    Scope *copyRootScope = nullptr;
+    vector_t<Node *> *openDeferreds = nullptr;
+
     explicit Parser(Lexer *lexer_);
 
     void popFront();
@@ -63,6 +85,7 @@ struct Parser {
     void initContext(Node *decl);
     void addBasicImport();
     Node *addImport(string importName, Node *alias);
+    void finishImports();
     void addContextParameterForDecl(vector_t<Node *> &currentParams, Scope *scope);
 
     void parseRoot();
@@ -112,4 +135,10 @@ struct Parser {
     Node *parseContextInit();
 };
 
+// lex and parse a whole program: the input file and, concurrently, everything it imports
+Parser *parseProgram(const string &inputFile);
+
+// the next parse starts over instead of reusing modules that were already parsed, e.g. because a file changed
+void forgetParsedModules();
+
 #endif // PARSER_H
\ No newline at end of file
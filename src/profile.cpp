@@ -0,0 +1,153 @@
+#include "profile.h"
+#include "modulecache.h"
+
+#include <fstream>
+#include <sstream>
+
+const uint64_t profileVersion = 1;
+
+string profileKey(Node *node) {
+    auto file = sourceFileFor(node->region.srcInfo);
+    if (file->fileName == nullptr || file->source == nullptr) { return ""; }
+
+    auto lineCol = lineColFor(node->region.srcInfo, node->region.start);
+
+    ostringstream key("");
+    key << *file->fileName << ":" << lineCol.line << ":" << lineCol.col;
+    return key.str();
+}
+
+void recordBranch(ProfileRecorder *recorder, uint64_t index, bool taken) {
+    auto counts = hash_get(recorder->branches, index);
+    if (counts == nullptr) {
+        hash_insert(recorder->branches, index, BranchCounts{});
+        counts = hash_get(recorder->branches, index);
+    }
+
+    if (taken) {
+        counts->taken += 1;
+    } else {
+        counts->notTaken += 1;
+    }
+}
+
+void recordCall(ProfileRecorder *recorder, uint64_t index) {
+    auto count = hash_get(recorder->calls, index);
+    if (count == nullptr) {
+        hash_insert(recorder->calls, index, (uint64_t) 1);
+        return;
+    }
+
+    *count += 1;
+}
+
+// every instantiation of a polymorph (and every copy of a rewritten for) shares its source location,
+// so their counts add up under the one key
+void addBranchCounts(Profile *profile, const string &key, BranchCounts counts) {
+    auto existing = hash_get(profile->branches, key);
+    if (existing == nullptr) {
+        hash_insert(profile->branches, key, counts);
+        return;
+    }
+
+    existing->taken += counts.taken;
+    existing->notTaken += counts.notTaken;
+}
+
+void addCalls(Profile *profile, const string &key, uint64_t count) {
+    auto existing = hash_get(profile->calls, key);
+    if (existing == nullptr) {
+        hash_insert(profile->calls, key, count);
+    } else {
+        *existing += count;
+        count = *existing;
+    }
+
+    profile->maxCalls = max(profile->maxCalls, count);
+}
+
+bool writeProfile(const string &path, ProfileRecorder *recorder, SourceMap &sourceMap,
+                  hash_t<uint32_t, uint64_t> *fnTable, vector_t<Node *> &generatedNodes) {
+    Profile profile;
+
+    for (auto &branch : sourceMap.branches) {
+        auto key = profileKey(branch.node);
+        if (key.empty()) { continue; }
+
+        auto counts = hash_get(recorder->branches, (uint64_t) branch.instIndex);
+        addBranchCounts(&profile, key, counts == nullptr ? BranchCounts{} : *counts);
+    }
+
+    for (auto node : generatedNodes) {
+        if (node->type != NodeType::FN_DECL) { continue; }
+        if (node->fnDeclData.isExternal || node->fnDeclData.body.length == 0) { continue; }
+
+        auto key = profileKey(node);
+        auto index = hash_get(fnTable, node->fnDeclData.tableIndex);
+        if (key.empty() || index == nullptr) { continue; }
+
+        auto count = hash_get(recorder->calls, *index);
+        addCalls(&profile, key, count == nullptr ? 0 : *count);
+    }
+
+    ofstream out(path, ios::binary);
+    if (!out) { return false; }
+
+    out << "cpiprof " << profileVersion << "\n";
+
+    out << "branches " << profile.branches->size << "\n";
+    for (auto i = 0; i < profile.branches->bucket_count; i++) {
+        for (auto bucket = profile.branches->buckets[i]; bucket != nullptr; bucket = bucket->next) {
+            writeString(out, bucket->key);
+            out << " " << bucket->value.taken << " " << bucket->value.notTaken << "\n";
+        }
+    }
+
+    out << "calls " << profile.calls->size << "\n";
+    for (auto i = 0; i < profile.calls->bucket_count; i++) {
+        for (auto bucket = profile.calls->buckets[i]; bucket != nullptr; bucket = bucket->next) {
+            writeString(out, bucket->key);
+            out << " " << bucket->value << "\n";
+        }
+    }
+
+    return (bool) out;
+}
+
+bool readProfile(const string &path, Profile *profile) {
+    ifstream in(path, ios::binary);
+    if (!in) { return false; }
+
+    string tag;
+    uint64_t version;
+    in >> tag >> version;
+    if (tag != "cpiprof" || version != profileVersion) { return false; }
+
+    unsigned long branchCount;
+    in >> tag >> branchCount;
+    if (tag != "branches") { return false; }
+
+    for (unsigned long i = 0; i < branchCount; i++) {
+        string key;
+        BranchCounts counts;
+        if (!readString(in, &key)) { return false; }
+        in >> counts.taken >> counts.notTaken;
+
+        addBranchCounts(profile, key, counts);
+    }
+
+    unsigned long callCount;
+    in >> tag >> callCount;
+    if (tag != "calls") { return false; }
+
+    for (unsigned long i = 0; i < callCount; i++) {
+        string key;
+        uint64_t count;
+        if (!readString(in, &key)) { return false; }
+        in >> count;
+
+        addCalls(profile, key, count);
+    }
+
+    return (bool) in;
+}
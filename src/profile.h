@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "node.h"
+
+// how often an if/while condition came out true and false
+struct BranchCounts {
+    uint64_t taken = 0;
+    uint64_t notTaken = 0;
+};
+
+// --profile-out/--profile-in: what the interpreter saw while running the program. keyed by where each if/while and fn
+// is in the source rather than by instruction index, so a native build of the same source can look the counts up
+// on its own AST
+struct Profile {
+    hash_t<string, BranchCounts> *branches = hash_init<string, BranchCounts>(256);
+    hash_t<string, uint64_t> *calls = hash_init<string, uint64_t>(256);
+
+    // a fn is hot relative to the most called one
+    uint64_t maxCalls = 0;
+};
+
+// "<file>:<line>:<col>" of the node, or empty for one that wasn't written in the source (e.g. a tagcheck's if)
+string profileKey(Node *node);
+
+// while interpreting, counts are kept by instruction index, and only turned into source locations when written
+struct ProfileRecorder {
+    // by the index just past each JUMPIF's opcode, see SourceMap::branches
+    hash_t<uint64_t, BranchCounts> *branches = hash_init<uint64_t, BranchCounts>(1024);
+
+    // by the instruction index each fn starts at
+    hash_t<uint64_t, uint64_t> *calls = hash_init<uint64_t, uint64_t>(1024);
+};
+
+void recordBranch(ProfileRecorder *recorder, uint64_t index, bool taken);
+void recordCall(ProfileRecorder *recorder, uint64_t index);
+
+// every if/while and fn the bytecode was generated from gets an entry, so a 0 means it never ran rather than unknown
+bool writeProfile(const string &path, ProfileRecorder *recorder, SourceMap &sourceMap,
+                  hash_t<uint32_t, uint64_t> *fnTable, vector_t<Node *> &generatedNodes);
+bool readProfile(const string &path, Profile *profile);
+
+#endif // PROFILE_H
@@ -4,12 +4,24 @@
 #include "parser.h"
 
 #include <sstream>
+#include <fstream>
 #include <memory>
 #include <utility>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "threadpool.h"
 
 int reusedPolymorphs;
 int newPolymorphs;
-int totalLines;
+atomic<int> totalLines;
+
+thread_local bool Semantic::lvalueAssignmentContext = false;
+thread_local bool Semantic::addressOfContext = false;
+thread_local bool Semantic::dotContext = false;
+thread_local Node *Semantic::currentFnDecl = nullptr;
+thread_local DeferredBody *Semantic::currentBody = nullptr;
+thread_local hash_t<Node *, DeferredBody *> *Semantic::shadowBodies = nullptr;
 
 Node *makeTypeConcrete(Node *typeInfo) {
     auto resolved = resolve(typeInfo);
@@ -37,6 +49,10 @@ bool simpleTypeMatch(Node *t1, Node *t2) {
     t1 = resolve(t1);
     t2 = resolve(t2);
 
+    if (t1 == t2) {
+        return true;
+    }
+
     if (t1->type != NodeType::TYPE || t2->type != NodeType::TYPE) {
         return false;
     }
@@ -122,18 +138,122 @@ bool polymorphMatches(Semantic *semantic, vector_t<Node *> givenParams, vector_t
     return true;
 }
 
-Node *Semantic::findExistingPolymorph(Node *polymorph, vector_t<Node *> givenParams) {
-    for (auto pm : polymorphs) {
-        if (pm.target == polymorph && polymorphMatches(this, givenParams, pm.givenParams)) {
-            reusedPolymorphs += 1;
-            return pm.result;
+uint64_t hashCombine(uint64_t seed, uint64_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+// must agree with simpleTypeMatch: types that match always hash the same
+uint64_t simpleTypeHash(Node *t) {
+    t = resolve(t);
+
+    if (t->type != NodeType::TYPE) {
+        return (uint64_t) t;
+    }
+
+    auto kind = t->typeData.kind;
+    if (kind == NodeTypekind::U8
+        || kind == NodeTypekind::I8
+        || kind == NodeTypekind::U16
+        || kind == NodeTypekind::I16
+        || kind == NodeTypekind::U32
+        || kind == NodeTypekind::I32
+        || kind == NodeTypekind::U64
+        || kind == NodeTypekind::I64
+        || kind == NodeTypekind::F32
+        || kind == NodeTypekind::F64
+        || kind == NodeTypekind::BOOLEAN) {
+        return (uint64_t) kind;
+    }
+    else if (kind == NodeTypekind::STRUCT && t->typeData.structTypeData.isSecretlyArray) {
+        return hashCombine((uint64_t) kind, simpleTypeHash(t->typeData.structTypeData.secretArrayElementType));
+    }
+
+    return (uint64_t) t;
+}
+
+// must agree with polymorphMatches: params that match always hash the same
+uint64_t polymorphKey(Semantic *semantic, Node *target, vector_t<Node *> givenParams) {
+    auto key = hashCombine((uint64_t) target, givenParams.length);
+
+    for (auto origGp : givenParams) {
+        semantic->resolveTypes(origGp);
+
+        auto gp = resolve(origGp->paramData.value);
+        if (gp->type == NodeType::TYPE) {
+            key = hashCombine(key, simpleTypeHash(gp));
+            continue;
+        }
+
+        gp = constantize(semantic, gp);
+        key = hashCombine(key, (uint64_t) gp->type);
+
+        switch (gp->type) {
+            case NodeType::INT_LITERAL: {
+                key = hashCombine(key, (uint64_t) gp->intLiteralData.value);
+            } break;
+            case NodeType::FLOAT_LITERAL: {
+                // 0.0 == -0.0, so they have to hash the same
+                auto value = gp->floatLiteralData.value == 0 ? 0.0 : gp->floatLiteralData.value;
+                uint64_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                key = hashCombine(key, bits);
+            } break;
+            case NodeType::BOOLEAN_LITERAL: {
+                key = hashCombine(key, (uint64_t) gp->boolLiteralData.value);
+            } break;
+            default: {
+                // never matches anything anyway
+                key = hashCombine(key, (uint64_t) gp);
+            } break;
+        }
+    }
+
+    return key;
+}
+
+PolymorphCounts *polymorphCountsFor(Semantic *semantic, Node *target) {
+    auto found = hash_get(semantic->polymorphCountsByTarget, target);
+    if (found != nullptr) { return *found; }
+
+    auto counts = new PolymorphCounts{target, 0, 0};
+    hash_insert(semantic->polymorphCountsByTarget, target, counts);
+    vector_append(semantic->polymorphCounts, counts);
+    return counts;
+}
+
+Node *Semantic::findExistingPolymorph(Node *polymorph, vector_t<Node *> givenParams, uint64_t *key) {
+    *key = polymorphKey(this, polymorph, givenParams);
+
+    auto counts = polymorphCountsFor(this, polymorph);
+
+    auto bucket = hash_get(polymorphs, *key);
+    if (bucket != nullptr) {
+        for (auto pm : **bucket) {
+            if (pm.target == polymorph && polymorphMatches(this, givenParams, pm.givenParams)) {
+                reusedPolymorphs += 1;
+                counts->reused += 1;
+                return pm.result;
+            }
         }
     }
 
     newPolymorphs += 1;
+    counts->made += 1;
     return nullptr;
 }
 
+void Semantic::addPolymorph(uint64_t key, Polymorphed polymorphed) {
+    auto bucket = hash_get(polymorphs, key);
+    if (bucket == nullptr) {
+        auto newBucket = (vector_t<Polymorphed> *) malloc(sizeof(vector_t<Polymorphed>));
+        *newBucket = vector_init<Polymorphed>(1);
+        hash_insert(polymorphs, key, newBucket);
+        bucket = hash_get(polymorphs, key);
+    }
+
+    vector_append(**bucket, polymorphed);
+}
+
 void addContextParameterForCall(Semantic *semantic, Node *node) {
     auto newParams = vector_init<Node *>(node->fnCallData.params.length + 1);
 
@@ -144,7 +264,7 @@ void addContextParameterForCall(Semantic *semantic, Node *node) {
     newParam->symbolData.atomId = contextSym->symbolData.atomId;
 
     // if 'context' is not in scope, then create a new one
-    auto missingContext = node->scope->find(newParam->symbolData.atomId) == nullptr;
+    auto missingContext = semantic->findSymbol(node->scope, newParam->symbolData.atomId) == nullptr;
     if (missingContext) {
         newParam = new Node(node->region.srcInfo, NodeType::CREATE_CONTEXT, node->scope);
     }
@@ -162,13 +282,18 @@ void addContextParameterForCall(Semantic *semantic, Node *node) {
     node->fnCallData.params = newParams;
 }
 
+StructLayout layoutFor(Node *type, bool needOffsets);
+
 int32_t typeAlign(Node *type) {
     auto resolved = resolve(type);
     cpi_assert(resolved->type == NodeType::TYPE);
 
     switch (resolved->typeData.kind) {
         case NodeTypekind::STRUCT: {
-            return resolved->typeData.structTypeData.alignment;
+            if (resolved->typeData.structTypeData.coercedType != nullptr) {
+                return typeAlign(resolved->typeData.structTypeData.coercedType);
+            }
+            return layoutFor(resolved, false).alignment;
         }
         default: {
             return typeSize(resolved);
@@ -179,6 +304,132 @@ int32_t typeAlign(Node *type) {
     return 0;
 }
 
+// non-literal struct layouts never change once computed, so they're memoized.
+// literal struct types can still be coerced or have their params' literal types unified, so those are recomputed every time,
+// into the same entry
+hash_t<Node *, StructLayout *> *structLayouts = hash_init<Node *, StructLayout *>(256);
+
+// bodies are sized on several threads at once
+recursive_mutex structLayoutsLock;
+
+// records offsets into offsets if it isn't null, which has room for every param
+StructLayout computeStructLayout(Node *resolved, vector_t<int32_t> *offsets) {
+    StructLayout layout = {};
+    if (offsets != nullptr) {
+        offsets->length = 0;
+    }
+
+    int32_t total = 0;
+    int32_t largest = 0;
+    int32_t largestAlign = 0;
+
+    int32_t tagSizeInBytes;
+    if (resolved->typeData.structTypeData.isSecretlyUnion && resolved->typeData.structTypeData.unionTagType != nullptr) {
+        tagSizeInBytes = typeSize(resolved->typeData.structTypeData.unionTagType);
+    }
+    else {
+        tagSizeInBytes = 8;
+    }
+
+    for (auto param : resolved->typeData.structTypeData.params) {
+        cpi_assert(param->type == NodeType::DECL_PARAM);
+
+        auto size = typeSize(param->paramData.type);
+        auto align = typeAlign(param->paramData.type);
+
+        // alignment
+        if (align > 0 && total % align > 0) {
+            total += align - (total % align);
+        }
+
+        // if it's a union and we're not assigning to the 'tag' part, then the offset is the size of the tag
+        auto offset = total;
+        if (resolved->typeData.structTypeData.isSecretlyUnion && param->paramData.index > 0) {
+            offset = tagSizeInBytes;
+        }
+        if (offsets != nullptr) {
+            vector_append(*offsets, offset);
+        }
+
+        total += size;
+
+        if (size > largest) {
+            largest = size;
+        }
+        if (align > largestAlign) {
+            largestAlign = align;
+        }
+    }
+
+    if (resolved->typeData.structTypeData.isSecretlyUnion) {
+        total = tagSizeInBytes + largest;
+    }
+
+    // alignment
+    if (largestAlign > 0 && total % largestAlign > 0) {
+        total += largestAlign - (total % largestAlign);
+    }
+
+    resolved->typeData.structTypeData.alignment = largestAlign;
+
+    layout.size = total;
+    layout.alignment = largestAlign;
+    return layout;
+}
+
+StructLayout layoutFor(Node *type, bool needOffsets) {
+    auto resolved = resolve(type);
+    cpi_assert(resolved->type == NodeType::TYPE && resolved->typeData.kind == NodeTypekind::STRUCT);
+
+    lock_guard<recursive_mutex> guard(structLayoutsLock);
+
+    auto isLiteral = resolved->typeData.structTypeData.isLiteral;
+    if (isLiteral && !needOffsets) {
+        return computeStructLayout(resolved, nullptr);
+    }
+
+    auto found = hash_get(structLayouts, resolved);
+    if (found != nullptr && !isLiteral) { return **found; }
+
+    auto layout = found != nullptr ? *found : nullptr;
+    if (layout == nullptr) {
+        layout = new StructLayout();
+        layout->offsets = vector_init<int32_t>(resolved->typeData.structTypeData.params.length + 1);
+        hash_insert(structLayouts, resolved, layout);
+    }
+
+    auto offsets = layout->offsets;
+    *layout = computeStructLayout(resolved, &offsets);
+    layout->offsets = offsets;
+    return *layout;
+}
+
+StructLayout structLayout(Node *type) {
+    return layoutFor(type, true);
+}
+
+int32_t structFieldOffset(Node *type, Node *param) {
+    cpi_assert(param->type == NodeType::DECL_PARAM);
+    return vector_at(structLayout(type).offsets, (unsigned long) param->paramData.index);
+}
+
+void forgetStructLayouts() {
+    lock_guard<recursive_mutex> guard(structLayoutsLock);
+
+    for (auto i = 0; i < structLayouts->bucket_count; i++) {
+        auto bucket = structLayouts->buckets[i];
+        while (bucket != nullptr) {
+            auto next = bucket->next;
+            free(bucket->value->offsets.items);
+            delete bucket->value;
+            delete bucket;
+            bucket = next;
+        }
+        structLayouts->buckets[i] = nullptr;
+    }
+    structLayouts->size = 0;
+}
+
 int32_t typeSize(Node *type) {
     auto resolved = resolve(type);
     cpi_assert(resolved->type == NodeType::TYPE);
@@ -215,58 +466,7 @@ int32_t typeSize(Node *type) {
                 return typeSize(resolved->typeData.structTypeData.coercedType);
             }
 
-            int32_t total = 0;
-            int32_t largest = 0;
-            int32_t largestAlign = 0;
-
-            int32_t tagSizeInBytes;
-            if (resolved->typeData.structTypeData.isSecretlyUnion && resolved->typeData.structTypeData.unionTagType != nullptr) {
-                tagSizeInBytes = typeSize(resolved->typeData.structTypeData.unionTagType);
-            }
-            else {
-                tagSizeInBytes = 8;
-            }
-
-            for (auto param : resolved->typeData.structTypeData.params) {
-                auto size = typeSize(param->paramData.type);
-                auto align = typeAlign(param->paramData.type);
-
-                // alignment
-                if (align > 0 && total % align > 0) {
-                    total += total % align;
-                }
-
-                // if it's a union and we're not assigning to the 'tag' part, then the offset is the size of the tag
-                if (resolved->typeData.structTypeData.isSecretlyUnion && param->paramData.index > 0) {
-                    param->localOffset = tagSizeInBytes;
-                }
-                else {
-                    param->localOffset = total;
-                }
-                cpi_assert(param->type == NodeType::DECL_PARAM);
-
-                total += size;
-
-                if (size > largest) {
-                    largest = size;
-                }
-                if (align > largestAlign) {
-                    largestAlign = align;
-                }
-            }
-
-            if (resolved->typeData.structTypeData.isSecretlyUnion) {
-                total = tagSizeInBytes + largest;
-            }
-
-            // alignment
-            if (largestAlign > 0 && total % largestAlign > 0) {
-                total += largestAlign - (total % largestAlign);
-            }
-
-            resolved->typeData.structTypeData.alignment = largestAlign;
-
-            return total;
+            return layoutFor(resolved, false).size;
         }
         default: cpi_assert(false);
     }
@@ -315,7 +515,7 @@ int maybeMatchUnionToStructLiteral(Node *desired, Node *actual, Semantic *semant
         cpi_assert(vector_at(other->typeData.structTypeData.params, 0)->paramData.name->type == NodeType::SYMBOL);
         auto otherAtomId = vector_at(other->typeData.structTypeData.params, 0)->paramData.name->symbolData.atomId;
 
-        auto debugAtom = atomTable->backwardAtoms[otherAtomId];
+        auto debugAtom = atomTable->nameOf(otherAtomId);
 
         auto paramIndex = 0;
         for (auto p : unionToMatchAgainst->typeData.structTypeData.params) {
@@ -816,7 +1016,7 @@ void addAllFromScopeToScope(Semantic *semantic, Scope *from, Scope *to, bool for
             auto found = hash_get(to->symbols, bucket->key);
             if (found != nullptr) {
                 ostringstream s("");
-                s << "redeclaration of symbol '" << atomTable->backwardAtoms[bucket->key] << "', from import";
+                s << "redeclaration of symbol '" << atomTable->nameOf(bucket->key) << "', from import";
                 semantic->reportError({}, Error{(*found)->region, s.str()});
             }
 
@@ -834,7 +1034,7 @@ void addAllFromScopeToScope(Semantic *semantic, Scope *from, Scope *to, bool for
                 found = hash_get(to->symbols, bucket->key);
                 if (found != nullptr) {
                     ostringstream s("");
-                    s << "redeclaration of symbol '" << atomTable->backwardAtoms[bucket->key] << "', from import";
+                    s << "redeclaration of symbol '" << atomTable->nameOf(bucket->key) << "', from import";
                     semantic->reportError({}, Error{(*found)->region, s.str()});
                 }
 
@@ -868,13 +1068,15 @@ void Semantic::addStaticIfs(Scope *targetScope, Scope *importInto) {
         cpi_assert(ifStmt->ifData.condition->staticValue->type == NodeType::BOOLEAN_LITERAL);
 
         if (ifStmt->ifData.condition->staticValue->boolLiteralData.value && ifStmt->ifData.stmts.length > 0) {
-            addImports(ifStmt->ifData.trueImports, ifStmt->ifData.trueImpls, ifStmt->ifData.trueContexts, ifStmt->ifData.trueContextInits);
+            auto data = ifStmt->ifData.staticIfData;
+            addImports(data->trueImports, data->trueImpls, data->trueContexts, data->trueContextInits);
 
             addAllFromScopeToScope(this, ifStmt->ifData.ifScope, ii, true);
             addStaticIfs(ifStmt->ifData.ifScope, ifStmt->scope);
         }
         else if (!ifStmt->ifData.condition->staticValue->boolLiteralData.value && ifStmt->ifData.elseStmts.length > 0) {
-            addImports(ifStmt->ifData.falseImports, ifStmt->ifData.falseImpls, ifStmt->ifData.falseContexts, ifStmt->ifData.falseContextInits);
+            auto data = ifStmt->ifData.staticIfData;
+            addImports(data->falseImports, data->falseImpls, data->falseContexts, data->falseContextInits);
 
             addAllFromScopeToScope(this, ifStmt->ifData.elseScope, ii, true);
             addStaticIfs(ifStmt->ifData.elseScope, ifStmt->scope);
@@ -918,6 +1120,8 @@ void Semantic::addImports(vector_t<Node *> imports, vector_t<Node *> impls, vect
 }
 
 void Semantic::reportError(vector<Node *> nodes, Error error) {
+    lock_guard<recursive_mutex> guard(sharedLock);
+
     encounteredErrors = true;
 
     auto seenBefore = false;
@@ -944,6 +1148,15 @@ void Semantic::reportError(vector<Node *> nodes, Error error) {
           << Colored<string>{note.message, {Color::FG_BLUE}, true};
     }
 
+    if (currentBody != nullptr && currentBody->isShadow) {
+        shadowErrors.push_back(s.str() + "\n");
+        return;
+    }
+    if (currentBody != nullptr) {
+        currentBody->errors += s.str() + "\n";
+        return;
+    }
+
     cout << s.str() << endl;
 }
 
@@ -979,6 +1192,7 @@ void resolveUnaryBitNot(Semantic *semantic, Node *node) {
 }
 
 void resolveLink(Semantic *semantic, Node *node) {
+    lock_guard<recursive_mutex> guard(semantic->sharedLock);
     vector_append(semantic->linkLibs, node->linkData.name);
 }
 
@@ -1081,7 +1295,7 @@ Node *Semantic::makeContextType() {
 
     for (auto context: contexts) {
         for (auto decl: context->contextData.decls) {
-            auto debugName = atomTable->backwardAtoms[decl->declData.lhs->symbolData.atomId];
+            auto debugName = atomTable->nameOf(decl->declData.lhs->symbolData.atomId);
             vector_append(ct->typeData.structTypeData.params, decl);
         }
     }
@@ -1110,6 +1324,8 @@ void resolveCreateContext(Semantic *semantic, Node *node) {
     node->typeInfo = addrOfContext->typeInfo;
 }
 
+void checkFnBody(Semantic *semantic, Node *node);
+
 void resolveFnDecl(Semantic *semantic, Node *node) {
     auto data = &node->fnDeclData;
 
@@ -1148,8 +1364,7 @@ void resolveFnDecl(Semantic *semantic, Node *node) {
         semantic->addLocal(param);
     }
 
-    data->tableIndex = fnTableId;
-    fnTableId += 1;
+    data->tableIndex = fnTableId++;
 
     for (auto param : data->ctParams) {
         semantic->resolveTypes(param);
@@ -1173,14 +1388,14 @@ void resolveFnDecl(Semantic *semantic, Node *node) {
 
     if (data->body.length == 0) {
         if (data->returnType == nullptr) {
-            data->returnType = new Node(NodeTypekind::NONE);
+            data->returnType = canonicalType(NodeTypekind::NONE);
         }
     }
     else if (data->returnType != nullptr && data->returns.length == 0) {
         semantic->reportError({node}, Error{node->region, "fn has a return type, but there are no return statements!"});
     }
     else if (data->returns.length == 0) {
-        data->returnType = new Node(NodeTypekind::NONE);
+        data->returnType = canonicalType(NodeTypekind::NONE);
     }
 
     if (data->returnType == nullptr) {
@@ -1220,12 +1435,33 @@ void resolveFnDecl(Semantic *semantic, Node *node) {
     if (data->returnType == nullptr) {
         ostringstream s("");
         s << "could not resolve return type for fn '"
-          << atomTable->backwardAtoms[data->name->symbolData.atomId]
+          << atomTable->nameOf(data->name->symbolData.atomId)
           << "'";
 
         semantic->reportError({node}, Error{node->region, s.str()});
     }
 
+    // a polymorph's body is checked right away: it can't be copied from source like other bodies (see readyBody),
+    // since the copy wouldn't have its ct params
+    if (semantic->deferBodies && Semantic::currentBody == nullptr && data->bodyScope != nullptr && !data->cameFromPolymorph) {
+        auto body = new DeferredBody();
+        body->fn = node;
+        vector_append(semantic->deferredBodies, body);
+        hash_insert(semantic->deferredBodyFor, node, body);
+    }
+    else {
+        checkFnBody(semantic, node);
+    }
+
+    semantic->currentFnDecl = savedFnDecl;
+}
+
+void checkFnBody(Semantic *semantic, Node *node) {
+    auto data = &node->fnDeclData;
+
+    auto savedFnDecl = semantic->currentFnDecl;
+    semantic->currentFnDecl = node;
+
     for (auto stmt : data->body) {
         semantic->resolveTypes(stmt);
     }
@@ -1307,7 +1543,7 @@ void resolveReturn(Semantic *semantic, Node *node) {
         node->typeInfo = node->retData.value->typeInfo;
     }
     else {
-        node->typeInfo = new Node(NodeTypekind::NONE);
+        node->typeInfo = canonicalType(NodeTypekind::NONE);
     }
 }
 
@@ -1316,7 +1552,9 @@ void resolveFloatLiteral(Semantic *semantic, Node *node) {
         node->typeInfo = new Node(NodeTypekind::FLOAT_LITERAL);
     }
 
-    node->typeInfo->typeData.floatTypeData = node->floatLiteralData.value;
+    if (node->typeInfo->typeData.kind == NodeTypekind::FLOAT_LITERAL) {
+        node->typeInfo->typeData.floatTypeData = node->floatLiteralData.value;
+    }
 }
 
 void resolveIntLiteral(Semantic *semantic, Node *node) {
@@ -1324,7 +1562,10 @@ void resolveIntLiteral(Semantic *semantic, Node *node) {
         node->typeInfo = new Node(NodeTypekind::INT_LITERAL);
     }
 
-    node->typeInfo->typeData.intTypeData = node->intLiteralData.value;
+    // the type might be a shared canonical one, only literal types carry their value
+    if (node->typeInfo->typeData.kind == NodeTypekind::INT_LITERAL) {
+        node->typeInfo->typeData.intTypeData = node->intLiteralData.value;
+    }
 }
 
 void resolveBooleanLiteral(Semantic *semantic, Node *node) {
@@ -1332,7 +1573,358 @@ void resolveBooleanLiteral(Semantic *semantic, Node *node) {
     node->typeInfo->typeData.boolTypeData = node->boolLiteralData.value;
 }
 
+Node *readCompileTimeResult(Interpreter *interp, Node *copied, bool isStringLiteral) {
+    auto resolvedTypeInfo = resolve(copied->typeInfo);
+    auto staticNode = new Node();
+
+    if (isStringLiteral) {
+        staticNode->type = NodeType::STRING_LITERAL;
+
+        auto count = interp->readFromStack<int32_t>(copied->localOffset + 8);
+        auto ptr = (char *) interp->readFromStack<int64_t>(copied->localOffset);
+
+        ostringstream buf("");
+        for (auto i = 0; i < count; i++) {
+            buf << *ptr;
+            ptr += 1;
+        }
+
+        auto stringValue = buf.str();
+
+        staticNode->type = NodeType::STRING_LITERAL;
+        staticNode->stringLiteralData.allocFn = nullptr; // todo(chad): check that there is no allocFn assigned
+        staticNode->stringLiteralData.value = new string(stringValue);
+    }
+    if (resolvedTypeInfo->typeData.kind == NodeTypekind::BOOLEAN_LITERAL || resolvedTypeInfo->typeData.kind == NodeTypekind::BOOLEAN) {
+        auto staticValue = interp->readFromStack<int32_t>(copied->localOffset);
+        staticNode->type = NodeType::BOOLEAN_LITERAL;
+        staticNode->boolLiteralData.value = staticValue != 0;
+    }
+    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::U8 || resolvedTypeInfo->typeData.kind == NodeTypekind::I8) {
+        auto staticValue = interp->readFromStack<int8_t>(copied->localOffset);
+        staticNode->type = NodeType::INT_LITERAL;
+        staticNode->intLiteralData.value = staticValue;
+    }
+    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::U16 || resolvedTypeInfo->typeData.kind == NodeTypekind::I16) {
+        auto staticValue = interp->readFromStack<int16_t>(copied->localOffset);
+        staticNode->type = NodeType::INT_LITERAL;
+        staticNode->intLiteralData.value = staticValue;
+    }
+    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::U32 || resolvedTypeInfo->typeData.kind == NodeTypekind::I32) {
+        auto staticValue = interp->readFromStack<int32_t>(copied->localOffset);
+        staticNode->type = NodeType::INT_LITERAL;
+        staticNode->intLiteralData.value = staticValue;
+    }
+    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::INT_LITERAL
+             || resolvedTypeInfo->typeData.kind == NodeTypekind::U64
+             || resolvedTypeInfo->typeData.kind == NodeTypekind::I64) {
+        auto staticValue = interp->readFromStack<int64_t>(copied->localOffset);
+        staticNode->type = NodeType::INT_LITERAL;
+        staticNode->intLiteralData.value = staticValue;
+    }
+    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::FLOAT_LITERAL || resolvedTypeInfo->typeData.kind == NodeTypekind::F32) {
+        auto staticValue = interp->readFromStack<float>(copied->localOffset);
+        staticNode->type = NodeType::FLOAT_LITERAL;
+        staticNode->floatLiteralData.value = staticValue;
+    }
+    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::F64) {
+        auto staticValue = interp->readFromStack<float>(copied->localOffset);
+        staticNode->type = NodeType::FLOAT_LITERAL;
+        staticNode->floatLiteralData.value = staticValue;
+    }
+    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::NONE) {
+        staticNode->type = NodeType::NIL_LITERAL;
+    }
+
+
+    return staticNode;
+}
+
+const uint64_t fnvOffsetBasis = 14695981039346656037ULL;
+
+uint64_t fnvByte(uint64_t h, unsigned char byte) {
+    return (h ^ byte) * 1099511628211ULL;
+}
+
+uint64_t fnvBytes(uint64_t h, const unsigned char *bytes, unsigned long length) {
+    for (unsigned long i = 0; i < length; i++) {
+        h = fnvByte(h, bytes[i]);
+    }
+    return h;
+}
+
+// the engine's stream holds every compile time run so far, so a run's key only hashes what the run can reach. that's
+// the code walked from its entry (through jumps, calls, and fn values it loads for an indirect call), the read-only
+// data it copies, and the names of the external fns it calls. targets are hashed by the order the walk found them in
+// rather than by where they are in the stream or the fn table, so unrelated code generated earlier doesn't change it
+struct CtfeKeyWalk {
+    BytecodeGen *gen;
+    uint64_t h = fnvOffsetBasis;
+
+    // block starts found so far, and their number in the order they were found
+    hash_t<uint64_t, uint64_t> *found = hash_init<uint64_t, uint64_t>(64);
+    vector<uint64_t> toWalk;
+
+    explicit CtfeKeyWalk(BytecodeGen *gen) : gen(gen) {}
+
+    void hashRaw(uint64_t from, uint64_t to) {
+        h = fnvBytes(h, &gen->instructions[from], to - from);
+    }
+
+    void hashTarget(uint64_t pc) {
+        auto ordinal = hash_get(found, pc);
+        if (ordinal == nullptr) {
+            hash_insert(found, pc, (uint64_t) found->size);
+            toWalk.push_back(pc);
+            ordinal = hash_get(found, pc);
+        }
+        h = hashCombine(h, *ordinal);
+    }
+
+    // a read<T> operand. a RELCONSTI32 is a fn's table index (a fn value), so that fn is reachable too
+    bool hashOperand(uint64_t at, uint64_t valueBytes) {
+        auto &code = gen->instructions;
+        auto tag = (Instruction) code[at];
+        h = fnvByte(h, code[at]);
+
+        if (tag == Instruction::RODATAI64) { return false; }
+
+        if (tag == Instruction::RELCONSTI32) {
+            auto fnStart = hash_get(gen->fnTable, (uint32_t) bytesTo<int32_t>(code, at + 1));
+            if (fnStart != nullptr) {
+                hashTarget(*fnStart);
+                return true;
+            }
+        }
+
+        hashRaw(at + 1, at + operandLength(code, at, valueBytes));
+        return true;
+    }
+
+    // false for anything the walk doesn't know how to follow
+    bool walkBlock(uint64_t pc) {
+        auto &code = gen->instructions;
+        while (pc < code.size()) {
+            auto inst = (Instruction) code[pc];
+            auto end = pc + instructionLength(code, pc);
+            auto p = pc + 1;
+            h = fnvByte(h, code[pc]);
+
+            if (inst <= Instruction::GEF64) {
+                auto bytes = mathOperandBytes(inst);
+                if (!hashOperand(p, bytes)) { return false; }
+                p += operandLength(code, p, bytes);
+                if (!hashOperand(p, bytes)) { return false; }
+                p += operandLength(code, p, bytes);
+                hashRaw(p, end);
+                pc = end;
+                continue;
+            }
+
+            switch (inst) {
+                case Instruction::STORE: {
+                    // copyFromRoData's read: the bytes it copies, not where they ended up
+                    if ((Instruction) code[p] == Instruction::RODATAI64) {
+                        auto size = bytesTo<int32_t>(code, end - sizeof(int32_t));
+                        auto roDataAt = bytesTo<int64_t>(code, p + 1);
+                        h = fnvByte(h, code[p]);
+                        h = fnvBytes(h, &code[roDataAt], (unsigned long) size);
+                    }
+                    else if (!hashOperand(p, sizeof(int64_t))) {
+                        return false;
+                    }
+                    p += operandLength(code, p, sizeof(int64_t));
+                    if (!hashOperand(p, sizeof(int64_t))) { return false; }
+                    p += operandLength(code, p, sizeof(int64_t));
+                    hashRaw(p, end);
+                } break;
+                case Instruction::STORECONST:
+                case Instruction::CALLI:
+                case Instruction::PUTS: {
+                    if (!hashOperand(p, sizeof(int64_t))) { return false; }
+                    p += operandLength(code, p, sizeof(int64_t));
+                    hashRaw(p, end);
+                } break;
+                case Instruction::JUMPIF: {
+                    if (!hashOperand(p, sizeof(int32_t))) { return false; }
+                    p += operandLength(code, p, sizeof(int32_t));
+                    for (auto i = 0; i < 2; i++) {
+                        auto target = constantJumpTarget(code, p);
+                        if (target < 0) { return false; }
+                        hashTarget((uint64_t) target);
+                        p += operandLength(code, p, sizeof(int32_t));
+                    }
+                    return true;
+                }
+                case Instruction::JUMP: {
+                    hashTarget((uint64_t) bytesTo<int32_t>(code, p));
+                    return true;
+                }
+                case Instruction::CALL: {
+                    hashTarget((uint64_t) bytesTo<int32_t>(code, p));
+                } break;
+                case Instruction::CALLE: {
+                    auto callNode = vector_at(gen->externalFnTable, (unsigned long) bytesTo<int32_t>(code, p));
+                    auto name = atomTable->nameOf(resolve(callNode->fnCallData.fn)->fnDeclData.name->symbolData.atomId);
+                    h = fnvBytes(h, (const unsigned char *) name.data(), name.size());
+                } break;
+                case Instruction::RET:
+                case Instruction::EXIT:
+                case Instruction::PANIC:
+                    return true;
+                case Instruction::RODATA:
+                    return false;
+                default: {
+                    hashRaw(p, end);
+                }
+            }
+
+            pc = end;
+        }
+
+        return true;
+    }
+
+    bool walk(uint64_t entryPc) {
+        hashTarget(entryPc);
+        for (unsigned long i = 0; i < toWalk.size(); i++) {
+            if (!walkBlock(toWalk[i])) { return false; }
+        }
+        return true;
+    }
+
+    ~CtfeKeyWalk() {
+        hash_clear(found);
+        free(found->buckets);
+        free(found);
+    }
+};
+
+// compile time results are cached on disk, keyed by the code the run can reach (see CtfeKeyWalk) plus where/what
+// the result is. runs with side effects are never cached
+uint64_t ctfeCacheKey(Semantic *semantic, unsigned long entryPc, Node *copied, bool isStringLiteral) {
+    CtfeKeyWalk walk(semantic->ctfeGen);
+
+    uint64_t h;
+    if (walk.walk(entryPc)) {
+        h = walk.h;
+    }
+    else {
+        // something the walk can't follow, so key on the whole stream and where in it the run starts
+        auto &instructions = semantic->ctfeGen->instructions;
+        h = fnvBytes(fnvOffsetBasis, instructions.data(), instructions.size());
+        h = hashCombine(h, entryPc);
+    }
+
+    h = hashCombine(h, (uint64_t) copied->localOffset);
+    h = hashCombine(h, (uint64_t) resolve(copied->typeInfo)->typeData.kind);
+    h = hashCombine(h, isStringLiteral ? 1 : 0);
+    return h;
+}
+
+string ctfeCachePath(uint64_t key) {
+    auto home = getenv("HOME");
+    if (home == nullptr) { return ""; }
+
+    ostringstream path("");
+    path << home << "/.cpi/cache/" << hex << key;
+    return path.str();
+}
+
+Node *readCtfeCache(uint64_t key) {
+    auto path = ctfeCachePath(key);
+    if (path.empty()) { return nullptr; }
+
+    ifstream in(path, ios::binary);
+    if (!in) { return nullptr; }
+
+    string kind;
+    in >> kind;
+
+    auto staticNode = new Node();
+    if (kind == "int") {
+        staticNode->type = NodeType::INT_LITERAL;
+        in >> staticNode->intLiteralData.value;
+    }
+    else if (kind == "float") {
+        uint64_t bits;
+        in >> hex >> bits;
+        staticNode->type = NodeType::FLOAT_LITERAL;
+        memcpy(&staticNode->floatLiteralData.value, &bits, sizeof(bits));
+    }
+    else if (kind == "bool") {
+        int value;
+        in >> value;
+        staticNode->type = NodeType::BOOLEAN_LITERAL;
+        staticNode->boolLiteralData.value = value != 0;
+    }
+    else if (kind == "nil") {
+        staticNode->type = NodeType::NIL_LITERAL;
+    }
+    else if (kind == "string") {
+        unsigned long length;
+        in >> length;
+        in.get();
+
+        auto value = new string(length, '\0');
+        in.read(&(*value)[0], length);
+
+        staticNode->type = NodeType::STRING_LITERAL;
+        staticNode->stringLiteralData.allocFn = nullptr;
+        staticNode->stringLiteralData.value = value;
+    }
+    else {
+        return nullptr;
+    }
+
+    if (!in) { return nullptr; }
+    return staticNode;
+}
+
+void writeCtfeCache(uint64_t key, Node *staticNode) {
+    auto path = ctfeCachePath(key);
+    if (path.empty()) { return; }
+
+    ostringstream out("");
+    switch (staticNode->type) {
+        case NodeType::INT_LITERAL: {
+            out << "int " << staticNode->intLiteralData.value;
+        } break;
+        case NodeType::FLOAT_LITERAL: {
+            uint64_t bits;
+            memcpy(&bits, &staticNode->floatLiteralData.value, sizeof(bits));
+            out << "float " << hex << bits;
+        } break;
+        case NodeType::BOOLEAN_LITERAL: {
+            out << "bool " << (staticNode->boolLiteralData.value ? 1 : 0);
+        } break;
+        case NodeType::NIL_LITERAL: {
+            out << "nil";
+        } break;
+        case NodeType::STRING_LITERAL: {
+            out << "string " << staticNode->stringLiteralData.value->size() << "\n" << *staticNode->stringLiteralData.value;
+        } break;
+        default: return;
+    }
+
+    auto home = string(getenv("HOME"));
+    mkdir((home + "/.cpi").c_str(), 0755);
+    mkdir((home + "/.cpi/cache").c_str(), 0755);
+
+    // write then rename, so a concurrent compile never reads half an entry
+    auto tmpPath = path + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary);
+        if (!file) { return; }
+        file << out.str();
+    }
+    rename(tmpPath.c_str(), path.c_str());
+}
+
 Node *constantize(Semantic *semantic, Node *node) {
+    // there's only one compile time engine
+    lock_guard<recursive_mutex> guard(semantic->sharedLock);
+
     semantic->resolveTypes(node);
     node = resolve(node);
 
@@ -1376,10 +1968,13 @@ Node *constantize(Semantic *semantic, Node *node) {
         return constNode;
     }
 
-    auto gen = new BytecodeGen();
-    gen->isMainFn = true;
-    gen->sourceMap.sourceInfo = node->region.srcInfo;
-    gen->processFnDecls = true;
+    if (semantic->ctfeGen == nullptr) {
+        semantic->ctfeGen = new BytecodeGen();
+        semantic->ctfeInterp = new Interpreter(semantic->linkLibs);
+        semantic->ctfeInterp->fnTable = semantic->ctfeGen->fnTable;
+    }
+
+    auto gen = semantic->ctfeGen;
 
     auto copied = semantic->deepCopyRvalue(node, node->scope);
     semantic->resolveTypes(copied);
@@ -1407,99 +2002,120 @@ Node *constantize(Semantic *semantic, Node *node) {
         semantic->resolveTypes(copied);
     }
 
-    gen->gen(copied);
-    gen->instructions.push_back((unsigned char) Instruction::EXIT);
-    while (!gen->toProcess.empty()) {
-        gen->isMainFn = false;
+    // whatever gets called needs its body checked before it can be generated. which fns get called is only known
+    // once they're generated, so a run that reaches a body that isn't ready is dropped, the body is readied
+    // (see Semantic::readyBody, which can constantize too), and the run is generated again
+    unsigned long entryPc;
+    while (true) {
+        // resolving above (or checking a body) can constantize other things, which runs the engine and leaves it
+        // in whatever state, so only set it up for this run now
+        gen->isMainFn = true;
+        gen->sourceMap.sourceInfo = node->region.srcInfo;
         gen->processFnDecls = true;
-        gen->gen(gen->toProcess.front());
-        gen->toProcess.pop();
-    }
-    gen->fixup();
+        gen->currentFnStackSize = 0;
 
-    for (auto g : gen->generatedNodes) {
-        g->genId = 0;
-        g->bytecode = {};
-    }
-
-    auto interp = new Interpreter(semantic->linkLibs);
-    interp->instructions = gen->instructions;
-    interp->fnTable = gen->fnTable;
-    interp->sourceMap = gen->sourceMap;
-    interp->externalFnTable = gen->externalFnTable;
-    interp->contextType = semantic->contextType;
-    auto instructions = gen->instructions;
+        entryPc = gen->instructions.size();
+        auto generatedBefore = gen->generatedNodes.length;
+        auto externalFnsBefore = gen->externalFnTable.length;
+        auto statementsBefore = gen->sourceMap.statements.size();
+        auto branchesBefore = gen->sourceMap.branches.size();
 
-    interp->continuing = true;
-    interp->instructions = instructions;
-    interp->fnTable = gen->fnTable;
+        vector<Node *> unready;
 
-//    auto p = new MnemonicPrinter(instructions);
-//    p->fnTable = gen->fnTable;
-//    cout << p->debugString() << endl << endl << endl;
+        gen->gen(copied);
+        gen->instructions.push_back((unsigned char) Instruction::EXIT);
+        while (!gen->toProcess.empty()) {
+            auto fn = gen->toProcess.front();
+            gen->toProcess.pop();
 
-    interp->interpret();
+            auto ready = semantic->compileTimeBody(fn);
+            if (ready == nullptr) {
+                unready.push_back(fn);
+                continue;
+            }
 
-    resolvedTypeInfo = resolve(copied->typeInfo);
-    auto staticNode = new Node();
+            gen->isMainFn = false;
+            gen->processFnDecls = true;
+            gen->gen(ready);
+        }
 
-    if (isStringLiteral) {
-        staticNode->type = NodeType::STRING_LITERAL;
+        if (unready.empty()) { break; }
 
-        auto count = interp->readFromStack<int32_t>(copied->localOffset + 8);
-        auto ptr = (char *) interp->readFromStack<int64_t>(copied->localOffset);
+        // nothing of this run has been fixed up or run yet, so it can all just be dropped
+        gen->instructions.resize(entryPc);
+        for (auto i = generatedBefore; i < gen->generatedNodes.length; i++) {
+            auto g = vector_at(gen->generatedNodes, i);
+            g->genId = 0;
+            g->bytecode = {};
+        }
+        gen->generatedNodes.length = generatedBefore;
+        gen->externalFnTable.length = externalFnsBefore;
+        gen->sourceMap.statements.resize(statementsBefore);
+        gen->sourceMap.branches.resize(branchesBefore);
+        gen->fixups.length = 0;
+        gen->jumpRelocs.length = 0;
+        gen->externalFnRelocs.length = 0;
+        gen->roData.clear();
+        hash_clear(gen->roDataOffsets);
+        gen->roDataRelocs.length = 0;
 
-        ostringstream buf("");
-        for (auto i = 0; i < count; i++) {
-            buf << *ptr;
-            ptr += 1;
+        for (auto fn : unready) {
+            if (!semantic->readyBody(fn)) { return node; }
         }
+    }
+    gen->fixup();
 
-        auto stringValue = buf.str();
+    // every fixup so far points into code that's already been patched, and this buffer never gets relinked
+    gen->fixups.length = 0;
+    gen->jumpRelocs.length = 0;
+    gen->externalFnRelocs.length = 0;
 
-        staticNode->type = NodeType::STRING_LITERAL;
-        staticNode->stringLiteralData.allocFn = nullptr; // todo(chad): check that there is no allocFn assigned
-        staticNode->stringLiteralData.value = new string(stringValue);
-    }
-    if (resolvedTypeInfo->typeData.kind == NodeTypekind::BOOLEAN_LITERAL || resolvedTypeInfo->typeData.kind == NodeTypekind::BOOLEAN) {
-        auto staticValue = interp->readFromStack<int32_t>(copied->localOffset);
-        staticNode->type = NodeType::BOOLEAN_LITERAL;
-        staticNode->boolLiteralData.value = staticValue != 0;
-    }
-    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::U8 || resolvedTypeInfo->typeData.kind == NodeTypekind::I8) {
-        auto staticValue = interp->readFromStack<int8_t>(copied->localOffset);
-        staticNode->type = NodeType::INT_LITERAL;
-        staticNode->intLiteralData.value = staticValue;
-    }
-    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::U16 || resolvedTypeInfo->typeData.kind == NodeTypekind::I16) {
-        auto staticValue = interp->readFromStack<int16_t>(copied->localOffset);
-        staticNode->type = NodeType::INT_LITERAL;
-        staticNode->intLiteralData.value = staticValue;
-    }
-    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::U32 || resolvedTypeInfo->typeData.kind == NodeTypekind::I32) {
-        auto staticValue = interp->readFromStack<int32_t>(copied->localOffset);
-        staticNode->type = NodeType::INT_LITERAL;
-        staticNode->intLiteralData.value = staticValue;
-    }
-    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::INT_LITERAL
-             || resolvedTypeInfo->typeData.kind == NodeTypekind::U64
-             || resolvedTypeInfo->typeData.kind == NodeTypekind::I64) {
-        auto staticValue = interp->readFromStack<int64_t>(copied->localOffset);
-        staticNode->type = NodeType::INT_LITERAL;
-        staticNode->intLiteralData.value = staticValue;
-    }
-    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::FLOAT_LITERAL || resolvedTypeInfo->typeData.kind == NodeTypekind::F32) {
-        auto staticValue = interp->readFromStack<float>(copied->localOffset);
-        staticNode->type = NodeType::FLOAT_LITERAL;
-        staticNode->floatLiteralData.value = staticValue;
+    auto interp = semantic->ctfeInterp;
+
+    // #link can add libs after the engine was created
+    for (auto i = interp->libs.length; i < semantic->linkLibs.length; i++) {
+        interp->loadLib(vector_at(semantic->linkLibs, i));
     }
-    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::F64) {
-        auto staticValue = interp->readFromStack<float>(copied->localOffset);
-        staticNode->type = NodeType::FLOAT_LITERAL;
-        staticNode->floatLiteralData.value = staticValue;
+
+    // only new code was appended (and only new code was fixed up), so the interpreter just needs the tail
+    interp->instructions.insert(interp->instructions.end(), gen->instructions.begin() + interp->instructions.size(), gen->instructions.end());
+    interp->sourceMap = gen->sourceMap;
+    interp->externalFnTable = gen->externalFnTable;
+    interp->contextType = semantic->contextType;
+    interp->continuing = true;
+
+    interp->pc = (uint32_t) entryPc;
+    interp->sp = 0;
+    interp->bp = 0;
+    interp->depth = 0;
+    interp->pcs.clear();
+    interp->terminated = false;
+
+//    auto p = new MnemonicPrinter(interp->instructions);
+//    p->fnTable = gen->fnTable;
+//    cout << p->debugString() << endl << endl << endl;
+
+    Node *staticNode = nullptr;
+
+    uint64_t cacheKey = 0;
+    auto canCache = noCtfeCacheFlag == 0;
+    if (canCache) {
+        cacheKey = ctfeCacheKey(semantic, entryPc, copied, isStringLiteral);
+        staticNode = readCtfeCache(cacheKey);
     }
-    else if (resolvedTypeInfo->typeData.kind == NodeTypekind::NONE) {
-        staticNode->type = NodeType::NIL_LITERAL;
+
+    if (staticNode == nullptr) {
+        interp->hadSideEffects = false;
+        interp->interpret();
+
+        staticNode = readCompileTimeResult(interp, copied, isStringLiteral);
+
+        if (interp->hadSideEffects) {
+            semantic->ctfeHadSideEffects = true;
+        }
+        else if (canCache) {
+            writeCtfeCache(cacheKey, staticNode);
+        }
     }
 
     semantic->resolveTypes(staticNode);
@@ -1507,8 +2123,6 @@ Node *constantize(Semantic *semantic, Node *node) {
     node->staticValue = staticNode;
     copied->staticValue = staticNode;
 
-    interp_destroy(interp);
-
     return staticNode;
 }
 
@@ -1634,9 +2248,23 @@ void resolveCast(Semantic *semantic, Node *node) {
 
 void resolveStringLiteral(Semantic *semantic, Node *node) {
     // typeInfo = []i8;
-    node->typeInfo = makeArrayType(new Node(NodeTypekind::I8));
+    node->typeInfo = canonicalArrayType(canonicalType(NodeTypekind::I8));
+
+    if (node->stringLiteralData.allocFn == nullptr) {
+        // the characters go in read-only data, and every evaluation copies them into this buffer, which then backs the
+        // array. the literal can still be written through, so it can't point at the read-only data itself
+        auto buffer = new Node(node->region.srcInfo, NodeType::STRUCT_LITERAL, node->scope);
+        buffer->region = node->region;
+        buffer->typeInfo = canonicalBufferType(static_cast<int64_t>(node->stringLiteralData.value->size()));
+        buffer->semantic = true;
+        semantic->addLocal(buffer);
+
+        node->stringLiteralData.buffer = buffer;
+        node->stringLiteralData.arrayLiteralRepresentation = nullptr;
+        return;
+    }
 
-    // "hello" <==> {&{'h', 'e', 'l', 'l', 'o'}, 5};
+    // [allocFn]"hello" <==> {heap(allocFn, {'h', 'e', 'l', 'l', 'o'}), 5};
     auto arrayLiteral = new Node(node->region.srcInfo, NodeType::STRUCT_LITERAL, node->scope);
     arrayLiteral->region = node->region;
 
@@ -1648,50 +2276,39 @@ void resolveStringLiteral(Semantic *semantic, Node *node) {
     for (auto c : *node->stringLiteralData.value) {
         auto charNode = new Node(node->region);
         charNode->type = NodeType::INT_LITERAL;
-        charNode->typeInfo = new Node(NodeTypekind::I8);
+        charNode->typeInfo = canonicalType(NodeTypekind::I8);
         charNode->intLiteralData.value = static_cast<int64_t>(c);
 
         vector_append(charArrayLiteral->structLiteralData.params, wrapInValueParam(charNode, ""));
     }
 
-    Node *heapifiedCharArrayLiteral = nullptr;
-    if (node->stringLiteralData.allocFn != nullptr) {
-        // heap(allocFn, {'h', 'e', 'l', 'l', 'o'})
-
-        semantic->resolveTypes(node->stringLiteralData.allocFn);
-        // todo(chad): check that the type is ok here
-
-        auto basicSym = new Node(node->region.srcInfo, NodeType::SYMBOL, node->scope);
-        basicSym->symbolData.atomId = atomTable->insertStr("basic");
+    // heap(allocFn, {'h', 'e', 'l', 'l', 'o'})
+    semantic->resolveTypes(node->stringLiteralData.allocFn);
+    // todo(chad): check that the type is ok here
 
-        auto heapFn = new Node(node->region.srcInfo, NodeType::SYMBOL, node->scope);
-        heapFn->symbolData.atomId = atomTable->insertStr("heap");
+    auto basicSym = new Node(node->region.srcInfo, NodeType::SYMBOL, node->scope);
+    basicSym->symbolData.atomId = atomTable->insertStr("basic");
 
-        auto basicDotHeap = new Node(node->region.srcInfo, NodeType::DOT, node->scope);
-        basicDotHeap->dotData.lhs = basicSym;
-        basicDotHeap->dotData.rhs = heapFn;
+    auto heapFn = new Node(node->region.srcInfo, NodeType::SYMBOL, node->scope);
+    heapFn->symbolData.atomId = atomTable->insertStr("heap");
 
-        heapifiedCharArrayLiteral = new Node(node->region.srcInfo, NodeType::FN_CALL, node->scope);
-        heapifiedCharArrayLiteral->fnCallData.fn = basicDotHeap;
-        heapifiedCharArrayLiteral->fnCallData.hasRuntimeParams = true;
+    auto basicDotHeap = new Node(node->region.srcInfo, NodeType::DOT, node->scope);
+    basicDotHeap->dotData.lhs = basicSym;
+    basicDotHeap->dotData.rhs = heapFn;
 
-        vector_append(heapifiedCharArrayLiteral->fnCallData.params, wrapInValueParam(node->stringLiteralData.allocFn, nullptr));
-        vector_append(heapifiedCharArrayLiteral->fnCallData.params, wrapInValueParam(charArrayLiteral, nullptr));
-    }
-    else {
-        // {'h', 'e', 'l', 'l', 'o'}
+    auto heapifiedCharArrayLiteral = new Node(node->region.srcInfo, NodeType::FN_CALL, node->scope);
+    heapifiedCharArrayLiteral->fnCallData.fn = basicDotHeap;
+    heapifiedCharArrayLiteral->fnCallData.hasRuntimeParams = true;
 
-        heapifiedCharArrayLiteral = new Node(node->region);
-        heapifiedCharArrayLiteral->type = NodeType::ADDRESS_OF;
-        heapifiedCharArrayLiteral->nodeData = charArrayLiteral;
-    }
+    vector_append(heapifiedCharArrayLiteral->fnCallData.params, wrapInValueParam(node->stringLiteralData.allocFn, nullptr));
+    vector_append(heapifiedCharArrayLiteral->fnCallData.params, wrapInValueParam(charArrayLiteral, nullptr));
 
     semantic->addLocal(heapifiedCharArrayLiteral->nodeData);
 
     // countNode = 5
     auto countNode = new Node(node->region);
     countNode->type = NodeType::INT_LITERAL;
-    countNode->typeInfo = new Node(NodeTypekind::I64);
+    countNode->typeInfo = canonicalType(NodeTypekind::I64);
     countNode->intLiteralData.value = static_cast<int64_t>(node->stringLiteralData.value->size());
 
     // arrayLiteral = {heap({'h', 'e', 'l', 'l', 'o'}), 5}
@@ -1703,22 +2320,23 @@ void resolveStringLiteral(Semantic *semantic, Node *node) {
     cpi_assert(arrayLiteral->typeInfo->typeData.kind == NodeTypekind::STRUCT);
     arrayLiteral->typeInfo->typeData.structTypeData.isSecretlyArray = true;
 
-    arrayLiteral->typeInfo->typeData.structTypeData.secretArrayElementType = new Node(NodeTypekind::I8);
+    arrayLiteral->typeInfo->typeData.structTypeData.secretArrayElementType = canonicalType(NodeTypekind::I8);
 
     node->stringLiteralData.arrayLiteralRepresentation = arrayLiteral;
+    node->stringLiteralData.buffer = nullptr;
 }
 
 void resolveNilLiteral(Semantic *semantic, Node *node) {
     node->typeInfo = new Node(NodeTypekind::POINTER);
-    node->typeInfo->typeData.pointerTypeData.underlyingType = new Node(NodeTypekind::NONE);
+    node->typeInfo->typeData.pointerTypeData.underlyingType = canonicalType(NodeTypekind::NONE);
 }
 
 void resolveSymbol(Semantic *semantic, Node *node) {
-    node->resolved = resolve(node->scope->find(node->symbolData.atomId));
+    node->resolved = resolve(semantic->findSymbol(node->scope, node->symbolData.atomId));
 
     if (node->resolved == nullptr) {
         ostringstream s("");
-        s << "undeclared identifier " << atomTable->backwardAtoms[node->symbolData.atomId];
+        s << "undeclared identifier " << atomTable->nameOf(node->symbolData.atomId);
         semantic->reportError({node}, Error{node->region, s.str()});
         return;
     }
@@ -1833,7 +2451,7 @@ bool assignParams(Semantic *semantic, Node *errorReportTarget, const vector_t<No
 
             if (reportError) {
                 ostringstream s("");
-                s << "unassigned parameter: " << atomTable->backwardAtoms[vector_at(declParams, i)->paramData.name->symbolData.atomId];
+                s << "unassigned parameter: " << atomTable->nameOf(vector_at(declParams, i)->paramData.name->symbolData.atomId);
                 auto sstr = s.str();
 
                 semantic->reportError({errorReportTarget}, Error{errorReportTarget->region, sstr});
@@ -1934,6 +2552,8 @@ void resolveAlias(Semantic *semantic, Node *node) {
 }
 
 Node *resolveParameterizedType(Semantic *semantic, Node *pt, Node *fnCall) {
+    lock_guard<recursive_mutex> guard(semantic->sharedLock);
+
     auto newType = semantic->deepCopyScopedStmt(pt, pt->scope);
 
     // assign parameters
@@ -1946,14 +2566,15 @@ Node *resolveParameterizedType(Semantic *semantic, Node *pt, Node *fnCall) {
 
     assignParams(semantic, fnCall, declParams, givenParams);
 
-    auto maybeExistingType = semantic->findExistingPolymorph(pt, givenParams);
+    uint64_t polyKey;
+    auto maybeExistingType = semantic->findExistingPolymorph(pt, givenParams, &polyKey);
     if (maybeExistingType != nullptr) {
         maybeExistingType->typeData.polyCameFrom = pt;
         *maybeExistingType->typeData.polyParams = givenParams;
         return maybeExistingType;
     }
     else {
-        vector_append(semantic->polymorphs, Polymorphed{pt, givenParams, newType->parameterizedTypeData.typeDecl});
+        semantic->addPolymorph(polyKey, Polymorphed{pt, givenParams, newType->parameterizedTypeData.typeDecl});
 
         for (unsigned long i = 0; i < declParams.length; i++) {
             vector_at(declParams, i)->staticValue = vector_at(givenParams, i)->paramData.value;
@@ -2016,11 +2637,11 @@ void resolveType(Semantic *semantic, Node *node) {
             }
         } break;
         case NodeTypekind::SYMBOL: {
-            node->resolved = node->scope->find(node->typeData.symbolTypeData.atomId);
+            node->resolved = semantic->findSymbol(node->scope, node->typeData.symbolTypeData.atomId);
 
             if (node->resolved == nullptr) {
                 ostringstream s("");
-                s << "undeclared type identifier " << atomTable->backwardAtoms[node->typeData.symbolTypeData.atomId];
+                s << "undeclared type identifier " << atomTable->nameOf(node->typeData.symbolTypeData.atomId);
                 semantic->reportError({node}, Error{node->region, s.str()});
                 return;
             }
@@ -2239,7 +2860,390 @@ void resolveBinop(Semantic *semantic, Node *node) {
     }
 }
 
+struct AstCloner {
+    CopyTemplate *tmpl;
+    Scope *targetScope;
+
+    // indexed by (template node id - tmpl->firstId)
+    vector<Node *> nodes;
+    hash_t<Scope *, Scope *> *scopes;
+};
+
+Node *cloneNode(AstCloner *cloner, Node *node);
+Scope *cloneScope(AstCloner *cloner, Scope *scope);
+
+vector_t<Node *> cloneNodes(AstCloner *cloner, vector_t<Node *> &nodes) {
+    auto cloned = vector_init<Node *>(nodes.length > 0 ? nodes.length : 4);
+    for (auto n : nodes) {
+        vector_append(cloned, cloneNode(cloner, n));
+    }
+    return cloned;
+}
+
+vector_t<Node *> *cloneNodes(AstCloner *cloner, vector_t<Node *> *nodes) {
+    if (nodes == nullptr) { return nullptr; }
+
+    auto cloned = (vector_t<Node *> *) malloc(sizeof(vector_t<Node *>));
+    *cloned = cloneNodes(cloner, *nodes);
+    return cloned;
+}
+
+bool isTemplateScope(AstCloner *cloner, Scope *scope) {
+    for (auto s = scope; s != nullptr; s = s->parent) {
+        if (s == cloner->tmpl->rootScope) { return true; }
+    }
+    return false;
+}
+
+Scope *cloneScope(AstCloner *cloner, Scope *scope) {
+    if (scope == cloner->tmpl->rootScope) { return cloner->targetScope; }
+    if (!isTemplateScope(cloner, scope)) { return scope; }
+
+    auto found = hash_get(cloner->scopes, scope);
+    if (found != nullptr) { return *found; }
+
+    auto cloned = new Scope(cloneScope(cloner, scope->parent));
+    hash_insert(cloner->scopes, scope, cloned);
+
+    cloned->insertedDeferredStmts = scope->insertedDeferredStmts;
+    cloned->addedStaticIfs = scope->addedStaticIfs;
+    cloned->isFunctionScope = scope->isFunctionScope;
+    cloned->fnReturnType = cloneNode(cloner, scope->fnReturnType);
+    cloned->deferredStmts = cloneNodes(cloner, scope->deferredStmts);
+    cloned->staticIfs = cloneNodes(cloner, scope->staticIfs);
+    cloned->fnScopeParams = cloneNodes(cloner, scope->fnScopeParams);
+
+    for (auto i = 0; i < scope->symbols->bucket_count; i++) {
+        for (auto bucket = scope->symbols->buckets[i]; bucket != nullptr; bucket = bucket->next) {
+            hash_insert(cloned->symbols, bucket->key, cloneNode(cloner, bucket->value));
+        }
+    }
+
+    return cloned;
+}
+
+void cloneTypeData(AstCloner *cloner, TypeData &td) {
+    td.name = cloneNode(cloner, td.name);
+    td.attributes = cloneNodes(cloner, td.attributes);
+    td.polyCameFrom = cloneNode(cloner, td.polyCameFrom);
+    td.polyParams = cloneNodes(cloner, td.polyParams);
+
+    switch (td.kind) {
+        case NodeTypekind::FN: {
+            td.fnTypeData.params = cloneNodes(cloner, td.fnTypeData.params);
+            td.fnTypeData.returnType = cloneNode(cloner, td.fnTypeData.returnType);
+        } break;
+        case NodeTypekind::STRUCT: {
+            td.structTypeData.params = cloneNodes(cloner, td.structTypeData.params);
+            td.structTypeData.secretArrayElementType = cloneNode(cloner, td.structTypeData.secretArrayElementType);
+            td.structTypeData.unionTagType = cloneNode(cloner, td.structTypeData.unionTagType);
+            td.structTypeData.coercedType = cloneNode(cloner, td.structTypeData.coercedType);
+        } break;
+        case NodeTypekind::ENUM: {
+            td.enumTypeData.type = cloneNode(cloner, td.enumTypeData.type);
+            td.enumTypeData.params = cloneNodes(cloner, td.enumTypeData.params);
+        } break;
+        case NodeTypekind::POINTER: {
+            td.pointerTypeData.underlyingType = cloneNode(cloner, td.pointerTypeData.underlyingType);
+        } break;
+        case NodeTypekind::DOT: {
+            td.dotTypeData = cloneNode(cloner, td.dotTypeData);
+        } break;
+        case NodeTypekind::PARAMETERIZED: {
+            td.polymorphTypeTypeData.value = cloneNode(cloner, td.polymorphTypeTypeData.value);
+        } break;
+        case NodeTypekind::AUTOCAST: {
+            td.autocastData = cloneNode(cloner, td.autocastData);
+        } break;
+        default: break;
+    }
+}
+
+Node *cloneNode(AstCloner *cloner, Node *node) {
+    if (node == nullptr) { return nullptr; }
+
+    // not part of the template (imported modules, outer deferred stmts, ...), so the copy shares it
+    if (node->id < cloner->tmpl->firstId || node->id >= cloner->tmpl->endId) { return node; }
+
+    auto &slot = cloner->nodes[node->id - cloner->tmpl->firstId];
+    if (slot != nullptr) { return slot; }
+
+    auto cloned = new Node();
+    auto id = cloned->id;
+    *cloned = *node;
+    cloned->id = id;
+
+    // register before recursing, scopes and children can point back at us
+    cloner->nodes[node->id - cloner->tmpl->firstId] = cloned;
+
+    cloned->scope = cloneScope(cloner, node->scope);
+    cloned->typeInfo = cloneNode(cloner, node->typeInfo);
+    cloned->preStmts = cloneNodes(cloner, node->preStmts);
+    cloned->postStmts = cloneNodes(cloner, node->postStmts);
+
+    switch (node->type) {
+        case NodeType::FN_DECL: {
+            auto &data = cloned->fnDeclData;
+            data.name = cloneNode(cloner, data.name);
+            data.ctParams = cloneNodes(cloner, data.ctParams);
+            data.params = cloneNodes(cloner, data.params);
+            data.returnType = cloneNode(cloner, data.returnType);
+            data.body = cloneNodes(cloner, data.body);
+            data.locals = cloneNodes(cloner, data.locals);
+            data.returns = cloneNodes(cloner, data.returns);
+            data.bodyScope = cloneScope(cloner, data.bodyScope);
+        } break;
+        case NodeType::DECL:
+        case NodeType::ALIAS: {
+            cloned->declData.lhs = cloneNode(cloner, cloned->declData.lhs);
+            cloned->declData.type = cloneNode(cloner, cloned->declData.type);
+            cloned->declData.initialValue = cloneNode(cloner, cloned->declData.initialValue);
+        } break;
+        case NodeType::ASSIGN: {
+            cloned->assignData.lhs = cloneNode(cloner, cloned->assignData.lhs);
+            cloned->assignData.rhs = cloneNode(cloner, cloned->assignData.rhs);
+        } break;
+        case NodeType::BINOP: {
+            auto &data = cloned->binopData;
+            data.lhs = cloneNode(cloner, data.lhs);
+            data.rhs = cloneNode(cloner, data.rhs);
+            data.lhsTemporary = cloneNode(cloner, data.lhsTemporary);
+            data.rhsTemporary = cloneNode(cloner, data.rhsTemporary);
+        } break;
+        case NodeType::DOT: {
+            auto &data = cloned->dotData;
+            data.lhs = cloneNode(cloner, data.lhs);
+            data.rhs = cloneNode(cloner, data.rhs);
+            data.resolved = cloneNode(cloner, data.resolved);
+            data.autoDerefStorage = cloneNode(cloner, data.autoDerefStorage);
+        } break;
+        case NodeType::FN_CALL: {
+            cloned->fnCallData.fn = cloneNode(cloner, cloned->fnCallData.fn);
+            cloned->fnCallData.ctParams = cloneNodes(cloner, cloned->fnCallData.ctParams);
+            cloned->fnCallData.params = cloneNodes(cloner, cloned->fnCallData.params);
+        } break;
+        case NodeType::STRING_LITERAL: {
+            cloned->stringLiteralData.allocFn = cloneNode(cloner, cloned->stringLiteralData.allocFn);
+            cloned->stringLiteralData.arrayLiteralRepresentation = cloneNode(cloner, cloned->stringLiteralData.arrayLiteralRepresentation);
+            cloned->stringLiteralData.buffer = cloneNode(cloner, cloned->stringLiteralData.buffer);
+        } break;
+        case NodeType::UNARY_NEG: {
+            cloned->unaryNegData.target = cloneNode(cloner, cloned->unaryNegData.target);
+            cloned->unaryNegData.rewritten = cloneNode(cloner, cloned->unaryNegData.rewritten);
+        } break;
+        case NodeType::RETURN: {
+            cloned->retData.value = cloneNode(cloner, cloned->retData.value);
+        } break;
+        case NodeType::IF: {
+            auto &data = cloned->ifData;
+            data.condition = cloneNode(cloner, data.condition);
+            data.stmts = cloneNodes(cloner, data.stmts);
+            data.elseStmts = cloneNodes(cloner, data.elseStmts);
+            data.ifScope = cloneScope(cloner, data.ifScope);
+            data.elseScope = cloneScope(cloner, data.elseScope);
+            if (data.staticIfData != nullptr) {
+                auto staticData = new StaticIfData(*data.staticIfData);
+                staticData->trueImports = cloneNodes(cloner, staticData->trueImports);
+                staticData->falseImports = cloneNodes(cloner, staticData->falseImports);
+                staticData->trueContexts = cloneNodes(cloner, staticData->trueContexts);
+                staticData->falseContexts = cloneNodes(cloner, staticData->falseContexts);
+                staticData->trueContextInits = cloneNodes(cloner, staticData->trueContextInits);
+                staticData->falseContextInits = cloneNodes(cloner, staticData->falseContextInits);
+                staticData->trueImpls = cloneNodes(cloner, staticData->trueImpls);
+                staticData->falseImpls = cloneNodes(cloner, staticData->falseImpls);
+                data.staticIfData = staticData;
+            }
+        } break;
+        case NodeType::WHILE: {
+            cloned->whileData.condition = cloneNode(cloner, cloned->whileData.condition);
+            cloned->whileData.stmts = cloneNodes(cloner, cloned->whileData.stmts);
+        } break;
+        case NodeType::DECL_PARAM:
+        case NodeType::VALUE_PARAM: {
+            auto &data = cloned->paramData;
+            data.name = cloneNode(cloner, data.name);
+            data.type = cloneNode(cloner, data.type);
+            data.value = cloneNode(cloner, data.value);
+            data.polyLink = cloneNode(cloner, data.polyLink);
+            data.polyCameFrom = cloneNode(cloner, data.polyCameFrom);
+        } break;
+        case NodeType::TYPE: {
+            cloneTypeData(cloner, cloned->typeData);
+        } break;
+        case NodeType::DEREF:
+        case NodeType::ADDRESS_OF:
+        case NodeType::UNARY_NOT:
+        case NodeType::UNARY_BITNOT:
+        case NodeType::RUN:
+        case NodeType::TYPEOF:
+        case NodeType::RETURNTYPEOF:
+        case NodeType::SIZEOF:
+        case NodeType::FIELDSOF:
+        case NodeType::PUTS:
+        case NodeType::TAGCHECK: {
+            cloned->nodeData = cloneNode(cloner, cloned->nodeData);
+        } break;
+        case NodeType::STRUCT_LITERAL: {
+            cloned->structLiteralData.params = cloneNodes(cloner, cloned->structLiteralData.params);
+        } break;
+        case NodeType::MODULE: {
+            cloned->moduleData.name = cloneNode(cloner, cloned->moduleData.name);
+            cloned->moduleData.stmts = cloneNodes(cloner, cloned->moduleData.stmts);
+        } break;
+        case NodeType::IMPORT: {
+            cloned->importData.target = cloneNode(cloner, cloned->importData.target);
+            cloned->importData.alias = cloneNode(cloner, cloned->importData.alias);
+        } break;
+        case NodeType::CAST: {
+            cloned->castData.type = cloneNode(cloner, cloned->castData.type);
+            cloned->castData.value = cloneNode(cloner, cloned->castData.value);
+        } break;
+        case NodeType::ARRAY_INDEX: {
+            cloned->arrayIndexData.target = cloneNode(cloner, cloned->arrayIndexData.target);
+            cloned->arrayIndexData.indexValue = cloneNode(cloner, cloned->arrayIndexData.indexValue);
+        } break;
+        case NodeType::ARRAY_LITERAL: {
+            auto &data = cloned->arrayLiteralData;
+            data.elementType = cloneNode(cloner, data.elementType);
+            data.elements = cloneNodes(cloner, data.elements);
+            data.structLiteralRepresentation = cloneNode(cloner, data.structLiteralRepresentation);
+            data.allocFn = cloneNode(cloner, data.allocFn);
+        } break;
+        case NodeType::FOR: {
+            auto &data = cloned->forData;
+            data.element_alias = cloneNode(cloner, data.element_alias);
+            data.iterator_alias = cloneNode(cloner, data.iterator_alias);
+            data.target = cloneNode(cloner, data.target);
+            data.stmts = cloneNodes(cloner, data.stmts);
+            data.rewritten = cloneNodes(cloner, data.rewritten);
+            data.staticStmts = cloneNodes(cloner, data.staticStmts);
+        } break;
+        case NodeType::ISKIND: {
+            cloned->isKindData.type = cloneNode(cloner, cloned->isKindData.type);
+        } break;
+        case NodeType::DEFER: {
+            cloned->deferData.stmts = cloneNodes(cloner, cloned->deferData.stmts);
+        } break;
+        case NodeType::PARAMETERIZED_TYPE: {
+            auto &data = cloned->parameterizedTypeData;
+            data.ctParams = cloneNodes(cloner, data.ctParams);
+            data.typeDecl = cloneNode(cloner, data.typeDecl);
+            data.attributes = cloneNodes(cloner, data.attributes);
+        } break;
+        case NodeType::ENUM_LITERAL: {
+            cloned->enumLiteralData.type = cloneNode(cloner, cloned->enumLiteralData.type);
+            cloned->enumLiteralData.value = cloneNode(cloner, cloned->enumLiteralData.value);
+        } break;
+        case NodeType::ATTR: {
+            cloned->attrData.target = cloneNode(cloner, cloned->attrData.target);
+            cloned->attrData.stmts = cloneNodes(cloner, cloned->attrData.stmts);
+        } break;
+        case NodeType::ATTROF:
+        case NodeType::HASATTR: {
+            cloned->attrofData.target = cloneNode(cloner, cloned->attrofData.target);
+            cloned->attrofData.attr = cloneNode(cloner, cloned->attrofData.attr);
+        } break;
+        case NodeType::CONTEXT: {
+            cloned->contextData.decls = cloneNodes(cloner, cloned->contextData.decls);
+        } break;
+        default: break;
+    }
+
+    return cloned;
+}
+
+CopyTemplate *copyTemplateFor(Semantic *semantic, Node *node, bool isRvalue) {
+    // whether there's a current fn decl changes how the parser treats decls (locals vs. constants)
+    auto key = (uint64_t) node->id * 4 + (isRvalue ? 2 : 0) + (semantic->currentFnDecl != nullptr ? 1 : 0);
+
+    auto found = hash_get(semantic->copyTemplates, key);
+    if (found != nullptr) { return *found; }
+
+    auto tmpl = new CopyTemplate();
+    tmpl->rootScope = new Scope(nullptr);
+    tmpl->fnDecl = semantic->currentFnDecl != nullptr ? new Node(node->region.srcInfo, NodeType::FN_DECL, nullptr) : nullptr;
+    tmpl->contexts = (vector_t<Node *> *) malloc(sizeof(vector_t<Node *>));
+    *tmpl->contexts = vector_init<Node *>(4);
+    tmpl->contextInits = (vector_t<Node *> *) malloc(sizeof(vector_t<Node *>));
+    *tmpl->contextInits = vector_init<Node *>(4);
+    tmpl->openDeferreds = (vector_t<Node *> *) malloc(sizeof(vector_t<Node *>));
+    *tmpl->openDeferreds = vector_init<Node *>(4);
+
+    tmpl->firstId = nodeId;
+
+    auto copyingLexer = new Lexer(node->region.srcInfo, node);
+
+    auto copyingParser = new Parser(copyingLexer);
+    copyingParser->isCopying = true;
+    copyingParser->scopes.pop();
+    copyingParser->scopes.push(tmpl->rootScope);
+    copyingParser->staticIfScope = tmpl->rootScope;
+    copyingParser->copyRootScope = tmpl->rootScope;
+    copyingParser->openDeferreds = tmpl->openDeferreds;
+    copyingParser->currentFnDecl = tmpl->fnDecl;
+    copyingParser->contexts = tmpl->contexts;
+    copyingParser->contextInits = tmpl->contextInits;
+
+    tmpl->root = isRvalue ? copyingParser->parseRvalue() : copyingParser->parseScopedStmt();
+
+    tmpl->endId = nodeId;
+
+    hash_insert(semantic->copyTemplates, key, tmpl);
+    return tmpl;
+}
+
+Node *instantiateCopyTemplate(Semantic *semantic, CopyTemplate *tmpl, Scope *scope) {
+    AstCloner cloner;
+    cloner.tmpl = tmpl;
+    cloner.targetScope = scope;
+    cloner.nodes = vector<Node *>(tmpl->endId - tmpl->firstId, nullptr);
+    cloner.scopes = hash_init<Scope *, Scope *>(16);
+
+    auto copied = cloneNode(&cloner, tmpl->root);
+
+    // replay what the parser would have done to the scope and fn decl we're copying into
+    auto root = tmpl->rootScope;
+    for (auto open : *tmpl->openDeferreds) {
+        auto node = cloneNode(&cloner, open);
+        if (node->scope == scope) {
+            if (scope->insertedDeferredStmts) { continue; }
+            scope->insertedDeferredStmts = true;
+        }
+        insertDeferreds(node, scope, node->type == NodeType::RETURN, nullptr);
+    }
+    for (auto i = 0; i < root->symbols->bucket_count; i++) {
+        for (auto bucket = root->symbols->buckets[i]; bucket != nullptr; bucket = bucket->next) {
+            hash_insert(scope->symbols, bucket->key, cloneNode(&cloner, bucket->value));
+        }
+    }
+    for (auto stmt : root->deferredStmts) {
+        vector_append(scope->deferredStmts, cloneNode(&cloner, stmt));
+    }
+    for (auto staticIf : root->staticIfs) {
+        vector_append(scope->staticIfs, cloneNode(&cloner, staticIf));
+    }
+
+    if (tmpl->fnDecl != nullptr && semantic->currentFnDecl != nullptr) {
+        for (auto local : tmpl->fnDecl->fnDeclData.locals) {
+            vector_append(semantic->currentFnDecl->fnDeclData.locals, cloneNode(&cloner, local));
+        }
+        for (auto ret : tmpl->fnDecl->fnDeclData.returns) {
+            vector_append(semantic->currentFnDecl->fnDeclData.returns, cloneNode(&cloner, ret));
+        }
+    }
+    for (auto context : *tmpl->contexts) {
+        vector_append(semantic->contexts, cloneNode(&cloner, context));
+    }
+    for (auto contextInit : *tmpl->contextInits) {
+        vector_append(semantic->contextInits, cloneNode(&cloner, contextInit));
+    }
+
+    return copied;
+}
+
 Node *Semantic::deepCopyScopedStmt(Node *node, Scope *scope) {
+    lock_guard<recursive_mutex> guard(sharedLock);
+
     Node *copied = nullptr;
 
     if (node->type == NodeType::END_SCOPE) {
@@ -2247,52 +3251,22 @@ Node *Semantic::deepCopyScopedStmt(Node *node, Scope *scope) {
         copied->region = node->region;
     }
     else {
-        Lexer *copyingLexer;
-        if (node->region.srcInfo.source != nullptr && !node->region.srcInfo.source->empty()) {
-            copyingLexer = new Lexer(node->region.srcInfo.fileName, node->region.srcInfo.source);
-        }
-        else {
-            copyingLexer = new Lexer(node->region.srcInfo.fileName, nullptr);
-        }
-
-        copyingLexer->lastLoc = node->region.start;
-        copyingLexer->loc = node->region.start;
-        copyingLexer->popFront();
-        copyingLexer->popFront();
-
-        auto copyingParser = new Parser(copyingLexer);
-        copyingParser->isCopying = true;
-        copyingParser->scopes.pop();
-        copyingParser->scopes.push(scope);
-        copyingParser->currentFnDecl = currentFnDecl;
-        copyingParser->contexts = &this->contexts;
-        copyingParser->contextInits = &this->contextInits;
-
-        copied = copyingParser->parseScopedStmt();
+        copied = instantiateCopyTemplate(this, copyTemplateFor(this, node, false), scope);
     }
 
     for (auto s : node->preStmts) {
-        vector_append(copied->preStmts, deepCopyScopedStmt(s, s->scope));
+        appendStmt(copied->preStmts, deepCopyScopedStmt(s, s->scope));
     }
     for (auto s : node->postStmts) {
-        vector_append(copied->postStmts, deepCopyScopedStmt(s, s->scope));
+        appendStmt(copied->postStmts, deepCopyScopedStmt(s, s->scope));
     }
 
     return copied;
 }
 
 Node *Semantic::deepCopyRvalue(Node *node, Scope *scope) {
-    auto copyingLexer = new Lexer(node->region.srcInfo, node);
-
-    auto copyingParser = new Parser(copyingLexer);
-    copyingParser->isCopying = true;
-    copyingParser->scopes.pop();
-    copyingParser->scopes.push(scope);
-    copyingParser->currentFnDecl = currentFnDecl;
-    copyingParser->contexts = &this->contexts;
-    copyingParser->contextInits = &this->contextInits;
-
-    return copyingParser->parseRvalue();
+    lock_guard<recursive_mutex> guard(sharedLock);
+    return instantiateCopyTemplate(this, copyTemplateFor(this, node, true), scope);
 }
 
 Node *resolveSymbolWithScopeType(Semantic *semantic, int64_t atom, Node *firstParam) {
@@ -2372,6 +3346,12 @@ void resolveFnCall(Semantic *semantic, Node *node) {
     auto isPoly = resolvedFn->type == NodeType::FN_DECL && resolvedFn->fnDeclData.ctParams.length != 0;
     Node *polyResolvedFn = nullptr;
 
+    // instantiating links and re-resolves the original fn's params, which every caller shares
+    unique_lock<recursive_mutex> polyGuard(semantic->sharedLock, defer_lock);
+    if (isPoly) {
+        polyGuard.lock();
+    }
+
     if (!noIppFlag) {
         bool shouldAddContextParam = false;
         if (node->fnCallData.skipContext) {
@@ -2588,13 +3568,14 @@ void resolveFnCall(Semantic *semantic, Node *node) {
 
         semantic->currentFnDecl = savedCurrentFnDecl;
 
-        auto maybeExistingFn = semantic->findExistingPolymorph(originalResolvedFn, node->fnCallData.ctParams);
+        uint64_t polyKey;
+        auto maybeExistingFn = semantic->findExistingPolymorph(originalResolvedFn, node->fnCallData.ctParams, &polyKey);
         if (maybeExistingFn != nullptr) {
             resolvedFn = maybeExistingFn;
             node->fnCallData.fn->resolved = resolvedFn;
         }
         else {
-            vector_append(semantic->polymorphs, Polymorphed{originalResolvedFn, node->fnCallData.ctParams, resolvedFn});
+            semantic->addPolymorph(polyKey, Polymorphed{originalResolvedFn, node->fnCallData.ctParams, resolvedFn});
         }
     }
 
@@ -2704,7 +3685,7 @@ void possiblyResolveAssignToUnion(Semantic *semantic, Node *originalAssignment,
         secretAss->assignData.lhs = tagDot;
         secretAss->assignData.rhs = constParamIndex;
 
-        vector_append(originalAssignment->postStmts, secretAss);
+        appendStmt(originalAssignment->postStmts, secretAss);
 
         semantic->resolveTypes(secretAss);
     }
@@ -2830,10 +3811,11 @@ Node *findParam(Semantic *semantic, Node *node) {
     auto resolvedTypeInfo = resolve(node->dotData.lhs)->typeInfo;
     cpi_assert(resolvedTypeInfo != nullptr);
 
-    auto typeData = &resolve(resolvedTypeInfo)->typeData;
-    while (typeData->kind == NodeTypekind::POINTER) {
-        typeData = &resolve(typeData->pointerTypeData.underlyingType)->typeData;
+    auto structType = resolve(resolvedTypeInfo);
+    while (structType->typeData.kind == NodeTypekind::POINTER) {
+        structType = resolve(structType->typeData.pointerTypeData.underlyingType);
     }
+    auto typeData = &structType->typeData;
     if (typeData->kind != NodeTypekind::STRUCT) {
         semantic->reportError({node}, Error{node->region, "cannot perform dot operation on this!"});
     }
@@ -2846,7 +3828,10 @@ Node *findParam(Semantic *semantic, Node *node) {
         foundParam = vector_at(structData.params, node->dotData.rhs->intLiteralData.value);
     }
     else {
-        vector_append(semantic->structsToSize, structData);
+        {
+            lock_guard<recursive_mutex> guard(semantic->sharedLock);
+            vector_append(semantic->structsToSize, structType);
+        }
 
         for (auto param : structData.params) {
             if (param->paramData.name != nullptr) {
@@ -2909,11 +3894,11 @@ void createTagCheck(Semantic *semantic, Node *node) {
     ifCheck->ifData.condition = eqFalse;
     vector_append(ifCheck->ifData.stmts, panicStmt);
 
-    vector_append(node->preStmts, ifCheck);
+    appendStmt(node->preStmts, ifCheck);
 }
 
 void resolveModuleDot(Semantic *semantic, Node *node) {
-    auto found = resolve(node->dotData.lhs)->scope->find(node->dotData.rhs->symbolData.atomId);
+    auto found = semantic->findSymbol(resolve(node->dotData.lhs)->scope, node->dotData.rhs->symbolData.atomId);
     semantic->resolveTypes(found);
 
     if (found == nullptr) {
@@ -2955,7 +3940,7 @@ void resolveTypeDot(Semantic *semantic, Node *node, Node *resolvedLhs) {
 }
 
 void resolveEnumDot(Semantic *semantic, Node *node) {
-    auto found = resolve(node->dotData.lhs)->scope->find(node->dotData.rhs->symbolData.atomId);
+    auto found = semantic->findSymbol(resolve(node->dotData.lhs)->scope, node->dotData.rhs->symbolData.atomId);
 
     if (found == nullptr) {
         semantic->reportError({node, found}, Error{node->region, "Could not resolve dot"});
@@ -3267,7 +4252,7 @@ void resolveArrayLiteral(Semantic *semantic, Node *node) {
 
     auto countNode = new Node(node->region.srcInfo, NodeType::INT_LITERAL, node->scope);
     countNode->intLiteralData.value = static_cast<int64_t>(elemsStruct->structLiteralData.params.length);
-    countNode->typeInfo = new Node(NodeTypekind::I64);
+    countNode->typeInfo = canonicalType(NodeTypekind::I64);
 
     node->arrayLiteralData.structLiteralRepresentation = new Node(node->region.srcInfo, NodeType::STRUCT_LITERAL, node->scope);
     vector_append(node->arrayLiteralData.structLiteralRepresentation->structLiteralData.params, wrapInValueParam(castedHeapified, "data"));
@@ -3311,7 +4296,7 @@ void resolveStaticFor(Semantic *semantic, Node *node) {
         for (unsigned long staticIdx = 0; staticIdx < params.length; staticIdx += 1) {
             auto intLiteral = new Node();
             intLiteral->type = NodeType::INT_LITERAL;
-            intLiteral->typeInfo = new Node(NodeTypekind::I64);
+            intLiteral->typeInfo = canonicalType(NodeTypekind::I64);
             intLiteral->intLiteralData.value = (int64_t) staticIdx;
 
             auto elemDot = new Node();
@@ -3341,7 +4326,7 @@ void resolveStaticFor(Semantic *semantic, Node *node) {
         if (node->forData.iterator_alias != nullptr) {
             indexLiteral = new Node();
             indexLiteral->type = NodeType::INT_LITERAL;
-            indexLiteral->typeInfo = new Node(NodeTypekind::I64);
+            indexLiteral->typeInfo = canonicalType(NodeTypekind::I64);
             indexLiteral->intLiteralData.value = staticIdx;
             hash_insert(node->scope->symbols, node->forData.iterator_alias->symbolData.atomId, indexLiteral);
         }
@@ -3486,7 +4471,7 @@ void resolveFor(Semantic *semantic, Node *node) {
     // 0
     auto zero = new Node();
     zero->type = NodeType::INT_LITERAL;
-    zero->typeInfo = new Node(NodeTypekind::I64);
+    zero->typeInfo = canonicalType(NodeTypekind::I64);
     zero->intLiteralData.value = 0;
 
     // indexDecl: i64 = 0
@@ -3497,7 +4482,7 @@ void resolveFor(Semantic *semantic, Node *node) {
     if (node->forData.iterator_alias != nullptr) {
         indexDecl->region = node->forData.iterator_alias->region;
     }
-    indexDecl->declData.type = new Node(NodeTypekind::I64);
+    indexDecl->declData.type = canonicalType(NodeTypekind::I64);
     indexDecl->declData.lhs = node->forData.iterator_alias;
     indexDecl->declData.initialValue = zero;
     semantic->addLocal(indexDecl);
@@ -3544,7 +4529,7 @@ void resolveFor(Semantic *semantic, Node *node) {
     // one
     auto one = new Node();
     one->type = NodeType::INT_LITERAL;
-    one->typeInfo = new Node(NodeTypekind::I64);
+    one->typeInfo = canonicalType(NodeTypekind::I64);
     one->intLiteralData.value = 1;
 
     // indexDecl + 1
@@ -3572,6 +4557,7 @@ void resolveFor(Semantic *semantic, Node *node) {
     // all stmts
     // indexDecl = indexDecl + 1
     auto while_ = new Node(node->region.srcInfo, NodeType::WHILE, node->scope);
+    while_->region = node->region;
     while_->whileData.condition = whileConditionBinop;
 
     // e := array[index]
@@ -3690,7 +4676,12 @@ void resolvePuts(Semantic *semantic, Node *node) {
 
 void resolveRun(Semantic *semantic, Node *node) {
     if (!semantic->canRun) {
-        vector_append(semantic->runLaters, node);
+        if (Semantic::currentBody != nullptr) {
+            vector_append(Semantic::currentBody->runLaters, node);
+        }
+        else {
+            vector_append(semantic->runLaters, node);
+        }
         return;
     }
 
@@ -3808,7 +4799,7 @@ void resolveIsKind(Semantic *semantic, Node *node) {
 void resolveSizeof(Semantic *semantic, Node *node) {
     semantic->resolveTypes(node->nodeData);
 
-    node->typeInfo = new Node(NodeTypekind::I64);
+    node->typeInfo = canonicalType(NodeTypekind::I64);
 }
 
 void resolveFieldsof(Semantic *semantic, Node *node) {
@@ -3863,7 +4854,7 @@ void resolveFieldsof(Semantic *semantic, Node *node) {
             nameLit->scope = node->scope;
             nameLit->type = NodeType::STRING_LITERAL;
             nameLit->stringLiteralData.value = new string(
-                    param->paramData.name == nullptr ? "" : atomTable->backwardAtoms[param->paramData.name->symbolData.atomId]);
+                    param->paramData.name == nullptr ? "" : atomTable->nameOf(param->paramData.name->symbolData.atomId));
 
             vector_append(fieldLit->structLiteralData.params, wrapInValueParam(nameLit, "name"));
             vector_append(fieldLit->structLiteralData.params, wrapInValueParam(valueLit, "value"));
@@ -3887,7 +4878,7 @@ void resolveFieldsof(Semantic *semantic, Node *node) {
             nameLit->scope = node->scope;
             nameLit->type = NodeType::STRING_LITERAL;
             nameLit->stringLiteralData.value = new string(
-                    param->paramData.name == nullptr ? "" : atomTable->backwardAtoms[param->paramData.name->symbolData.atomId]);
+                    param->paramData.name == nullptr ? "" : atomTable->nameOf(param->paramData.name->symbolData.atomId));
 
             auto fieldLit = new Node();
             fieldLit->scope = node->scope;
@@ -3906,6 +4897,36 @@ void resolveFieldsof(Semantic *semantic, Node *node) {
     node->typeInfo = node->resolved->typeInfo;
 }
 
+bool isInBody(DeferredBody *body, Scope *scope) {
+    if (body == nullptr) { return false; }
+
+    auto bodyScope = body->fn->fnDeclData.bodyScope;
+    for (; scope != nullptr; scope = scope->parent) {
+        if (scope == bodyScope) { return true; }
+    }
+
+    return false;
+}
+
+// Scope::find, but safe on a worker. the scopes of its own body are its alone, but past them are shared ones
+// which other workers insert into (copies, polymorphs) under sharedLock, so the rest of the lookup takes it too
+Node *Semantic::findSymbol(Scope *scope, int64_t atomId) {
+    if (!checkingInParallel) { return scope->find(atomId); }
+
+    if (isInBody(currentBody, scope)) {
+        auto bodyScope = currentBody->fn->fnDeclData.bodyScope;
+        for (; scope != bodyScope->parent; scope = scope->parent) {
+            auto found = hash_get(scope->symbols, atomId);
+            if (found != nullptr) { return *found; }
+        }
+
+        if (scope == nullptr) { return nullptr; }
+    }
+
+    lock_guard<recursive_mutex> guard(sharedLock);
+    return scope->find(atomId);
+}
+
 void Semantic::resolveTypes(Node *node) {
     if (node == nullptr) { return; }
 
@@ -3915,6 +4936,12 @@ void Semantic::resolveTypes(Node *node) {
         return;
     }
 
+    // a worker only has its own body to itself. anything else can be reached by other workers at the same time
+    unique_lock<recursive_mutex> guard(sharedLock, defer_lock);
+    if (checkingInParallel && !isInBody(currentBody, node->scope)) {
+        guard.lock();
+    }
+
     // DECL_PARAM because it might be polyLinked.....
     if (node->semantic && node->type != NodeType::STRING_LITERAL && node->type != NodeType::DECL_PARAM) {
         return;
@@ -4090,22 +5117,166 @@ void Semantic::addLocal(Node *local) {
     }
 }
 
-void Semantic::sizeStructs() {
-    for (auto structData : this->structsToSize) {
-        auto sizeSoFar = 0;
+void Semantic::releaseCompileTimeNodes() {
+    if (ctfeGen == nullptr) { return; }
+
+    // nodes the compile time engine generated are marked with its genId and carry its bytecode, so hand them back
+    // before the real BytecodeGen runs. if something gets constantized after this they'll just be generated again
+    for (auto g : ctfeGen->generatedNodes) {
+        g->genId = 0;
+        g->bytecode = {};
+    }
+    ctfeGen->generatedNodes.length = 0;
+}
 
-        for (const auto &param : structData.params) {
-            auto paramSize = typeSize(param->paramData.type);
-            auto paramAlign = typeAlign(param->paramData.type);
+void checkDeferredBody(Semantic *semantic, DeferredBody *body) {
+    {
+        lock_guard<mutex> bodiesGuard(semantic->bodiesLock);
+        if (body->started) { return; }
 
-            // alignment
-            if (sizeSoFar > 0 && paramAlign > 0) {
-                sizeSoFar += sizeSoFar % paramAlign;
-            }
+        body->started = true;
+        body->owner = this_thread::get_id();
+    }
+
+    auto savedBody = Semantic::currentBody;
+    Semantic::currentBody = body;
+
+    checkFnBody(semantic, body->fn);
+
+    Semantic::currentBody = savedBody;
+
+    lock_guard<mutex> bodiesGuard(semantic->bodiesLock);
+    body->finished = true;
+}
+
+void Semantic::checkDeferredBodies(unsigned int threadCount) {
+    deferBodies = false;
+
+    if (threadCount > 1) {
+        checkingInParallel = true;
+
+        auto pool = new ThreadPool(threadCount);
+        for (auto body : deferredBodies) {
+            pool->submit([this, body]() { checkDeferredBody(this, body); });
+        }
+        pool->wait();
+        delete pool;
+
+        checkingInParallel = false;
+    }
+    else {
+        for (auto body : deferredBodies) {
+            checkDeferredBody(this, body);
+        }
+    }
+
+    string reported;
+    for (auto body : deferredBodies) {
+        cout << body->errors;
+        reported += body->errors;
+        for (auto r : body->runLaters) {
+            vector_append(runLaters, r);
+        }
+    }
+    deferredBodies.length = 0;
+
+    // a copy checked for compile time code runs into the same errors as its original. the ones the original didn't
+    // report came from something shared, which the original then found already resolved
+    for (auto &error : shadowErrors) {
+        if (reported.find(error) == string::npos) {
+            cout << error;
+        }
+    }
+    shadowErrors.clear();
+}
+
+// what compile time code should generate for fn: fn itself once its body is checked, or this thread's copy of it.
+// nullptr if neither is ready, see readyBody
+Node *Semantic::compileTimeBody(Node *fn) {
+    if (fn->type != NodeType::FN_DECL) { return fn; }
+
+    auto found = hash_get(deferredBodyFor, fn);
+    if (found == nullptr) { return fn; }
+
+    {
+        lock_guard<mutex> bodiesGuard(bodiesLock);
+        if ((*found)->finished) { return fn; }
+    }
+
+    if (shadowBodies != nullptr) {
+        auto shadow = hash_get(shadowBodies, fn);
+        if (shadow != nullptr && (*shadow)->finished) { return (*shadow)->fn; }
+    }
+
+    return nullptr;
+}
+
+// false if fn's body can't be ready before the compile time code that calls it runs, which has been reported
+bool Semantic::readyBody(Node *fn) {
+    if (compileTimeBody(fn) != nullptr) { return true; }
+
+    auto body = *hash_get(deferredBodyFor, fn);
+    auto self = this_thread::get_id();
+
+    // nobody has it yet, so check it here. if another worker gets there first this comes right back
+    checkDeferredBody(this, body);
+
+    {
+        lock_guard<mutex> bodiesGuard(bodiesLock);
+        if (body->finished) { return true; }
+
+        if (body->owner == self) {
+            reportError({fn}, Error{fn->region, "fn is called at compile time while its own body is still being checked"});
+            return false;
+        }
+    }
+
+    // another worker is in the middle of it. this thread can't wait for that: it may be holding sharedLock in the
+    // middle of something the owner needs, and letting go would hand out whatever it's halfway through.
+    // so this thread checks a copy of its own instead, which stands in for fn in compile time code
+    if (shadowBodies == nullptr) {
+        shadowBodies = hash_init<Node *, DeferredBody *>(16);
+    }
+    if (hash_get(shadowBodies, fn) != nullptr) {
+        reportError({fn}, Error{fn->region, "fn is called at compile time while its own body is still being checked"});
+        return false;
+    }
+
+    auto savedFnDecl = currentFnDecl;
+    currentFnDecl = nullptr;
+
+    auto copy = deepCopyScopedStmt(fn, fn->scope);
+    copy->fnDeclData.isLiteral = fn->fnDeclData.isLiteral;
 
-            param->localOffset = sizeSoFar;
+    auto shadow = new DeferredBody();
+    shadow->fn = copy;
+    shadow->started = true;
+    shadow->owner = self;
+    shadow->isShadow = true;
+    hash_insert(shadowBodies, fn, shadow);
+
+    // with a current body, resolving the copy checks its body right away
+    auto savedBody = currentBody;
+    currentBody = shadow;
+    resolveTypes(copy);
+    currentBody = savedBody;
+
+    currentFnDecl = savedFnDecl;
+
+    // calls to fn land in the copy
+    copy->fnDeclData.tableIndex = fn->fnDeclData.tableIndex;
+    shadow->finished = true;
+
+    return true;
+}
+
+void Semantic::sizeStructs() {
+    // anything sized while bodies were still being checked may have seen a field type that wasn't resolved yet
+    forgetStructLayouts();
 
-            sizeSoFar += paramSize;
+    for (auto structType : this->structsToSize) {
+        if (structType->typeData.structTypeData.coercedType == nullptr) {
+            structLayout(structType);
         }
     }
 }
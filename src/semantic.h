@@ -2,6 +2,9 @@
 #define SEMANTIC_H
 
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
 
 #include "node.h"
 #include "parser.h"
@@ -13,16 +16,95 @@ struct Polymorphed {
     Node *result;
 };
 
+struct PolymorphCounts {
+    Node *target;
+
+    int reused;
+    int made;
+};
+
+// a pristine parse of some node's source which is never resolved.
+// copies are cloned from this structurally instead of re-lexing and re-parsing the source every time
+struct CopyTemplate {
+    Node *root;
+
+    // the scope the template was parsed into. anything declared directly in it goes into the copy's scope
+    Scope *rootScope;
+
+    // returns and scope ends whose deferreds reach into the copy's scope. those get filled in per copy,
+    // which keeps the template independent of where it's copied to
+    vector_t<Node *> *openDeferreds;
+
+    // stands in for Semantic::currentFnDecl while parsing, to collect locals and returns
+    Node *fnDecl;
+    vector_t<Node *> *contexts;
+    vector_t<Node *> *contextInits;
+
+    // every node with an id in [firstId, endId) belongs to the template and gets cloned, everything else is shared
+    unsigned long firstId;
+    unsigned long endId;
+};
+
+// a fn body whose check was put off until every signature is resolved, see Semantic::deferBodies
+struct DeferredBody {
+    Node *fn;
+
+    // guarded by Semantic::bodiesLock. claimed by whichever thread checks it first
+    bool started = false;
+    bool finished = false;
+    thread::id owner;
+
+    // a thread's own copy of a body another worker was still checking, see Semantic::readyBody
+    bool isShadow = false;
+
+    // what checking the body produced. handed back in queue order once every body is done,
+    // so the output doesn't depend on which worker got there first
+    vector_t<Node *> runLaters = vector_init<Node *>(4);
+    string errors;
+};
+
+class BytecodeGen;
+class Interpreter;
+
 class Semantic {
 public:
     bool encounteredErrors = false;
-    bool lvalueAssignmentContext = false;
-    bool addressOfContext = false;
-    bool dotContext = false;
-    Node *currentFnDecl = nullptr;
+
+    // per fn state, so every thread checking a body gets its own
+    static thread_local bool lvalueAssignmentContext;
+    static thread_local bool addressOfContext;
+    static thread_local bool dotContext;
+    static thread_local Node *currentFnDecl;
+
+    // the body this thread is checking, if it was deferred
+    static thread_local DeferredBody *currentBody;
+
+    // two phase mode: while set, resolving a fn decl only resolves its signature and queues the body.
+    // checkDeferredBodies then checks the queued bodies on worker threads
+    bool deferBodies = false;
+    vector_t<DeferredBody *> deferredBodies = vector_init<DeferredBody *>(256);
+
+    // set while workers are checking bodies. a worker takes sharedLock for anything outside its own body:
+    // other decls and types, lookups in shared scopes, polymorph instantiation, copies, and compile time execution
+    bool checkingInParallel = false;
+    recursive_mutex sharedLock;
+
+    // the state of each deferred body. compile time code can only be generated once every body it calls is finished
+    mutex bodiesLock;
+    hash_t<Node *, DeferredBody *> *deferredBodyFor = hash_init<Node *, DeferredBody *>(256);
+
+    // this thread's copies of bodies other workers hadn't finished when its compile time code needed them
+    static thread_local hash_t<Node *, DeferredBody *> *shadowBodies;
+
+    // errors from checking those copies. guarded by sharedLock, and only printed if the original didn't report them
+    vector<string> shadowErrors;
 
     vector_t<string *> linkLibs = vector_init<string *>(4);
-    vector_t<Polymorphed> polymorphs = vector_init<Polymorphed>(32);
+
+    // keyed by polymorphKey(target, givenParams), collisions are told apart with polymorphMatches
+    hash_t<uint64_t, vector_t<Polymorphed> *> *polymorphs = hash_init<uint64_t, vector_t<Polymorphed> *>(256);
+    hash_t<Node *, PolymorphCounts *> *polymorphCountsByTarget = hash_init<Node *, PolymorphCounts *>(64);
+    vector_t<PolymorphCounts *> polymorphCounts = vector_init<PolymorphCounts *>(16);
 
     vector_t<Node *> contexts = vector_init<Node *>(16);
     vector_t<Node *> contextInits = vector_init<Node *>(16);
@@ -31,7 +113,7 @@ public:
     bool canContext = false;
     vector_t<Node *> postContexts = vector_init<Node *>(16);
 
-    vector_t<StructTypeData> structsToSize = vector_init<StructTypeData>(256);
+    vector_t<Node *> structsToSize = vector_init<Node *>(256);
 
     bool canRun = false;
     vector_t<Node *> runLaters = vector_init<Node *>(16);
@@ -39,6 +121,16 @@ public:
     Lexer *lexer = nullptr;
     Parser *parser = nullptr;
 
+    // one compile time execution engine for the whole compilation, shared by every constantize.
+    // fns it has generated stay generated (and loaded libs stay loaded) between runs, so each run only generates what's new
+    BytecodeGen *ctfeGen = nullptr;
+    Interpreter *ctfeInterp = nullptr;
+
+    // anything compile time code did besides compute a value (output, extern calls) is lost if the program is loaded from cache
+    bool ctfeHadSideEffects = false;
+
+    hash_t<uint64_t, CopyTemplate *> *copyTemplates = hash_init<uint64_t, CopyTemplate *>(256);
+
     void addStaticIfs(Scope *target, Scope *importInto = nullptr);
     void addImports(vector_t<Node *> imports, vector_t<Node *> impls, vector_t<Node *> contexts, vector_t<Node *> contextInits);
 
@@ -49,8 +141,14 @@ public:
     void reportError(vector<Node *> affectedNodes, Error error);
     void resolveTypes(Node *node);
     void addLocal(Node *local);
-    Node *findExistingPolymorph(Node *polymorph, vector_t<Node *> givenParams);
+    Node *findExistingPolymorph(Node *polymorph, vector_t<Node *> givenParams, uint64_t *key);
+    void addPolymorph(uint64_t key, Polymorphed polymorphed);
     void sizeStructs();
+    void checkDeferredBodies(unsigned int threadCount);
+    Node *compileTimeBody(Node *fn);
+    bool readyBody(Node *fn);
+    Node *findSymbol(Scope *scope, int64_t atomId);
+    void releaseCompileTimeNodes();
 };
 
 bool assignParams(Semantic *semantic, Node *errorReportTarget, const vector_t<Node *> &declParams, vector_t<Node *> &givenParams, bool reportError = true);
@@ -0,0 +1,501 @@
+#include "serve.h"
+#include "llvmgen.h"
+#include "modulecache.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+struct WatchedFile {
+    string path;
+    uint64_t hash;
+};
+
+// each program's parse lives in its own process forked from the server, which forks every build/run of the program
+// from itself. re-parsing starts a new one and lets the old one exit once its requests are done, which gives the
+// old AST back all at once
+struct WatchedProgram {
+    string inputFile;
+
+    // -1 if the last parse failed, in which case each request is built from scratch (and reports the errors)
+    pid_t holder = -1;
+    int channel = -1;
+
+    vector<WatchedFile> files;
+};
+
+// a forked build/run, whose exit status goes back over conn once it's done
+struct RunningRequest {
+    pid_t pid;
+    int conn;
+};
+
+int watcher = -1;
+hash_t<string, int> *watchedDirs = hash_init<string, int>(16);
+
+// SIGCHLD just pokes the poll loop, children are reaped there
+int childSignal[2] = {-1, -1};
+
+void onChildExited(int) {
+    auto savedErrno = errno;
+    char c = 0;
+    write(childSignal[1], &c, 1);
+    errno = savedErrno;
+}
+
+void watchChildren() {
+    if (childSignal[0] >= 0) {
+        close(childSignal[0]);
+        close(childSignal[1]);
+    }
+
+    pipe(childSignal);
+    fcntl(childSignal[0], F_SETFL, O_NONBLOCK);
+    fcntl(childSignal[1], F_SETFL, O_NONBLOCK);
+
+    signal(SIGCHLD, onChildExited);
+}
+
+void drainChildSignal() {
+    char buffer[64];
+    while (read(childSignal[0], buffer, sizeof(buffer)) > 0) {}
+}
+
+string directoryOf(const string &path) {
+    auto lastSlash = path.rfind('/');
+    if (lastSlash == string::npos) { return "."; }
+    return path.substr(0, lastSlash);
+}
+
+void watchDirectoryOf(const string &path) {
+#ifdef __linux__
+    // watch the directory rather than the file, since editors tend to save by replacing the file
+    auto dir = directoryOf(path);
+    if (watcher < 0 || hash_get(watchedDirs, dir) != nullptr) { return; }
+
+    auto wd = inotify_add_watch(watcher, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    hash_insert(watchedDirs, dir, wd);
+#endif
+}
+
+bool hasChanged(WatchedProgram *program) {
+    if (program->holder < 0) { return true; }
+
+    for (auto &file : program->files) {
+        string contents;
+        if (!readFileContents(file.path, &contents) || fnv1a(contents) != file.hash) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool readLine(int fd, string *line) {
+    char c;
+    while (read(fd, &c, 1) == 1) {
+        if (c == '\n') { return true; }
+        line->push_back(c);
+    }
+    return false;
+}
+
+// the exit status follows everything the child printed, after a 0 byte so the client can tell it apart
+void sendExitStatus(int conn, int status) {
+    auto code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    auto trailer = string(1, '\0') + to_string(code) + "\n";
+    write(conn, trailer.c_str(), trailer.size());
+}
+
+void reapFinished(vector<RunningRequest> &running) {
+    int status = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (auto it = running.begin(); it != running.end(); ++it) {
+            if (it->pid != pid) { continue; }
+
+            sendExitStatus(it->conn, status);
+            close(it->conn);
+            running.erase(it);
+            break;
+        }
+    }
+}
+
+// passes a client's connection (and whether it's a run) on to a program's holder
+void sendConnection(int channel, bool run, int conn) {
+    char command = run ? 'r' : 'b';
+    iovec io = {&command, 1};
+
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    auto cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &conn, sizeof(int));
+
+    sendmsg(channel, &message, 0);
+}
+
+bool receiveConnection(int channel, bool *run, int *conn) {
+    char command;
+    iovec io = {&command, 1};
+
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(channel, &message, 0) <= 0) { return false; }
+
+    auto cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) { return false; }
+
+    *run = command == 'r';
+    memcpy(conn, CMSG_DATA(cmsg), sizeof(int));
+    return true;
+}
+
+// in a fork of the server or a holder: hand the request's output to its client and carry on as a normal invocation
+ServeRequest startRequest(int conn, const string &inputFile, bool run, Parser *parser) {
+    signal(SIGCHLD, SIG_DFL);
+    close(childSignal[0]);
+    close(childSignal[1]);
+
+    dup2(conn, 1);
+    dup2(conn, 2);
+    close(conn);
+
+    return ServeRequest{inputFile, run, parser};
+}
+
+// in the holder: tell the server which files went into the parse, then fork every request the server passes on.
+// only returns in those forks. once the server lets go of the channel, whatever is still running is finished and
+// the holder exits
+ServeRequest hold(WatchedProgram *program, Parser *parser) {
+    // imports are relative to the program's directory, which only the holder is in
+    char cwd[PATH_MAX] = {};
+    getcwd(cwd, sizeof(cwd));
+
+    for (unsigned long i = 0; i < sourceFiles.length; i++) {
+        auto file = vector_at(sourceFiles, i);
+        if (file->fileName == nullptr || file->source == nullptr) { continue; }
+
+        auto path = (*file->fileName)[0] == '/' ? *file->fileName : string(cwd) + "/" + *file->fileName;
+        auto line = path + "\n" + to_string(fnv1a(*file->source)) + "\n";
+        write(program->channel, line.c_str(), line.size());
+    }
+    write(program->channel, "\n", 1);
+
+    vector<RunningRequest> running;
+    auto serverConnected = true;
+
+    while (serverConnected || !running.empty()) {
+        pollfd fds[2] = {{childSignal[0], POLLIN, 0}, {serverConnected ? program->channel : -1, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) { continue; }
+
+        if (fds[0].revents & POLLIN) {
+            drainChildSignal();
+            reapFinished(running);
+        }
+
+        if (!(fds[1].revents & (POLLIN | POLLHUP))) { continue; }
+
+        bool run;
+        int conn;
+        if (!receiveConnection(program->channel, &run, &conn)) {
+            serverConnected = false;
+            continue;
+        }
+
+        cout.flush();
+        auto pid = fork();
+        if (pid == 0) {
+            close(program->channel);
+            for (auto &r : running) { close(r.conn); }
+
+            return startRequest(conn, program->inputFile, run, parser);
+        }
+
+        // builds of the same program would write the same output, so only runs go on alongside each other
+        if (run) {
+            running.push_back(RunningRequest{pid, conn});
+            continue;
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        sendExitStatus(conn, status);
+        close(conn);
+    }
+
+    _exit(0);
+}
+
+// lets the current holder (if any) finish up, and parses the program again in a new one.
+// true in a request forked from the new holder, which is then in request
+bool reparse(WatchedProgram *program, int listener, vector_t<WatchedProgram *> &programs, vector<RunningRequest> &running,
+             ServeRequest *request) {
+    if (program->holder >= 0) {
+        close(program->channel);
+        program->holder = -1;
+        program->channel = -1;
+    }
+    program->files.clear();
+
+    int channel[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, channel);
+
+    cout.flush();
+    auto pid = fork();
+    if (pid == 0) {
+        close(listener);
+        if (watcher >= 0) { close(watcher); }
+        for (auto p : programs) {
+            if (p->channel >= 0) { close(p->channel); }
+        }
+        for (auto &r : running) { close(r.conn); }
+        close(channel[0]);
+        watchChildren();
+
+        // a parse error exits the holder, and the request builds from scratch to report it
+        auto devNull = open("/dev/null", O_WRONLY);
+        auto savedOut = dup(1);
+        auto savedErr = dup(2);
+        dup2(devNull, 1);
+        dup2(devNull, 2);
+
+        // imports are found relative to the program's directory
+        chdir(directoryOf(program->inputFile).c_str());
+
+        forgetParsedModules();
+        auto parser = parseProgram(program->inputFile);
+
+        dup2(savedOut, 1);
+        dup2(savedErr, 2);
+        close(savedOut);
+        close(savedErr);
+        close(devNull);
+
+        program->channel = channel[1];
+        *request = hold(program, parser);
+        return true;
+    }
+
+    close(channel[1]);
+
+    // the file list, ending with an empty line. anything short of that means the parse failed
+    auto parsed = false;
+    while (true) {
+        string path;
+        string hash;
+        if (!readLine(channel[0], &path)) { break; }
+        if (path.empty()) {
+            parsed = true;
+            break;
+        }
+        if (!readLine(channel[0], &hash)) { break; }
+
+        program->files.push_back(WatchedFile{path, strtoull(hash.c_str(), nullptr, 10)});
+        watchDirectoryOf(path);
+    }
+
+    if (!parsed) {
+        close(channel[0]);
+        waitpid(pid, nullptr, 0);
+
+        program->files.clear();
+        watchDirectoryOf(program->inputFile);
+        return false;
+    }
+
+    program->holder = pid;
+    program->channel = channel[0];
+    return false;
+}
+
+string defaultServeSocketPath() {
+    auto home = getenv("HOME");
+    if (home == nullptr) { return "/tmp/cpi-serve.sock"; }
+
+    return string(home) + "/.cpi/serve.sock";
+}
+
+ServeRequest serve(const string &socketPath) {
+    initializeLlvmTargets();
+
+    // a client going away mid-reply shouldn't take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    mkdir(directoryOf(socketPath).c_str(), 0755);
+
+    auto listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    unlink(socketPath.c_str());
+    if (bind(listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        cout << "could not listen on " << socketPath << endl;
+        exit(1);
+    }
+
+#ifdef __linux__
+    watcher = inotify_init1(IN_NONBLOCK);
+#endif
+
+    cout << "serving on " << socketPath << endl;
+
+    auto programs = vector_init<WatchedProgram *>(4);
+
+    // requests built from scratch by the server itself, because their program didn't parse
+    vector<RunningRequest> running;
+
+    watchChildren();
+
+    ServeRequest request;
+
+    while (true) {
+        pollfd fds[3] = {{listener, POLLIN, 0}, {childSignal[0], POLLIN, 0}, {watcher, POLLIN, 0}};
+        if (poll(fds, watcher >= 0 ? 3 : 2, -1) < 0) { continue; }
+
+        // finished holders are reaped along with these
+        if (fds[1].revents & POLLIN) {
+            drainChildSignal();
+            reapFinished(running);
+        }
+
+        if (watcher >= 0 && (fds[2].revents & POLLIN)) {
+            // which file it was doesn't matter much, checking every program against its hashes is cheap
+            char events[4096];
+            while (read(watcher, events, sizeof(events)) > 0) {}
+
+            for (auto program : programs) {
+                if (hasChanged(program) && reparse(program, listener, programs, running, &request)) {
+                    return request;
+                }
+            }
+        }
+
+        if (!(fds[0].revents & POLLIN)) { continue; }
+
+        auto conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) { continue; }
+
+        // <build|run> <absolute path to a .cpi file>
+        string line;
+        readLine(conn, &line);
+
+        auto space = line.find(' ');
+        auto command = line.substr(0, space);
+        auto inputFile = space == string::npos ? "" : line.substr(space + 1);
+
+        if ((command != "build" && command != "run") || inputFile.empty()) {
+            auto error = string("expected 'build <file>' or 'run <file>'\n");
+            write(conn, error.c_str(), error.size());
+            sendExitStatus(conn, 1 << 8);
+            close(conn);
+            continue;
+        }
+
+        WatchedProgram *program = nullptr;
+        for (auto p : programs) {
+            if (p->inputFile == inputFile) {
+                program = p;
+            }
+        }
+        if (program == nullptr) {
+            program = new WatchedProgram();
+            program->inputFile = inputFile;
+            vector_append(programs, program);
+        }
+
+        // in case a change came in without an event (or there's no inotify here)
+        if (hasChanged(program) && reparse(program, listener, programs, running, &request)) {
+            return request;
+        }
+
+        if (program->holder >= 0) {
+            sendConnection(program->channel, command == "run", conn);
+            close(conn);
+            continue;
+        }
+
+        // it didn't parse, so the build parses it again itself and reports why
+        cout.flush();
+        auto pid = fork();
+        if (pid == 0) {
+            close(listener);
+            if (watcher >= 0) { close(watcher); }
+            for (auto p : programs) {
+                if (p->channel >= 0) { close(p->channel); }
+            }
+            for (auto &r : running) { close(r.conn); }
+
+            chdir(directoryOf(inputFile).c_str());
+            return startRequest(conn, inputFile, command == "run", nullptr);
+        }
+
+        running.push_back(RunningRequest{pid, conn});
+    }
+}
+
+int sendServeRequest(const string &socketPath, const string &command, const string &inputFile) {
+    auto conn = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    if (connect(conn, (sockaddr *) &address, sizeof(address)) != 0) {
+        cout << "no cpi --serve listening on " << socketPath << endl;
+        return 1;
+    }
+
+    auto line = command + " " + inputFile + "\n";
+    write(conn, line.c_str(), line.size());
+
+    // everything up to the last 0 byte so far can be printed right away, the exit status can only come after it
+    string pending;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(conn, buffer, sizeof(buffer))) > 0) {
+        pending.append(buffer, (size_t) count);
+
+        auto lastZero = pending.rfind('\0');
+        auto printable = lastZero == string::npos ? pending.size() : lastZero;
+        fwrite(pending.data(), 1, printable, stdout);
+        pending.erase(0, printable);
+    }
+
+    close(conn);
+
+    // the server went away before the build/run finished
+    if (pending.empty() || pending[0] != '\0' || pending.back() != '\n') {
+        fwrite(pending.data(), 1, pending.size(), stdout);
+        fflush(stdout);
+        return 1;
+    }
+    fflush(stdout);
+
+    return atoi(pending.c_str() + 1);
+}
@@ -0,0 +1,26 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "parser.h"
+
+struct ServeRequest {
+    string inputFile;
+    bool run;
+
+    // already parsed by the server, so the forked build only has to resolve and generate it
+    Parser *parser;
+};
+
+string defaultServeSocketPath();
+
+// --serve: stay resident with the llvm targets initialized. the server itself never parses: each requested program is
+// parsed in a holder process forked from it, which keeps that parse (and the atoms it interned) in memory. watched
+// files are re-parsed in a new holder as soon as they change, and each build/run request is handled in a fork of its
+// program's holder. only returns in that fork, which then carries on like a normal invocation on the request's file,
+// #link libs included: those are dlopened by every request that runs compile time code or the program
+ServeRequest serve(const string &socketPath);
+
+// --request build|run: hand a file to a running --serve, print everything the build/run prints, and return its exit code
+int sendServeRequest(const string &socketPath, const string &command, const string &inputFile);
+
+#endif // SERVE_H
@@ -0,0 +1,93 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// a fixed set of worker threads pulling jobs off one queue.
+// jobs are allowed to submit more jobs, and wait() only returns once nothing is queued or running
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threadCount) {
+        if (threadCount == 0) { threadCount = 1; }
+
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            unique_lock<mutex> guard(lock);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    void submit(function<void()> job) {
+        {
+            unique_lock<mutex> guard(lock);
+            jobs.push(move(job));
+            pending += 1;
+        }
+        workAvailable.notify_one();
+    }
+
+    void wait() {
+        unique_lock<mutex> guard(lock);
+        allDone.wait(guard, [this]() { return pending == 0; });
+    }
+
+private:
+    mutex lock;
+    condition_variable workAvailable;
+    condition_variable allDone;
+
+    queue<function<void()>> jobs;
+    vector<thread> workers;
+
+    // queued + running
+    int64_t pending = 0;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            function<void()> job;
+            {
+                unique_lock<mutex> guard(lock);
+                workAvailable.wait(guard, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) { return; }
+
+                job = move(jobs.front());
+                jobs.pop();
+            }
+
+            job();
+
+            {
+                unique_lock<mutex> guard(lock);
+                pending -= 1;
+                if (pending == 0) {
+                    allDone.notify_all();
+                }
+            }
+        }
+    }
+};
+
+inline unsigned int defaultThreadCount() {
+    auto count = thread::hardware_concurrency();
+    return count == 0 ? 4 : count;
+}
+
+#endif // THREADPOOL_H
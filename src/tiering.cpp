@@ -0,0 +1,240 @@
+#include "tiering.h"
+#include "interpreter.h"
+
+#include <algorithm>
+#include <ffi.h>
+
+// calls + loop iterations before a fn gets compiled
+const uint64_t tierUpThreshold = 1000;
+
+// args are passed through a fixed array on every native call
+const unsigned long maxTieredParams = 16;
+
+struct TieredFn {
+    Node *fn;
+
+    uint64_t heat = 0;
+
+    // queued for compiling, or found not to qualify. either way it's only ever looked at once
+    bool promoted = false;
+
+    // set by the compiler thread once the native code is ready
+    atomic<void *> native{nullptr};
+
+    ffi_cif cif;
+    vector<ffi_type *> argTypes;
+
+    // how far below sp each arg starts. the caller stores them last to first going up from its stack size
+    vector<int32_t> argOffsets;
+};
+
+// only types which are passed the same way to native code as they sit in the interpreter's frame
+ffi_type *scalarFfiType(Node *type, bool isReturn) {
+    type = resolve(type);
+    cpi_assert(type->type == NodeType::TYPE);
+
+    switch (type->typeData.kind) {
+        case NodeTypekind::NONE: return isReturn ? &ffi_type_void : nullptr;
+        case NodeTypekind::I8:
+        case NodeTypekind::U8:
+        case NodeTypekind::I16:
+        case NodeTypekind::U16:
+        case NodeTypekind::I32:
+        case NodeTypekind::U32:
+        case NodeTypekind::I64:
+        case NodeTypekind::U64:
+        case NodeTypekind::F32:
+        case NodeTypekind::F64:
+        case NodeTypekind::POINTER:
+            return ffiTypeFor(type);
+        case NodeTypekind::ENUM:
+            return scalarFfiType(type->typeData.enumTypeData.type, isReturn);
+        default:
+            return nullptr;
+    }
+}
+
+// the interpreter lays these out differently than llvm does: bools take 4 bytes, and fns are fn table indices
+bool hasInterpreterOnlyLayout(llvm::Type *type) {
+    if (type->isIntegerTy(1) || type->isFunctionTy()) { return true; }
+
+    // what a pointer points to only matters once it's dereferenced, which gets checked on its own
+    if (type->isPointerTy()) { return type->getPointerElementType()->isFunctionTy(); }
+
+    if (auto structType = llvm::dyn_cast<llvm::StructType>(type)) {
+        for (auto element : structType->elements()) {
+            if (hasInterpreterOnlyLayout(element)) { return true; }
+        }
+    }
+    if (type->isArrayTy()) { return hasInterpreterOnlyLayout(type->getArrayElementType()); }
+
+    return false;
+}
+
+// anything not derived from one of the fn's own allocas could be memory the interpreter reads or writes too
+bool isSharedMemory(llvm::Value *pointer) {
+    while (true) {
+        pointer = pointer->stripPointerCasts();
+        if (auto gep = llvm::dyn_cast<llvm::GEPOperator>(pointer)) {
+            pointer = gep->getPointerOperand();
+            continue;
+        }
+        return !llvm::isa<llvm::AllocaInst>(pointer);
+    }
+}
+
+// whether the fns in module can run against the interpreter's memory.
+// that rules out calls through fn pointers and fns used as values (the interpreter's are fn table indices, not
+// addresses), and touching bools or fn pointers anywhere but the fn's own locals
+bool nativeCompatible(llvm::Module &module) {
+    for (auto &fn : module) {
+        for (auto &bb : fn) {
+            for (auto &inst : bb) {
+                auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                if (call != nullptr && !llvm::isa<llvm::Function>(call->getCalledValue()->stripPointerCasts())) {
+                    return false;
+                }
+
+                for (auto &operand : inst.operands()) {
+                    auto isCallee = call != nullptr && operand.get() == call->getCalledValue();
+                    if (!isCallee && llvm::isa<llvm::Function>(operand.get()->stripPointerCasts())) {
+                        return false;
+                    }
+                }
+
+                if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+                    if (isSharedMemory(load->getPointerOperand()) && hasInterpreterOnlyLayout(load->getType())) {
+                        return false;
+                    }
+                }
+                else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+                    if (isSharedMemory(store->getPointerOperand())
+                        && hasInterpreterOnlyLayout(store->getValueOperand()->getType())) {
+                        return false;
+                    }
+                }
+                else if (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(&inst)) {
+                    if (isSharedMemory(gep->getPointerOperand()) && hasInterpreterOnlyLayout(gep->getSourceElementType())) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+Tiering::Tiering(const string &inputFile, vector_t<string *> &linkLibs, unsigned int optLevel, const string &cpu,
+                 Node *mainFn, hash_t<uint32_t, uint64_t> *fnTable, vector_t<Node *> &generatedNodes)
+        : inputFile(inputFile), optLevel(optLevel), cpu(cpu) {
+    fns = hash_init<uint64_t, TieredFn *>((int32_t) fnTable->size * 2 + 16);
+
+    for (auto node : generatedNodes) {
+        // main is only ever run from the top, never called, so there's no point compiling it
+        if (node->type != NodeType::FN_DECL || node == mainFn) { continue; }
+        if (node->fnDeclData.isExternal || node->fnDeclData.body.length == 0) { continue; }
+
+        auto index = hash_get(fnTable, node->fnDeclData.tableIndex);
+        if (index == nullptr || hash_get(fns, *index) != nullptr) { continue; }
+
+        auto tiered = new TieredFn();
+        tiered->fn = node;
+        hash_insert(fns, *index, tiered);
+        fnStarts.push_back(*index);
+    }
+
+    sort(fnStarts.begin(), fnStarts.end());
+
+    loadJitLibs(linkLibs);
+    jit = new Jit();
+}
+
+bool Tiering::callNative(Interpreter *interp, uint64_t index) {
+    auto found = hash_get(fns, index);
+    if (found == nullptr) { return false; }
+
+    auto tiered = *found;
+    auto native = tiered->native.load(memory_order_acquire);
+    if (native == nullptr) {
+        heatUp(tiered, 1);
+        return false;
+    }
+
+    void *args[maxTieredParams];
+    for (unsigned long i = 0; i < tiered->argOffsets.size(); i++) {
+        args[i] = interp->stack_base + interp->sp - tiered->argOffsets[i];
+    }
+
+    // the return value goes where the callee's RET would have left it: the start of its frame, just past the
+    // saved bp/pc. ffi writes at least a whole register there, which is still free stack
+    ffi_call(&tiered->cif, FFI_FN(native), interp->stack_base + interp->sp + 8, args);
+
+    return true;
+}
+
+void Tiering::backEdge(uint64_t target) {
+    // fns are laid out one after the other, so the loop is in the last one starting at or before its target
+    auto after = upper_bound(fnStarts.begin(), fnStarts.end(), target);
+    if (after == fnStarts.begin()) { return; }
+
+    auto found = hash_get(fns, *(after - 1));
+    if (found == nullptr) { return; }
+
+    heatUp(*found, 1);
+}
+
+void Tiering::heatUp(TieredFn *tiered, uint64_t amount) {
+    tiered->heat += amount;
+    if (tiered->promoted || tiered->heat < tierUpThreshold) { return; }
+
+    tiered->promoted = true;
+
+    auto fn = tiered->fn;
+    if (fn->fnDeclData.params.length > maxTieredParams) { return; }
+
+    auto returnType = scalarFfiType(fn->fnDeclData.returnType, true);
+    if (returnType == nullptr) { return; }
+
+    int32_t offset = 0;
+    for (auto param : fn->fnDeclData.params) {
+        auto paramType = scalarFfiType(param->paramData.type, false);
+        if (paramType == nullptr) { return; }
+
+        offset += typeSize(param->paramData.type);
+        tiered->argTypes.push_back(paramType);
+        tiered->argOffsets.push_back(offset);
+    }
+
+    // built here rather than on the compiler thread, ffiTypeFor isn't thread safe
+    if (ffi_prep_cif(&tiered->cif, FFI_DEFAULT_ABI, (unsigned int) tiered->argTypes.size(), returnType,
+                     tiered->argTypes.data()) != FFI_OK) {
+        return;
+    }
+
+    compiler.submit([this, tiered]() { compile(tiered); });
+}
+
+void Tiering::compile(TieredFn *tiered) {
+    auto llvmGen = new LlvmGen(inputFile.c_str(), optLevel, cpu);
+
+    llvmGen->gen(tiered->fn);
+
+    auto fn = (llvm::Function *) llvmGen->llvmData(tiered->fn);
+    if (fn == nullptr || !nativeCompatible(*llvmGen->module)) {
+        delete llvmGen;
+        return;
+    }
+
+    // it's called from outside the module now, so it has to stay around and be findable
+    fn->setLinkage(llvm::Function::ExternalLinkage);
+    fn->setName("__cpi_tiered_" + to_string(tiered->fn->fnDeclData.tableIndex));
+
+    llvmGen->finalize();
+
+    auto native = jit->add(llvmGen, fn);
+    delete llvmGen;
+
+    // if it didn't compile, it just stays interpreted
+    tiered->native.store(native, memory_order_release);
+}
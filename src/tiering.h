@@ -0,0 +1,45 @@
+#ifndef TIERING_H
+#define TIERING_H
+
+#include <atomic>
+
+#include "jit.h"
+#include "threadpool.h"
+
+class Interpreter;
+struct TieredFn;
+
+// --tiered: interpret, counting calls and loop back-edges per fn. a fn that gets hot is compiled with llvm on a
+// background thread, and from then on CALL/CALLI run it natively instead, with its args and return value passed
+// through the interpreter's frame.
+// only fns native code can share memory with the interpreter for qualify: scalar params and return value, and no
+// fn pointers or bools in anything they read or write outside their own locals (see nativeCompatible)
+class Tiering {
+public:
+    Tiering(const string &inputFile, vector_t<string *> &linkLibs, unsigned int optLevel, const string &cpu,
+            Node *mainFn, hash_t<uint32_t, uint64_t> *fnTable, vector_t<Node *> &generatedNodes);
+
+    // at a call to the fn starting at instruction index. true if it ran natively, and the interpreter should carry on
+    // after the call as if it had returned
+    bool callNative(Interpreter *interp, uint64_t index);
+
+    // at a jump back to target, i.e. once per loop iteration
+    void backEdge(uint64_t target);
+
+private:
+    string inputFile;
+    unsigned int optLevel;
+    string cpu;
+
+    // by the instruction index each fn starts at, plus those indices sorted for finding which fn a loop is in
+    hash_t<uint64_t, TieredFn *> *fns;
+    vector<uint64_t> fnStarts;
+
+    Jit *jit = nullptr;
+    ThreadPool compiler{1};
+
+    void heatUp(TieredFn *tiered, uint64_t amount);
+    void compile(TieredFn *tiered);
+};
+
+#endif // TIERING_H
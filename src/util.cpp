@@ -1,5 +1,6 @@
 #include "util.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -62,44 +63,113 @@ void cpi_assert(bool check) {
     }
 }
 
+vector_t<SourceFile *> sourceFiles = vector_init<SourceFile *>(16);
+mutex sourceFilesLock;
+
+SourceInfo addSourceFile(string *fileName, string *source) {
+    lock_guard<mutex> guard(sourceFilesLock);
+
+    if (sourceFiles.length == 0) {
+        // reserve 0 for nodes which don't come from any file
+        vector_append(sourceFiles, new SourceFile());
+    }
+
+    // the same buffer gets lexed more than once (copies, #run, imports), so don't register it twice
+    for (uint32_t i = 1; i < sourceFiles.length; i++) {
+        if (source != nullptr && sourceFiles.items[i]->source == source) {
+            return SourceInfo{i};
+        }
+    }
+
+    auto file = new SourceFile();
+    file->fileName = fileName;
+    file->source = source;
+    vector_append(sourceFiles, file);
+
+    return SourceInfo{static_cast<uint32_t>(sourceFiles.length - 1)};
+}
+
+SourceFile *sourceFileFor(SourceInfo srcInfo) {
+    lock_guard<mutex> guard(sourceFilesLock);
+
+    if (sourceFiles.length == 0) {
+        vector_append(sourceFiles, new SourceFile());
+    }
+
+    cpi_assert(srcInfo.fileId < sourceFiles.length);
+    return sourceFiles.items[srcInfo.fileId];
+}
+
+LineCol lineColFor(SourceInfo srcInfo, Location location) {
+    auto file = sourceFileFor(srcInfo);
+    if (file->source == nullptr) {
+        return {1, 1};
+    }
+
+    // parse errors can be reported from several threads at once
+    lock_guard<mutex> guard(sourceFilesLock);
+    if (!file->linesBuilt) {
+        file->lines = vector_init<uint32_t>(64);
+        vector_append(file->lines, (uint32_t) 0);
+        for (uint32_t i = 0; i < file->source->length(); i++) {
+            if (file->source->at(i) == '\n') {
+                vector_append(file->lines, i + 1);
+            }
+        }
+        file->linesBuilt = true;
+    }
+
+    // last line starting at or before the location
+    auto lineStart = upper_bound(begin(file->lines), end(file->lines), location.byteIndex) - 1;
+
+    uint32_t col = 1;
+    for (auto i = *lineStart; i < location.byteIndex && i < file->source->length(); i += bytesInCodepoint(file->source->at(i))) {
+        col += 1;
+    }
+
+    return {static_cast<uint32_t>(lineStart - begin(file->lines)) + 1, col};
+}
+
 ostream &operator<<(ostream &os, Location location) {
-    return os << "("
-              << location.line << ", " << location.col
-              << ")";
+    return os << "(" << location.byteIndex << ")";
 }
 
 ostream &operator<<(ostream &os, Region region) {
-    return os << "[" << region.start << " - " << region.end << "]";
+    auto start = lineColFor(region.srcInfo, region.start);
+    auto end = lineColFor(region.srcInfo, region.end);
+    return os << "[(" << start.line << ", " << start.col << ") - (" << end.line << ", " << end.col << ")]";
 }
 
 ostream &operator<<(ostream &os, SourceRegion region) {
-    return os << region.region.srcInfo.source->substr(region.region.start.byteIndex,
+    return os << sourceFileFor(region.region.srcInfo)->source->substr(region.region.start.byteIndex,
                                              region.region.end.byteIndex - region.region.start.byteIndex);
 }
 
 ostream &operator<<(ostream &os, SourceInfoRegion region) {
     ostringstream message("");
 
-    if (region.region.srcInfo.fileName == nullptr) {
+    auto file = sourceFileFor(region.region.srcInfo);
+    if (file->fileName == nullptr) {
         return os;
     }
 
-    message << *region.region.srcInfo.fileName
-            << ":" << region.region.start.line
-            << ":" << region.region.start.col << ": ";
+    auto start = lineColFor(region.region.srcInfo, region.region.start);
+    message << *file->fileName
+            << ":" << start.line
+            << ":" << start.col << ": ";
     return os << Colored<string>{message.str(), {Color::FG_DEFAULT}, 1};
 }
 
 ostream &operator<<(ostream &os, HighlightedRegion region) {
-    if (region.region.srcInfo.fileName == nullptr) {
+    auto file = sourceFileFor(region.region.srcInfo);
+    if (file->fileName == nullptr) {
         return os << "NO SOURCE INFO" << endl;
     }
 
-    auto startLine = region.region.start.line;
-    if (startLine > 0) { startLine -= 1; }
+    auto startLine = lineColFor(region.region.srcInfo, region.region.start).line - 1;
 
-    auto startSrc = vector_at(region.region.srcInfo.lines, (int64_t) startLine);
-    for (auto i = startSrc; i < region.region.srcInfo.source->length() && region.region.srcInfo.source->at(i) != '\n'; i++) {
+    auto startSrc = vector_at(file->lines, startLine);
+    for (auto i = startSrc; i < file->source->length() && file->source->at(i) != '\n'; i++) {
         Colored<string> colored;
         if (i == region.region.start.byteIndex) {
             os << "\e[" << Color::BG_MAGENTA << ";" << Color::FG_DARK_GREY << "m";
@@ -108,7 +178,7 @@ ostream &operator<<(ostream &os, HighlightedRegion region) {
             os << Colored<string>{"", {}};
         }
 
-        os << region.region.srcInfo.source->at(i);
+        os << file->source->at(i);
     }
 
     return os << Colored<string>{"", {}} << endl;
@@ -264,7 +334,7 @@ ostream &operator<<(ostream &os, TypeData td) {
             os << "}";
         } break;
         case NodeTypekind::SYMBOL: {
-            os << atomTable->backwardAtoms[td.symbolTypeData.atomId];
+            os << atomTable->nameOf(td.symbolTypeData.atomId);
         } break;
         case NodeTypekind::POINTER: {
             os << "*";
@@ -305,7 +375,7 @@ ostream &operator<<(ostream &os, Node *node) {
             cout << "}" << endl;
         } break;
         case NodeType::SYMBOL:{
-            auto sym = atomTable->backwardAtoms[node->symbolData.atomId];
+            auto sym = atomTable->nameOf(node->symbolData.atomId);
             cout << sym;
         } break;
         case NodeType::DECL: {
@@ -489,6 +559,8 @@ bool isNumericType(Node *type) {
 //  ATOMS  //
 /////////////
 int64_t AtomTable::insertStr(string s) {
+    lock_guard<mutex> guard(lock);
+
     auto found = hash_get(atoms, s);
     if (found != nullptr) {
         return *found;
@@ -501,7 +573,9 @@ int64_t AtomTable::insertStr(string s) {
 }
 
 int64_t AtomTable::insert(Region &r) {
-    auto sourceStr = r.srcInfo.source->substr(r.start.byteIndex, r.end.byteIndex - r.start.byteIndex);
+    auto sourceStr = sourceFileFor(r.srcInfo)->source->substr(r.start.byteIndex, r.end.byteIndex - r.start.byteIndex);
+
+    lock_guard<mutex> guard(lock);
 
     auto found = hash_get(atoms, sourceStr);
     if (found != nullptr) {
@@ -514,6 +588,11 @@ int64_t AtomTable::insert(Region &r) {
     return tableIndex;
 }
 
+string AtomTable::nameOf(int64_t atomId) {
+    lock_guard<mutex> guard(lock);
+    return backwardAtoms[atomId];
+}
+
 bool hasNoLocalByDefault(Node *node) {
     switch (resolve(node)->type) {
         case NodeType::INT_LITERAL:
@@ -7,19 +7,23 @@
 #include <iostream>
 #include <unordered_map>
 #include <memory.h>
+#include <atomic>
+#include <mutex>
 
 #include "container.h"
 
 using namespace std;
 
-extern unsigned long nodeId;
-extern unsigned long fnTableId;
+// parsing runs on several threads at once (see importPool), so these are bumped atomically
+extern atomic<unsigned long> nodeId;
+extern atomic<unsigned long> fnTableId;
 extern int debugFlag;
 extern int noIppFlag;
+extern int noCtfeCacheFlag;
 
 extern int reusedPolymorphs;
 extern int newPolymorphs;
-extern int totalLines;
+extern atomic<int> totalLines;
 
 const char *readFile(const char *fileName);
 
@@ -216,19 +220,37 @@ enum class LexerTokenType : int32_t {
     TYPE_STMT,
 };
 
-struct SourceInfo {
+struct SourceFile {
     string *fileName = nullptr;
     string *source = nullptr;
 
-    vector_t<unsigned long> lines = vector_init<unsigned long>(100);
+    // byte offset of the start of each line, only built once someone asks for a line/col
+    vector_t<uint32_t> lines;
+    bool linesBuilt = false;
+};
+
+// every file the compiler has seen, indexed by SourceInfo::fileId. slot 0 is 'no file'.
+// entries are never moved, so a SourceFile * stays valid while other threads register files
+extern vector_t<SourceFile *> sourceFiles;
+
+struct SourceInfo {
+    uint32_t fileId = 0;
 };
 
+SourceInfo addSourceFile(string *fileName, string *source);
+SourceFile *sourceFileFor(SourceInfo srcInfo);
+
 struct Location {
-    unsigned long byteIndex;
-    unsigned long line = 1;
-    unsigned long col = 1;
+    uint32_t byteIndex = 0;
+};
+
+struct LineCol {
+    uint32_t line;
+    uint32_t col;
 };
 
+LineCol lineColFor(SourceInfo srcInfo, Location location);
+
 struct Region {
     SourceInfo srcInfo = {};
     Location start = {};
@@ -319,14 +341,15 @@ struct FnDeclData {
     vector_t<Node *> returns;
     Scope *bodyScope;
 
-    int32_t stackSize;
     uint64_t instOffset;
+    int64_t debugLocalOffset;
+    int32_t stackSize;
+    uint32_t tableIndex;
+
     bool isLiteral;
     bool isExternal;
-    uint32_t tableIndex;
     bool cameFromPolymorph;
     bool isImpl;
-    int64_t debugLocalOffset;
     bool skipContext;
 };
 
@@ -396,18 +419,14 @@ struct StructLiteralData {
 struct StringLiteralData {
     string *value;
     Node *allocFn;
+
+    // only for [allocFn]"..." literals. the rest keep their characters in read-only data and copy them into buffer
     Node *arrayLiteralRepresentation;
+    Node *buffer;
 };
 
-struct IfData {
-    Node *condition;
-    vector_t<Node *> stmts;
-    vector_t<Node *> elseStmts;
-
-    bool isStatic;
-    Scope *ifScope;
-    Scope *elseScope;
-
+// what a static if brings in, depending on which way it goes
+struct StaticIfData {
     vector_t<Node *> trueImports;
     vector_t<Node *> falseImports;
 
@@ -421,6 +440,19 @@ struct IfData {
     vector_t<Node *> falseImpls;
 };
 
+struct IfData {
+    Node *condition;
+    vector_t<Node *> stmts;
+    vector_t<Node *> elseStmts;
+
+    bool isStatic;
+    Scope *ifScope;
+    Scope *elseScope;
+
+    // only set when isStatic, see initStaticIfData
+    StaticIfData *staticIfData;
+};
+
 struct WhileData {
     Node *condition;
     vector_t<Node *> stmts;
@@ -542,19 +574,62 @@ public:
     Node *find(int64_t atomId);
 };
 
+// the operand instruction a node's value is read through: a CONST, a REL*, or a fn's RELCONSTI32 table index.
+// that's never more than an instruction and 8 bytes, so it's kept in the node instead of a heap allocated buffer
+struct NodeBytecode {
+    unsigned char bytes[9];
+    uint8_t length;
+
+    unsigned long size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    void resize(unsigned long newLength) {
+        cpi_assert(newLength <= sizeof(bytes));
+        length = static_cast<uint8_t>(newLength);
+    }
+
+    void push_back(unsigned char byte) {
+        resize(length + 1);
+        bytes[length - 1] = byte;
+    }
+
+    unsigned char &operator[](unsigned long index) { return bytes[index]; }
+    const unsigned char &operator[](unsigned long index) const { return bytes[index]; }
+
+    const unsigned char *begin() const { return bytes; }
+    const unsigned char *end() const { return bytes + length; }
+};
+
 class Node {
 public:
     unsigned long id;
 
-    Region region = {};
+    // hot: touched on every walk through Semantic::resolveTypes / BytecodeGen::gen
+    NodeType type;
+
+    bool semantic : 1;
+    bool isLocal : 1;
+    bool isBytecodeLocal : 1;
+    bool isDeferred : 1;
+    bool sourceMapStatement : 1;
+    bool skipAllButPostStmts : 1;
+
+    // cold: one-shot guards for error reporting, printing and the backends
+    bool isUsedInError : 1;
+    bool printed : 1;
+    bool tagCheck : 1;
+    bool debugBytecodeAdjusted : 1;
+
+    uint32_t genId = 0;
+
     Scope *scope = nullptr;
     Node *typeInfo = nullptr;
     Node *resolved = nullptr;
+    Node *staticValue = nullptr;
     Node *bytecodeResolved = nullptr;
-    NodeType type;
 
-    vector_t<Node *> preStmts = vector_init<Node *>(10);
-    vector_t<Node *> postStmts = vector_init<Node *>(10);
+    // the offset of the storage for this node from the current base pointer
+    int64_t localOffset = 0;
 
     union {
         Node *nodeData;
@@ -592,31 +667,14 @@ public:
         ContextData contextData;
     };
 
-    Node *staticValue = nullptr;
-
-    bool isUsedInError = false;
-    bool semantic = false;
-    bool printed = false;
-    bool tagCheck = false;
-    bool llvmGen = false;
-    bool sourceMapStatement = false;
-    bool isDeferred = false;
-
-    uint32_t genId = 0;
-
-    // todo(chad): better way to store this?
-    vector<unsigned char> bytecode;
-    bool isLocal = false;
-
-    bool isBytecodeLocal = false;
-    bool skipAllButPostStmts = false;
-    bool debugBytecodeAdjusted = false;
+    // almost every node has none of these, so they're only allocated by the first appendStmt
+    vector_t<Node *> *preStmts = nullptr;
+    vector_t<Node *> *postStmts = nullptr;
 
-    // the offset of the storage for this node from the current base pointer
-    int64_t localOffset = 0;
+    Region region = {};
 
-    void *llvmLocal = nullptr;
-    void *llvmData = nullptr;
+    // how other nodes read this one's value
+    NodeBytecode bytecode = {};
 
     Node(Region r = {});
     explicit Node(NodeTypekind typekind);
@@ -751,6 +809,9 @@ struct SourceMapStatement {
 struct SourceMap {
     SourceInfo sourceInfo = {};
     vector<SourceMapStatement> statements = {};
+
+    // the JUMPIF of every if/while, instIndex being just past its opcode (for --profile-out)
+    vector<SourceMapStatement> branches = {};
 };
 
 bool isFloatType(Node *type);
@@ -762,10 +823,17 @@ bool isNumericType(Node *type);
 class AtomTable {
 public:
     hash_t<string, int64_t> *atoms;
-    vector<string> backwardAtoms;
+
+    // parsers, semantic workers and bytecode workers on different threads all intern into the same table,
+    // and interning can grow backwardAtoms out from under a reader, so names are only read through nameOf
+    mutex lock;
 
     int64_t insert(Region &r);
     int64_t insertStr(string s);
+    string nameOf(int64_t atomId);
+
+private:
+    vector<string> backwardAtoms;
 };
 
 extern AtomTable *atomTable;